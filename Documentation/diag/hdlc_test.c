@@ -0,0 +1,402 @@
+/*
+ * hdlc_test.c - userspace check of the CRC-CCITT and diag HDLC code
+ *
+ * Builds lib/crc-ccitt.c and drivers/char/diag/diagchar_hdlc.c as they
+ * are in the tree and compares them against the plain bytewise versions
+ * they replaced: first on known vectors, then on random buffers at every
+ * alignment, cut into random fragments so that the partial-buffer state
+ * of the encoder and decoder is exercised as well.
+ *
+ *	make -C Documentation/diag check
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* What the kernel headers, emptied by the Makefile, would provide */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint32_t __le32;
+
+#define EXPORT_SYMBOL(sym)
+#define MODULE_LICENSE(s)
+#define MODULE_DESCRIPTION(s)
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define le32_to_cpu(x)	(x)
+#else
+#define le32_to_cpu(x)	__builtin_bswap32(x)
+#endif
+
+#define min(x, y) ({				\
+	typeof(x) _min1 = (x);			\
+	typeof(y) _min2 = (y);			\
+	(void) (&_min1 == &_min2);		\
+	_min1 < _min2 ? _min1 : _min2; })
+
+extern u16 const crc_ccitt_table[256];
+
+static inline u16 crc_ccitt_byte(u16 crc, const u8 c)
+{
+	return (crc >> 8) ^ crc_ccitt_table[(crc ^ c) & 0xff];
+}
+
+u16 crc_ccitt(u16 crc, u8 const *buffer, size_t len);
+
+#include "../../lib/crc-ccitt.c"
+#include "../../drivers/char/diag/diagchar_hdlc.c"
+
+/*
+ * Reference versions.  The CRC is computed bit by bit, independently of
+ * the tables; the encoder and decoder are the bytewise loops the
+ * word-at-a-time code replaced.
+ */
+static u16 ref_crc_ccitt(u16 crc, const u8 *p, size_t len)
+{
+	int bit;
+
+	while (len--) {
+		crc ^= *p++;
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (crc & 1 ? 0x8408 : 0);
+	}
+	return crc;
+}
+
+static void ref_hdlc_encode(struct diag_send_desc_type *src_desc,
+			    struct diag_hdlc_dest_type *enc)
+{
+	uint8_t *dest = enc->dest;
+	uint8_t *dest_last = enc->dest_last;
+	const uint8_t *src = src_desc->pkt;
+	const uint8_t *src_last = src_desc->last;
+	enum diag_send_state_enum_type state = src_desc->state;
+	uint16_t crc;
+	uint8_t src_byte;
+
+	if (state == DIAG_STATE_START) {
+		crc = CRC_16_L_SEED;
+		state++;
+	} else {
+		crc = enc->crc;
+	}
+
+	while (src <= src_last && dest <= dest_last) {
+		src_byte = *src++;
+		if (src_byte == CONTROL_CHAR || src_byte == ESC_CHAR) {
+			if (dest == dest_last) {
+				src--;
+				break;
+			}
+			crc = ref_crc_ccitt(crc, &src_byte, 1);
+			*dest++ = ESC_CHAR;
+			*dest++ = src_byte ^ ESC_MASK;
+		} else {
+			crc = ref_crc_ccitt(crc, &src_byte, 1);
+			*dest++ = src_byte;
+		}
+	}
+
+	if (src > src_last) {
+		if (state == DIAG_STATE_BUSY) {
+			if (src_desc->terminate) {
+				crc = ~crc;
+				state++;
+			} else {
+				state = DIAG_STATE_COMPLETE;
+			}
+		}
+		while (dest <= dest_last && state >= DIAG_STATE_CRC1 &&
+		       state < DIAG_STATE_TERM) {
+			src_byte = crc & 0xff;
+			if (src_byte == CONTROL_CHAR || src_byte == ESC_CHAR) {
+				if (dest == dest_last)
+					break;
+				*dest++ = ESC_CHAR;
+				*dest++ = src_byte ^ ESC_MASK;
+			} else {
+				*dest++ = src_byte;
+			}
+			crc >>= 8;
+			state++;
+		}
+		if (state == DIAG_STATE_TERM && dest_last >= dest) {
+			*dest++ = CONTROL_CHAR;
+			state++;
+		}
+	}
+
+	enc->dest = dest;
+	enc->crc = crc;
+	src_desc->pkt = src;
+	src_desc->state = state;
+}
+
+static int ref_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
+{
+	uint8_t *src_ptr = &hdlc->src_ptr[hdlc->src_idx];
+	uint8_t *dest_ptr = &hdlc->dest_ptr[hdlc->dest_idx];
+	unsigned int src_length = hdlc->src_size - hdlc->src_idx;
+	unsigned int dest_length = hdlc->dest_size - hdlc->dest_idx;
+	unsigned int len = 0, i;
+	int pkt_bnd = 0;
+
+	if (!src_length || !dest_length)
+		return 0;
+
+	for (i = 0; i < src_length; i++) {
+		uint8_t src_byte = src_ptr[i];
+
+		if (hdlc->escaping) {
+			dest_ptr[len++] = src_byte ^ ESC_MASK;
+			hdlc->escaping = 0;
+		} else if (src_byte == ESC_CHAR) {
+			if (i == src_length - 1) {
+				hdlc->escaping = 1;
+				i++;
+				break;
+			}
+			dest_ptr[len++] = src_ptr[++i] ^ ESC_MASK;
+		} else if (src_byte == CONTROL_CHAR) {
+			dest_ptr[len++] = src_byte;
+			pkt_bnd = 1;
+			i++;
+			break;
+		} else {
+			dest_ptr[len++] = src_byte;
+		}
+		if (len >= dest_length) {
+			i++;
+			break;
+		}
+	}
+
+	hdlc->src_idx += i;
+	hdlc->dest_idx += len;
+	return pkt_bnd;
+}
+
+#define BUF_SIZE	2048
+#define ITERATIONS	20000
+
+static int failures;
+
+#define CHECK(cond, fmt, ...)						\
+do {									\
+	if (!(cond)) {							\
+		fprintf(stderr, "FAIL %s:%d: " fmt "\n",		\
+			__func__, __LINE__, ##__VA_ARGS__);		\
+		failures++;						\
+		return;							\
+	}								\
+} while (0)
+
+/* Random bytes, with 0x7e and 0x7d common enough to hit every path */
+static void fill_random(uint8_t *p, size_t len)
+{
+	while (len--) {
+		switch (rand() % 8) {
+		case 0:
+			*p++ = CONTROL_CHAR;
+			break;
+		case 1:
+			*p++ = ESC_CHAR;
+			break;
+		default:
+			*p++ = rand();
+		}
+	}
+}
+
+static void test_crc_vectors(void)
+{
+	static const u8 check[] = "123456789";
+	u16 crc;
+
+	/* X.25 before the final inversion, and Kermit */
+	crc = crc_ccitt(0xffff, check, 9);
+	CHECK(crc == 0x6f91, "crc_ccitt(0xffff, \"123456789\") = %#x", crc);
+	crc = crc_ccitt(0, check, 9);
+	CHECK(crc == 0x2189, "crc_ccitt(0, \"123456789\") = %#x", crc);
+	crc = crc_ccitt(0x1234, check, 0);
+	CHECK(crc == 0x1234, "empty buffer changed the crc to %#x", crc);
+}
+
+static void test_crc_random(void)
+{
+	static uint8_t buf[BUF_SIZE + 4];
+	size_t off, len;
+	u16 seed, got, want;
+	int n;
+
+	for (n = 0; n < ITERATIONS; n++) {
+		off = rand() % 4;
+		len = rand() % (n < ITERATIONS / 2 ? 16 : BUF_SIZE);
+		seed = rand();
+		fill_random(buf + off, len);
+		got = crc_ccitt(seed, buf + off, len);
+		want = ref_crc_ccitt(seed, buf + off, len);
+		CHECK(got == want, "seed %#x off %zu len %zu: %#x, want %#x",
+		      seed, off, len, got, want);
+	}
+}
+
+static void test_encode_vector(void)
+{
+	static const uint8_t pkt[] = { 0x01, 0x7e, 0x02, 0x7d };
+	static const uint8_t want[] = {
+		0x01, 0x7d, 0x5e, 0x02, 0x7d, 0x5d, 0x74, 0xeb, 0x7e
+	};
+	struct diag_send_desc_type send = {
+		.pkt = pkt,
+		.last = pkt + sizeof(pkt) - 1,
+		.state = DIAG_STATE_START,
+		.terminate = 1,
+	};
+	struct diag_hdlc_dest_type enc;
+	uint8_t out[32];
+
+	enc.dest = out;
+	enc.dest_last = out + sizeof(out) - 1;
+	diag_hdlc_encode(&send, &enc);
+	CHECK(send.state == DIAG_STATE_COMPLETE, "state %d", send.state);
+	CHECK((uint8_t *)enc.dest - out == sizeof(want), "%td bytes",
+	      (uint8_t *)enc.dest - out);
+	CHECK(!memcmp(out, want, sizeof(want)), "frame differs");
+}
+
+/*
+ * Encode a packet into windows of random size, as diag_process_*() does
+ * when a packet spills over the end of a USB buffer, and compare output
+ * and state after every call.
+ */
+static void test_encode_random(void)
+{
+	static uint8_t pkt[BUF_SIZE + 4];
+	static uint8_t out[2 * BUF_SIZE + 16], ref_out[2 * BUF_SIZE + 16];
+	struct diag_send_desc_type send, ref_send;
+	struct diag_hdlc_dest_type enc, ref_enc;
+	size_t off, len, pos, win;
+	int n, calls;
+
+	for (n = 0; n < ITERATIONS; n++) {
+		off = rand() % 4;
+		len = 1 + rand() % (n < ITERATIONS / 2 ? 16 : BUF_SIZE);
+		fill_random(pkt + off, len);
+		memset(out, 0, sizeof(out));
+		memset(ref_out, 0, sizeof(ref_out));
+
+		memset(&send, 0, sizeof(send));
+		send.pkt = pkt + off;
+		send.last = pkt + off + len - 1;
+		send.state = DIAG_STATE_START;
+		send.terminate = rand() % 4 != 0;
+		ref_send = send;
+		memset(&enc, 0, sizeof(enc));
+		memset(&ref_enc, 0, sizeof(ref_enc));
+
+		pos = 0;
+		for (calls = 0; send.state != DIAG_STATE_COMPLETE; calls++) {
+			CHECK(calls < 4 * BUF_SIZE, "no progress at %zu", pos);
+			/* an escape needs a window of two */
+			win = 2 + rand() % (rand() % 2 ? 8 : 256);
+			if (pos + win > sizeof(out))
+				win = sizeof(out) - pos;
+			enc.dest = out + pos;
+			enc.dest_last = out + pos + win - 1;
+			ref_enc.dest = ref_out + pos;
+			ref_enc.dest_last = ref_out + pos + win - 1;
+
+			diag_hdlc_encode(&send, &enc);
+			ref_hdlc_encode(&ref_send, &ref_enc);
+
+			CHECK(send.state == ref_send.state,
+			      "len %zu call %d: state %d, want %d", len, calls,
+			      send.state, ref_send.state);
+			CHECK(send.pkt == ref_send.pkt &&
+			      (uint8_t *)enc.dest - out ==
+			      (uint8_t *)ref_enc.dest - ref_out &&
+			      enc.crc == ref_enc.crc,
+			      "len %zu call %d: progress differs", len, calls);
+			pos = (uint8_t *)enc.dest - out;
+		}
+		CHECK(!memcmp(out, ref_out, pos), "len %zu: output differs",
+		      len);
+	}
+}
+
+/*
+ * Feed an HDLC stream to the decoder in random fragments, into a
+ * destination that fills up at random points, as diagchar_write() does.
+ */
+static void test_decode_random(void)
+{
+	static uint8_t in[BUF_SIZE + 4];
+	static uint8_t out[BUF_SIZE], ref_out[BUF_SIZE];
+	struct diag_hdlc_decode_type hdlc, ref;
+	size_t off, len, pos, frag;
+	int n, ret, ref_ret;
+
+	for (n = 0; n < ITERATIONS; n++) {
+		off = rand() % 4;
+		len = 1 + rand() % (n < ITERATIONS / 2 ? 16 : BUF_SIZE);
+		fill_random(in + off, len);
+
+		memset(&hdlc, 0, sizeof(hdlc));
+		memset(&ref, 0, sizeof(ref));
+		hdlc.dest_ptr = out;
+		ref.dest_ptr = ref_out;
+		hdlc.dest_size = ref.dest_size = 1 + rand() % 300;
+
+		for (pos = 0; pos < len; pos += frag) {
+			frag = 1 + rand() % 64;
+			if (frag > len - pos)
+				frag = len - pos;
+			hdlc.src_ptr = ref.src_ptr = in + off + pos;
+			hdlc.src_size = ref.src_size = frag;
+			hdlc.src_idx = ref.src_idx = 0;
+
+			while (ref.src_idx < ref.src_size) {
+				ret = diag_hdlc_decode(&hdlc);
+				ref_ret = ref_hdlc_decode(&ref);
+				CHECK(ret == ref_ret &&
+				      hdlc.src_idx == ref.src_idx &&
+				      hdlc.dest_idx == ref.dest_idx &&
+				      hdlc.escaping == ref.escaping,
+				      "len %zu pos %zu: state differs", len, pos);
+				CHECK(!memcmp(out, ref_out, ref.dest_idx),
+				      "len %zu pos %zu: output differs", len, pos);
+				if (ref_ret || ref.dest_idx == ref.dest_size)
+					hdlc.dest_idx = ref.dest_idx = 0;
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int seed = argc > 1 ? strtoul(argv[1], NULL, 0) : 1;
+
+	srand(seed);
+	test_crc_vectors();
+	test_crc_random();
+	test_encode_vector();
+	test_encode_random();
+	test_decode_random();
+
+	if (failures) {
+		fprintf(stderr, "hdlc_test: %d failure(s), seed %u\n",
+			failures, seed);
+		return 1;
+	}
+	printf("hdlc_test: all passed, seed %u\n", seed);
+	return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * msmfb_async_blit.c - check the MSM framebuffer asynchronous blit queue
+ *
+ * Queues blit lists through MSMFB_ASYNC_BLIT and checks that the fences
+ * and MSMFB_BLIT_WAIT behave as include/linux/msm_mdp.h documents them:
+ *   - every list gets the next fence, and lists retire in order;
+ *   - waiting on a fence returns the result of that list alone;
+ *   - waiting on a fence that was never handed out fails with EINVAL;
+ *   - clients submitting more lists than the queue holds block, they
+ *     are not refused, and every list still completes.
+ *
+ * The copies are done inside the framebuffer, on rows below the first
+ * screen when there is room, and checked through an mmap of it.  On
+ * MDP 4.0 the PPP blitter is not implemented, so run it with the CPU
+ * path enabled and nothing else blitting:
+ *
+ *	echo 1 > /sys/module/msm_fb/parameters/blit_sw_ref
+ *	msmfb_async_blit [/dev/graphics/fb0]
+ *
+ * Cross-compile with cross-gcc -I/path/to/cross-kernel/include
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <linux/fb.h>
+#include <linux/msm_mdp.h>
+
+#define BLOCK_W		64
+#define BLOCK_H		16
+#define NR_CLIENTS	4
+#define LISTS_PER_CLIENT 16	/* several times the queue depth */
+
+static const char *device = "/dev/graphics/fb0";
+static int fd;
+static uint8_t *fb;
+static unsigned width, height, bpp, first_row;
+static int failed;
+
+static void check(int cond, const char *what)
+{
+	printf("%s: %s\n", cond ? "ok" : "FAIL", what);
+	if (!cond)
+		failed = 1;
+}
+
+static uint8_t *pixel(unsigned x, unsigned y)
+{
+	return fb + ((size_t)y * width + x) * bpp;
+}
+
+/* a copy of the block at row sy to row dy, or one outside the image */
+static void fill_req(struct mdp_blit_req *req, unsigned sy, unsigned dy)
+{
+	memset(req, 0, sizeof(*req));
+	req->src.width = req->dst.width = width;
+	req->src.height = req->dst.height = height;
+	req->src.format = req->dst.format = MDP_FB_FORMAT;
+	req->src.memory_id = req->dst.memory_id = fd;
+	req->src_rect.y = first_row + sy;
+	req->dst_rect.y = first_row + dy;
+	req->src_rect.w = req->dst_rect.w = BLOCK_W;
+	req->src_rect.h = req->dst_rect.h = BLOCK_H;
+	req->alpha = MDP_ALPHA_NOP;
+	req->transp_mask = MDP_TRANSP_NOP;
+}
+
+static int submit(unsigned sy, unsigned dy, uint32_t *fence)
+{
+	struct {
+		struct mdp_async_blit_req_list hdr;
+		struct mdp_blit_req req;
+	} list;
+
+	list.hdr.count = 1;
+	fill_req(&list.req, sy, dy);
+	if (ioctl(fd, MSMFB_ASYNC_BLIT, &list) < 0)
+		return -errno;
+	*fence = list.hdr.fence;
+	return 0;
+}
+
+static int wait_fence(uint32_t fence)
+{
+	return ioctl(fd, MSMFB_BLIT_WAIT, &fence) < 0 ? -errno : 0;
+}
+
+static int block_matches(unsigned sy, unsigned dy)
+{
+	unsigned y;
+
+	for (y = 0; y < BLOCK_H; y++)
+		if (memcmp(pixel(0, first_row + sy + y),
+			   pixel(0, first_row + dy + y), BLOCK_W * bpp))
+			return 0;
+	return 1;
+}
+
+static void test_fences(void)
+{
+	uint32_t good1, bad, good2;
+	unsigned y;
+
+	for (y = 0; y < BLOCK_H; y++) {
+		uint8_t *p = pixel(0, first_row + y);
+		unsigned i;
+
+		for (i = 0; i < BLOCK_W * bpp; i++)
+			p[i] = rand();
+	}
+	memset(pixel(0, first_row + BLOCK_H), 0,
+	       (size_t)2 * BLOCK_H * width * bpp);
+
+	check(!submit(0, BLOCK_H, &good1), "queue a copy");
+	check(!submit(0, height, &bad), "queue a copy outside the image");
+	check(!submit(0, 2 * BLOCK_H, &good2), "queue another copy");
+	check(bad == good1 + 1 && good2 == bad + 1,
+	      "fences are handed out in order");
+
+	check(wait_fence(good2) == 0,
+	      "a list after a failed one reports its own success");
+	check(wait_fence(bad) == -EINVAL, "the failed list reports EINVAL");
+	check(wait_fence(good1) == 0, "an earlier list reports success");
+	check(block_matches(0, BLOCK_H) && block_matches(0, 2 * BLOCK_H),
+	      "the copies landed");
+
+	check(wait_fence(good2 + 1000) == -EINVAL,
+	      "waiting on a fence not handed out yet fails");
+}
+
+/* each client checks its own fences; the parent only collects results */
+static int run_client(void)
+{
+	uint32_t fence[LISTS_PER_CLIENT];
+	int i;
+
+	for (i = 0; i < LISTS_PER_CLIENT; i++) {
+		if (submit(0, BLOCK_H, &fence[i]))
+			return 1;
+		if (i && (int32_t)(fence[i] - fence[i - 1]) <= 0)
+			return 1;
+	}
+	if (wait_fence(fence[LISTS_PER_CLIENT - 1]))
+		return 1;
+	for (i = 0; i < LISTS_PER_CLIENT; i++)
+		if (wait_fence(fence[i]))
+			return 1;
+	return 0;
+}
+
+static void test_depth(void)
+{
+	int i, status, ok = 1;
+	pid_t pid;
+
+	for (i = 0; i < NR_CLIENTS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			exit(1);
+		}
+		if (pid == 0)
+			_exit(run_client());
+	}
+	for (i = 0; i < NR_CLIENTS; i++) {
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			ok = 0;
+	}
+	check(ok, "clients overfilling the queue block and complete in order");
+}
+
+int main(int argc, char *argv[])
+{
+	struct fb_fix_screeninfo fix;
+	struct fb_var_screeninfo var;
+
+	if (argc > 1)
+		device = argv[1];
+
+	fd = open(device, O_RDWR);
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+	if (ioctl(fd, FBIOGET_FSCREENINFO, &fix) < 0 ||
+	    ioctl(fd, FBIOGET_VSCREENINFO, &var) < 0) {
+		perror("FBIOGET_*SCREENINFO");
+		return 1;
+	}
+
+	bpp = var.bits_per_pixel / 8;
+	width = fix.line_length / bpp;
+	height = fix.smem_len / fix.line_length;
+	if (width < BLOCK_W || height < 3 * BLOCK_H) {
+		fprintf(stderr, "%s: framebuffer too small\n", device);
+		return 1;
+	}
+	/* stay off the visible screen if there is a second one */
+	if (height >= var.yres + 3 * BLOCK_H)
+		first_row = var.yres;
+
+	fb = mmap(NULL, fix.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		  fd, 0);
+	if (fb == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	test_fences();
+	test_depth();
+
+	return failed;
+}
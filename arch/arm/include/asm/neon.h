@@ -0,0 +1,27 @@
+/*
+ * arch/arm/include/asm/neon.h
+ *
+ * Use of the NEON unit from kernel code.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+#ifdef CONFIG_NEON
+/*
+ * NEON code in the kernel must be bracketed by these.  The section runs
+ * with preemption disabled, so it must not sleep, and it may not be
+ * entered from interrupt context.
+ */
+void kernel_neon_begin(void);
+void kernel_neon_end(void);
+#endif
+
+#endif /* __ASM_ARM_NEON_H */
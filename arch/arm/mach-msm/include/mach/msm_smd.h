@@ -34,6 +34,13 @@ int smd_close(smd_channel_t *ch);
 int smd_read(smd_channel_t *ch, void *data, int len);
 int smd_read_from_cb(smd_channel_t *ch, void *data, int len);
 
+/* In batch notify mode, reads do not interrupt the other cpu for every
+** packet; the reader must call smd_read_notify() once it has drained
+** the channel, or the other side may stall on a full fifo.
+*/
+void smd_set_batch_notify(smd_channel_t *ch, int enable);
+void smd_read_notify(smd_channel_t *ch);
+
 /* Write to stream channels may do a partial write and return
 ** the length actually written.
 ** Write to packet channels will never do a partial write --
@@ -0,0 +1,60 @@
+/* arch/arm/mach-msm/include/mach/qdsp5v2/audio_stats.h
+ *
+ * Latency, fill level and underrun accounting for the qdsp5v2 audio path
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _MACH_QDSP5_V2_AUDIO_STATS_H
+#define _MACH_QDSP5_V2_AUDIO_STATS_H
+
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+
+/* log2 buckets in usecs: bucket n counts [2^n, 2^(n+1)) */
+#define AUDIO_STATS_HIST_BUCKETS 24
+/* fill level in tenths, the last bucket is completely full */
+#define AUDIO_STATS_FILL_BUCKETS 11
+
+struct audio_stats_hist {
+	uint32_t count;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t bucket[AUDIO_STATS_HIST_BUCKETS];
+};
+
+/* Per stream counters, exported as debugfs audio_stats/<name>.
+ * All updates take the stats spinlock with irqs off, so they can be
+ * made from dsp event callbacks as well as from process context.
+ */
+struct audio_stats {
+	const char *name;
+	spinlock_t lock;
+	uint32_t underruns;
+	uint32_t overruns;
+	struct audio_stats_hist latency;   /* data queued to dsp consumed */
+	struct audio_stats_hist interrupt; /* output held off, e.g. routing */
+	uint32_t fill[AUDIO_STATS_FILL_BUCKETS]; /* queued data at send */
+	ktime_t interrupt_start;
+	struct dentry *dentry;
+};
+
+void audio_stats_register(struct audio_stats *stats, const char *name);
+void audio_stats_unregister(struct audio_stats *stats);
+
+void audio_stats_underrun(struct audio_stats *stats, unsigned val);
+void audio_stats_overrun(struct audio_stats *stats, unsigned val);
+void audio_stats_latency(struct audio_stats *stats, ktime_t queued);
+void audio_stats_fill(struct audio_stats *stats, unsigned used,
+		unsigned size);
+void audio_stats_interrupt_begin(struct audio_stats *stats);
+void audio_stats_interrupt_end(struct audio_stats *stats);
+
+#endif /* _MACH_QDSP5_V2_AUDIO_STATS_H */
@@ -29,6 +29,8 @@
 #define CODEC_UTILS_H
 
 #include <linux/earlysuspend.h>
+#include <linux/msm_audio_aac.h>
+#include <linux/msm_audio_wma.h>
 
 #define ADRV_STATUS_AIO_INTF 0x00000001
 #define ADRV_STATUS_OBUF_GIVEN 0x00000002
@@ -86,6 +88,8 @@ struct audio {
 	uint32_t out_sample_rate;
 	uint32_t out_channel_mode;
 	uint32_t out_bits; /* bits per sample (used by PCM decoder) */
+	struct msm_audio_aac_config aac_config; /* used by AAC decoder */
+	struct msm_audio_wma_config wma_config; /* used by WMA decoder */
 
 	/* data allocated for various buffers */
 	char *data;
@@ -137,6 +141,13 @@ struct audio {
 	uint64_t bytecount_given;
 	uint64_t bytecount_query;
 
+	/* Offload statistics, protected by dsp_lock */
+	uint32_t dsp_wakeups;         /* DSP messages taken while running */
+	uint32_t bufs_given;          /* bitstream buffers handed to DSP */
+	uint64_t bytes_given;
+	unsigned long run_start;      /* jiffies at CFG_MSG ENABLE */
+	unsigned long run_jiffies;    /* accumulated running time */
+
 	struct list_head pmem_region_queue; /* protected by lock */
 
 	int eq_enable;
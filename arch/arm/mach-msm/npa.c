@@ -137,6 +137,17 @@ MODULE_PARM_DESC(npa_log_reset, "Reset NPA module parameters.");
 struct npa_resource *npa_log_resource;
 #endif
 
+/* Requests that lower the state of a max, sum or binary aggregated resource
+ * are not applied right away, but held for this many milliseconds so that
+ * a burst of votes results in one driver call and one set of events. Raising
+ * requests are always applied synchronously. 0 disables coalescing.
+ */
+static int npa_coalesce_ms = 5;
+module_param_named(coalesce_ms, npa_coalesce_ms, int,
+		S_IRUGO | S_IWUSR | S_IWGRP);
+MODULE_PARM_DESC(npa_coalesce_ms,
+	"Time window in ms to coalesce requests lowering a resource state.");
+
 /* Maps resource name to alias name.*/
 struct npa_alias_list {
 	struct list_head 	list;
@@ -157,6 +168,7 @@ static void resource_creation_handler(void *data, unsigned int state,
 		void *called_data, unsigned int value);
 static void send_single_event(struct work_struct *work);
 static void send_update_events(struct work_struct *work);
+static void apply_coalesced_state(struct work_struct *work);
 
 #ifdef CONFIG_MSM_NPA_LOG
 void _npa_log(int log_mask, struct npa_resource *res, const char *fmt, ...)
@@ -339,6 +351,17 @@ static struct npa_resource *create_resource(struct npa_node_definition *node,
 	struct npa_node_definition *new_node = NULL;
 	struct npa_resource_definition *old_defn = NULL;
 	struct npa_resource_definition *new_defn = NULL;
+	struct npa_client *new_client = NULL;
+
+	/* The driver function of a resource with coalesced requests is called
+	 * on behalf of this client, which lives as long as the resource.
+	 */
+	new_client = kzalloc(sizeof(struct npa_client), GFP_KERNEL);
+	if (new_client) {
+		new_client->type = NPA_CLIENT_REQUIRED;
+		new_client->name = NPA_STR_NPA_INTERNAL;
+		INIT_LIST_HEAD(&new_client->list);
+	}
 
 	if (!node) {
 		new_node = kzalloc(sizeof(struct npa_node_definition),
@@ -373,6 +396,10 @@ static struct npa_resource *create_resource(struct npa_node_definition *node,
 		INIT_LIST_HEAD(&new_resource->events);
 		INIT_LIST_HEAD(&new_resource->watermarks);
 		INIT_WORK(&new_resource->work, send_update_events);
+		INIT_DELAYED_WORK(&new_resource->update_work,
+				apply_coalesced_state);
+		new_resource->coalesce_client = new_client;
+		new_client = NULL;
 
 		list_add(&new_alias->list, &alias_list);
 		list_add(&new_resource->list, &waiting_list);
@@ -410,6 +437,7 @@ done:
 		kfree(new_resource);
 		kfree(new_alias);
 	}
+	kfree(new_client);
 
 	return resource;
 }
@@ -652,15 +680,94 @@ static int activate_node(struct npa_resource *resource)
 	return 0;
 }
 
+/* Returns if a request taking the resource to new_state may be held back and
+ * coalesced with the requests that follow it. Only requests that lower the
+ * state of resources where a lower state is a weaker requirement qualify;
+ * anything else has to reach the driver before the request returns.
+ * Sum aggregated resources do not qualify: sum_update() works from the
+ * active state, which is stale while a lowering request is held back.
+ */
+static int can_coalesce_state(struct npa_resource *resource,
+		unsigned int new_state)
+{
+	const struct npa_resource_plugin_ops *plugin = resource->active_plugin;
+
+	if (!npa_coalesce_ms || new_state >= resource->active_state)
+		return 0;
+
+	if (!resource->coalesce_client)
+		return 0;
+
+	if (resource->definition->attributes & NPA_RESOURCE_REPORT_ALL_REQS)
+		return 0;
+
+	return plugin == &npa_max_plugin || plugin == &npa_binary_plugin;
+}
+
+/* Applies the aggregated state of a resource whose lowering requests were
+ * held back by request_state(). The driver function is called on behalf of
+ * NPA itself, through the resource's coalesce_client, with the aggregated
+ * state as the request.
+ */
+static void apply_coalesced_state(struct work_struct *work)
+{
+	struct npa_resource *resource = container_of(work,
+			struct npa_resource, update_work.work);
+	struct npa_client *client = resource->coalesce_client;
+	unsigned int new_state;
+	int changed = 0;
+
+	RESOURCE_LOCK(resource);
+	new_state = resource->requested_state;
+	if (new_state > resource->active_max)
+		new_state = resource->active_max;
+
+	if (new_state != resource->active_state) {
+		client->resource = resource;
+		client->resource_name = resource->definition->name;
+		PENDING_STATE(client) = new_state;
+		resource->active_state =
+			resource->node->driver_fn(resource, client,
+					new_state);
+		ACTIVE_STATE(client) = PENDING_STATE(client);
+		resource->active_headroom = resource->active_max -
+						resource->active_state;
+		changed = 1;
+	}
+	RESOURCE_UNLOCK(resource);
+
+	npa_log(NPA_LOG_MASK_CLIENT, resource,
+		"NPA: Resource [%s] coalesced state set to [%u]\n",
+		resource->definition->name, resource->active_state);
+
+	if (changed)
+		publish_resource_state(resource);
+}
+
 static void request_state(struct npa_resource *resource,
 		struct npa_client *client, unsigned int state)
 {
 	unsigned int new_state;
+	int changed = 0;
 
 	npa_log(NPA_LOG_MASK_CLIENT, resource,
 		"NPA: Resource [%s] client [%s] requested state [%u]\n",
 		resource->definition->name, client->name, state);
 
+	/* Fast path: a required client repeating its current vote can not
+	 * change the aggregated state. The active state of a client is only
+	 * written on behalf of that client, so no lock is needed to check it.
+	 */
+	if (client->type == NPA_CLIENT_REQUIRED &&
+			!(resource->definition->attributes &
+				NPA_RESOURCE_REPORT_ALL_REQS) &&
+			ACTIVE_STATE(client) == state) {
+		npa_log(NPA_LOG_MASK_CLIENT, resource,
+			"NPA: Resource [%s] client [%s] vote unchanged\n",
+			resource->definition->name, client->name);
+		return;
+	}
+
 	RESOURCE_LOCK(resource);
 	PENDING_STATE(client) = state;
 	new_state = resource->active_plugin->update_fn(resource, client);
@@ -670,7 +777,14 @@ static void request_state(struct npa_resource *resource,
 	if (new_state > resource->active_max)
 		new_state = resource->active_max;
 
-	if ((resource->definition->attributes &
+	if (can_coalesce_state(resource, new_state)) {
+		/* Picked up, along with any later votes, by
+		 * apply_coalesced_state(). A pending work is not re-armed, so
+		 * the window is counted from the first relaxing vote.
+		 */
+		queue_delayed_work(npa_wq, &resource->update_work,
+				msecs_to_jiffies(npa_coalesce_ms));
+	} else if ((resource->definition->attributes &
 				NPA_RESOURCE_REPORT_ALL_REQS) ||
 				new_state != resource->active_state) {
 		resource->active_state =
@@ -678,6 +792,7 @@ static void request_state(struct npa_resource *resource,
 					new_state);
 		resource->active_headroom = resource->active_max -
 						resource->active_state;
+		changed = 1;
 	}
 	RESOURCE_UNLOCK(resource);
 
@@ -685,7 +800,8 @@ static void request_state(struct npa_resource *resource,
 		"NPA: Resource [%s] state set to [%u]\n",
 		resource->definition->name, resource->active_state);
 
-	publish_resource_state(resource);
+	if (changed)
+		publish_resource_state(resource);
 }
 
 /* Return if any dependency of this resource is still not active.
@@ -745,6 +861,7 @@ static void resource_destruction_handler(void *data, unsigned int value,
 	struct npa_resource *resource = data;
 
 	BUG_ON(!list_empty(&resource->clients));
+	cancel_delayed_work_sync(&resource->update_work);
 
 	if (!list_empty(&resource->events)) {
 		struct npa_event *event = NULL;
@@ -767,6 +884,7 @@ static void resource_destruction_handler(void *data, unsigned int value,
 
 	kfree(resource->definition);
 	kfree(resource->node);
+	kfree(resource->coalesce_client);
 	kfree(resource);
 }
 
@@ -1560,6 +1678,18 @@ void npa_reset(void)
 	struct npa_resource_definition *def = NULL;
 	unsigned int count = 0;
 
+	/* Coalesced requests must not run on resources freed below. Cancel
+	 * them first and wait for any already running, outside list_lock since
+	 * flushing sleeps.
+	 */
+	read_lock(&list_lock);
+	list_for_each_entry(a, &alias_list, list) {
+		if (a->resource)
+			cancel_delayed_work(&a->resource->update_work);
+	}
+	read_unlock(&list_lock);
+	flush_workqueue(npa_wq);
+
 	write_lock(&list_lock);
 	list_for_each_entry_safe(a, temp_a, &alias_list, list) {
 		list_del(&a->list);
@@ -1598,6 +1728,7 @@ void npa_reset(void)
 			count--;
 			def++;
 		}
+		kfree(resource->coalesce_client);
 		kfree(resource);
 	}
 	write_unlock(&list_lock);
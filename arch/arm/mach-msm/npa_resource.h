@@ -215,6 +215,10 @@ struct npa_resource {
 	struct mutex			*resource_lock; /* Node lock */
 	unsigned int			level; /* Resource depth for locks */
 	struct work_struct		work;
+	struct delayed_work		update_work; /* Coalesced relaxing
+						      * requests */
+	struct npa_client		*coalesce_client; /* Votes for
+							   * update_work */
 };
 
 /* NPA work structure */
@@ -65,6 +65,8 @@
 #include <linux/sched.h>
 #include <linux/debugfs.h>
 #include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <mach/msm_rpcrouter.h>
 
 #define PING_TEST_BASE 0x31
@@ -615,6 +617,34 @@ static int ping_mdm_null_test(void)
 	return ping_mdm_null(rpc_client, NULL, NULL);
 }
 
+#define PING_MDM_NULL_RATE_CALLS 1000
+
+/* Round-trip benchmark: returns completed null calls per second, so
+ * router overhead changes show up directly in the result.
+ */
+static int ping_mdm_null_rate_test(void)
+{
+	ktime_t start;
+	s64 elapsed_us;
+	int i, rc;
+
+	start = ktime_get();
+	for (i = 0; i < PING_MDM_NULL_RATE_CALLS; i++) {
+		rc = ping_mdm_null(rpc_client, NULL, NULL);
+		if (rc)
+			return rc;
+	}
+	elapsed_us = ktime_to_us(ktime_sub(ktime_get(), start));
+	if (elapsed_us <= 0)
+		elapsed_us = 1;
+
+	pr_info("%s: %d calls in %lld us\n", __func__,
+		PING_MDM_NULL_RATE_CALLS, elapsed_us);
+
+	return div64_u64((u64)PING_MDM_NULL_RATE_CALLS * USEC_PER_SEC,
+			 elapsed_us);
+}
+
 static int ping_test_release(struct inode *ip, struct file *fp)
 {
 	return ping_mdm_close();
@@ -669,6 +699,8 @@ static ssize_t ping_test_write(struct file *fp, const char __user *buf,
 
 	if (!strncmp(cmd, "null_test", 64))
 		test_res = ping_mdm_null_test();
+	else if (!strncmp(cmd, "null_rate_test", 64))
+		test_res = ping_mdm_null_rate_test();
 	else if (!strncmp(cmd, "reg_test", 64))
 		test_res = ping_mdm_register_test();
 	else if (!strncmp(cmd, "data_reg_test", 64))
@@ -28,6 +28,7 @@
 #include <linux/reboot.h>
 #include <linux/uaccess.h>
 #include <linux/io.h>
+#include <linux/math64.h>
 #ifdef CONFIG_HAS_WAKELOCK
 #include <linux/wakelock.h>
 #endif
@@ -612,6 +613,10 @@ enum msm_pm_time_stats_id {
 	MSM_PM_STAT_SUSPEND,
 	MSM_PM_STAT_FAILED_SUSPEND,
 	MSM_PM_STAT_NOT_IDLE,
+	MSM_PM_STAT_IDLE_POWER_COLLAPSE_HIT,
+	MSM_PM_STAT_IDLE_POWER_COLLAPSE_MISS,
+	MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE_HIT,
+	MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE_MISS,
 	MSM_PM_STAT_COUNT
 };
 
@@ -674,6 +679,26 @@ static struct msm_pm_time_stats {
 	[MSM_PM_STAT_NOT_IDLE].name = "not-idle",
 	[MSM_PM_STAT_NOT_IDLE].first_bucket_time =
 		CONFIG_MSM_IDLE_STATS_FIRST_BUCKET,
+
+	[MSM_PM_STAT_IDLE_POWER_COLLAPSE_HIT].name =
+		"idle-power-collapse-hit",
+	[MSM_PM_STAT_IDLE_POWER_COLLAPSE_HIT].first_bucket_time =
+		CONFIG_MSM_IDLE_STATS_FIRST_BUCKET,
+
+	[MSM_PM_STAT_IDLE_POWER_COLLAPSE_MISS].name =
+		"idle-power-collapse-miss",
+	[MSM_PM_STAT_IDLE_POWER_COLLAPSE_MISS].first_bucket_time =
+		CONFIG_MSM_IDLE_STATS_FIRST_BUCKET,
+
+	[MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE_HIT].name =
+		"idle-standalone-power-collapse-hit",
+	[MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE_HIT].first_bucket_time =
+		CONFIG_MSM_IDLE_STATS_FIRST_BUCKET,
+
+	[MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE_MISS].name =
+		"idle-standalone-power-collapse-miss",
+	[MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE_MISS].first_bucket_time =
+		CONFIG_MSM_IDLE_STATS_FIRST_BUCKET,
 };
 
 static uint32_t msm_pm_sleep_limit = SLEEP_LIMIT_NONE;
@@ -708,6 +733,29 @@ static void msm_pm_add_stat(enum msm_pm_time_stats_id id, int64_t t)
 		msm_pm_stats[id].max_time[i] = t;
 }
 
+/*
+ * Record whether an idle power collapse lasted long enough to pay for
+ * itself, i.e. whether the actual residency reached the break-even time
+ * of the mode that was entered.
+ */
+static void msm_pm_add_residency_stat(int mode, int64_t t)
+{
+	bool hit = t >= msm_pm_modes[mode].residency * 1000LL;
+
+	switch (mode) {
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE:
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN:
+		msm_pm_add_stat(hit ? MSM_PM_STAT_IDLE_POWER_COLLAPSE_HIT :
+			MSM_PM_STAT_IDLE_POWER_COLLAPSE_MISS, t);
+		break;
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE:
+		msm_pm_add_stat(hit ?
+			MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE_HIT :
+			MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE_MISS, t);
+		break;
+	}
+}
+
 /*
  * Helper function of snprintf where buf is auto-incremented, size is auto-
  * decremented, and there is no return value.
@@ -1325,6 +1373,177 @@ static int msm_pm_swfi(bool ramp_acpu)
 }
 
 
+/******************************************************************************
+ * Idle Residency Prediction
+ *****************************************************************************/
+
+/*
+ * The next timer event is only an upper bound on how long the Apps processor
+ * will stay idle; interrupts frequently wake it up much earlier.  Learn from
+ * recent wakeups, in the manner of the menu cpuidle governor, so that power
+ * collapse is only attempted when the predicted residency exceeds the
+ * break-even time of the mode.
+ *
+ * Two estimates are kept:
+ *   - a correction factor, per range of next timer event, applied to the
+ *     time until the next timer event;
+ *   - the average of the last few idle periods, used when they are regular
+ *     enough (low variance) to indicate a repeating wakeup source.
+ * The smaller of the two is the predicted residency.
+ */
+
+#define MSM_PM_PREDICT_INTERVALS 8
+#define MSM_PM_PREDICT_BUCKETS 6
+#define MSM_PM_PREDICT_RESOLUTION 1024
+#define MSM_PM_PREDICT_DECAY 8
+#define MSM_PM_PREDICT_UNITY (MSM_PM_PREDICT_RESOLUTION * MSM_PM_PREDICT_DECAY)
+/* Idle periods are clamped to this (~268s) so the variance can't overflow */
+#define MSM_PM_PREDICT_MAX_US (1U << 28)
+
+static int msm_pm_idle_predict = 1;
+module_param_named(
+	idle_predict, msm_pm_idle_predict,
+	int, S_IRUGO | S_IWUSR | S_IWGRP
+);
+
+static struct msm_pm_predictor {
+	uint32_t intervals[MSM_PM_PREDICT_INTERVALS];	/* microseconds */
+	int interval_ptr;
+	uint32_t correction_factor[MSM_PM_PREDICT_BUCKETS];
+} msm_pm_predictor;
+
+/*
+ * Map the time until the next timer event (in microseconds) to a
+ * correction factor bucket: <10us, <100us, <1ms, <10ms, <100ms, longer.
+ */
+static int msm_pm_predict_bucket(uint32_t expected_us)
+{
+	int bucket = 0;
+
+	while (bucket < MSM_PM_PREDICT_BUCKETS - 1 && expected_us >= 10) {
+		expected_us /= 10;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static uint32_t msm_pm_ns_to_us(int64_t time_ns)
+{
+	if (time_ns <= 0)
+		return 0;
+	if (time_ns >= (int64_t)UINT_MAX * NSEC_PER_USEC)
+		return UINT_MAX;
+	return (uint32_t)div_u64((u64)time_ns, NSEC_PER_USEC);
+}
+
+/*
+ * Return the average of the recent idle periods in microseconds if they
+ * are regular enough to be a good predictor, 0 otherwise.
+ */
+static uint32_t msm_pm_predict_typical_interval(void)
+{
+	struct msm_pm_predictor *p = &msm_pm_predictor;
+	uint64_t avg = 0;
+	uint64_t variance = 0;
+	int i;
+
+	for (i = 0; i < MSM_PM_PREDICT_INTERVALS; i++)
+		avg += p->intervals[i];
+	avg = div_u64(avg, MSM_PM_PREDICT_INTERVALS);
+
+	for (i = 0; i < MSM_PM_PREDICT_INTERVALS; i++) {
+		int64_t diff = (int64_t)p->intervals[i] - (int64_t)avg;
+		variance += diff * diff;
+	}
+	variance = div_u64(variance, MSM_PM_PREDICT_INTERVALS);
+
+	/*
+	 * Accept the average when the standard deviation is below 1/6 of it
+	 * (i.e. variance * 36 < avg^2), or below 20us in absolute terms.
+	 */
+	if (avg && (variance * 36 < avg * avg || variance <= 400))
+		return (uint32_t)avg;
+
+	return 0;
+}
+
+/*
+ * Predict how long the coming idle period will last, in nanoseconds.
+ */
+static int64_t msm_pm_predict_residency(int64_t timer_expiration)
+{
+	struct msm_pm_predictor *p = &msm_pm_predictor;
+	uint32_t expected_us = msm_pm_ns_to_us(timer_expiration);
+	uint32_t typical_us;
+	uint64_t predicted_us;
+
+	if (!msm_pm_idle_predict || !expected_us)
+		return timer_expiration;
+
+	predicted_us = div_u64((uint64_t)expected_us *
+		p->correction_factor[msm_pm_predict_bucket(expected_us)],
+		MSM_PM_PREDICT_UNITY);
+
+	typical_us = msm_pm_predict_typical_interval();
+	if (typical_us && typical_us < predicted_us)
+		predicted_us = typical_us;
+
+	return (int64_t)predicted_us * NSEC_PER_USEC;
+}
+
+/*
+ * Feed the measured length of the idle period back into the predictor.
+ */
+static void msm_pm_predict_update(int64_t timer_expiration, int64_t idle_time)
+{
+	struct msm_pm_predictor *p = &msm_pm_predictor;
+	uint32_t expected_us = msm_pm_ns_to_us(timer_expiration);
+	uint32_t measured_us = msm_pm_ns_to_us(idle_time);
+	uint32_t *factor;
+
+	p->intervals[p->interval_ptr] = min(measured_us, MSM_PM_PREDICT_MAX_US);
+	p->interval_ptr = (p->interval_ptr + 1) % MSM_PM_PREDICT_INTERVALS;
+
+	if (!expected_us)
+		return;
+
+	/* Waking up late, e.g. from power collapse, still counts as a hit */
+	if (measured_us > expected_us)
+		measured_us = expected_us;
+
+	factor = &p->correction_factor[msm_pm_predict_bucket(expected_us)];
+	*factor -= *factor / MSM_PM_PREDICT_DECAY;
+	*factor += (uint32_t)div_u64((uint64_t)MSM_PM_PREDICT_RESOLUTION *
+		measured_us, expected_us);
+
+	/* Never let the factor reach zero, or the bucket can not recover */
+	if (*factor == 0)
+		*factor = 1;
+}
+
+static bool msm_pm_mode_uses_prediction(int mode)
+{
+	switch (mode) {
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE:
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN:
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE:
+	case MSM_PM_SLEEP_MODE_APPS_SLEEP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void __init msm_pm_predict_init(void)
+{
+	int i;
+
+	for (i = 0; i < MSM_PM_PREDICT_BUCKETS; i++)
+		msm_pm_predictor.correction_factor[i] = MSM_PM_PREDICT_UNITY;
+}
+
+
 /******************************************************************************
  * External Idle/Suspend Functions
  *****************************************************************************/
@@ -1339,6 +1558,10 @@ void arch_idle(void)
 
 	int latency_qos;
 	int64_t timer_expiration;
+	int64_t predicted_residency;
+	int64_t t1;
+	int64_t idle_time;
+	int collapse_mode = -1;
 
 	int low_power;
 	int ret;
@@ -1346,7 +1569,6 @@ void arch_idle(void)
 
 #ifdef CONFIG_MSM_IDLE_STATS
 	DECLARE_BITMAP(clk_ids, NR_CLKS);
-	int64_t t1;
 	static int64_t t2;
 	int exit_stat;
 #endif /* CONFIG_MSM_IDLE_STATS */
@@ -1356,9 +1578,10 @@ void arch_idle(void)
 
 	latency_qos = pm_qos_requirement(PM_QOS_CPU_DMA_LATENCY);
 	timer_expiration = msm_timer_enter_idle();
+	predicted_residency = msm_pm_predict_residency(timer_expiration);
+	t1 = ktime_to_ns(ktime_get());
 
 #ifdef CONFIG_MSM_IDLE_STATS
-	t1 = ktime_to_ns(ktime_get());
 	msm_pm_add_stat(MSM_PM_STAT_NOT_IDLE, t1 - t2);
 	msm_pm_add_stat(MSM_PM_STAT_REQUESTED_IDLE, timer_expiration);
 #endif /* CONFIG_MSM_IDLE_STATS */
@@ -1406,9 +1629,20 @@ void arch_idle(void)
 
 	for (i = 0; i < ARRAY_SIZE(allow); i++) {
 		struct msm_pm_platform_data *mode = &msm_pm_modes[i];
+		int64_t residency_limit = timer_expiration;
+
+		/*
+		 * Only the sleep and power collapse modes are held back by
+		 * the prediction; WFI is never refused for a short idle
+		 * period, so a low prediction can not leave us spinning.
+		 */
+		if (msm_pm_mode_uses_prediction(i))
+			residency_limit = predicted_residency;
+
 		if (!mode->supported || !mode->idle_enabled ||
 			mode->latency >= latency_qos ||
-			mode->residency * 1000ULL >= timer_expiration)
+			(i != MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT &&
+			 mode->residency * 1000ULL >= residency_limit))
 			allow[i] = false;
 	}
 
@@ -1424,8 +1658,9 @@ void arch_idle(void)
 #endif
 
 	MSM_PM_DPRINTK(MSM_PM_DEBUG_IDLE, KERN_INFO,
-		"%s(): latency qos %d, next timer %lld, sleep limit %u\n",
-		__func__, latency_qos, timer_expiration, sleep_limit);
+		"%s(): latency qos %d, next timer %lld, predicted %lld, "
+		"sleep limit %u\n", __func__, latency_qos, timer_expiration,
+		predicted_residency, sleep_limit);
 
 	for (i = 0; i < ARRAY_SIZE(allow); i++)
 		MSM_PM_DPRINTK(MSM_PM_DEBUG_IDLE, KERN_INFO,
@@ -1452,6 +1687,10 @@ void arch_idle(void)
 
 		ret = msm_pm_power_collapse(true, sleep_delay, sleep_limit);
 		low_power = (ret != -EBUSY && ret != -ETIMEDOUT);
+		if (!ret)
+			collapse_mode = allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE] ?
+				MSM_PM_SLEEP_MODE_POWER_COLLAPSE :
+				MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN;
 
 #ifdef CONFIG_MSM_IDLE_STATS
 		if (ret)
@@ -1483,6 +1722,9 @@ void arch_idle(void)
 	} else if (allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE]) {
 		ret = msm_pm_power_collapse_standalone();
 		low_power = 0;
+		if (!ret)
+			collapse_mode =
+				MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE;
 #ifdef CONFIG_MSM_IDLE_STATS
 		exit_stat = ret ?
 			MSM_PM_STAT_IDLE_FAILED_STANDALONE_POWER_COLLAPSE :
@@ -1515,9 +1757,14 @@ void arch_idle(void)
 arch_idle_exit:
 	msm_timer_exit_idle(low_power);
 
+	idle_time = ktime_to_ns(ktime_get()) - t1;
+	msm_pm_predict_update(timer_expiration, idle_time);
+
 #ifdef CONFIG_MSM_IDLE_STATS
-	t2 = ktime_to_ns(ktime_get());
-	msm_pm_add_stat(exit_stat, t2 - t1);
+	t2 = t1 + idle_time;
+	msm_pm_add_stat(exit_stat, idle_time);
+	if (collapse_mode >= 0)
+		msm_pm_add_residency_stat(collapse_mode, idle_time);
 #endif /* CONFIG_MSM_IDLE_STATS */
 }
 
@@ -1811,6 +2058,7 @@ static int __init msm_pm_init(void)
 
 	BUG_ON(msm_pm_modes == NULL);
 
+	msm_pm_predict_init();
 	atomic_set(&msm_pm_init_done, 1);
 	suspend_set_ops(&msm_pm_ops);
 
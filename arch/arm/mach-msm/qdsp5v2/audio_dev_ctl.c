@@ -66,6 +66,7 @@
 #include <mach/debug_audio_mm.h>
 #include <mach/qdsp5v2/qdsp5audppmsg.h>
 #include <mach/qdsp5v2/audpp.h>
+#include <mach/qdsp5v2/audio_stats.h>
 
 #ifndef MAX
 #define  MAX(x, y) (((x) > (y)) ? (x) : (y))
@@ -74,6 +75,9 @@
 
 static DEFINE_MUTEX(session_lock);
 
+/* time taken by all listeners to handle a routing event */
+static struct audio_stats auddev_stats;
+
 struct audio_dev_ctrl_state {
 	struct msm_snddev_info *devs[AUDIO_DEV_CTL_MAX_DEV];
 	u32 num_dev;
@@ -780,6 +784,10 @@ void broadcast_event(u32 evt_id, u32 dev_id, u32 session_id)
 		return;
 	mutex_lock(&session_lock);
 
+	if (evt_id & (AUDDEV_EVT_DEV_RDY | AUDDEV_EVT_DEV_RLS |
+			AUDDEV_EVT_DEV_CHG_VOICE))
+		audio_stats_interrupt_begin(&auddev_stats);
+
 	evt_payload = kzalloc(sizeof(union auddev_evt_data),
 			GFP_KERNEL);
 
@@ -1014,6 +1022,7 @@ sent_voc:
 		}
 	}
 	kfree(evt_payload);
+	audio_stats_interrupt_end(&auddev_stats);
 	mutex_unlock(&session_lock);
 }
 EXPORT_SYMBOL(broadcast_event);
@@ -1071,6 +1080,7 @@ static int __init audio_dev_ctrl_init(void)
 	audio_dev_ctrl.num_dev = 0;
 	audio_dev_ctrl.voice_tx_dev = NULL;
 	audio_dev_ctrl.voice_rx_dev = NULL;
+	audio_stats_register(&auddev_stats, "auddev");
 	return misc_register(&audio_dev_ctrl_misc);
 }
 
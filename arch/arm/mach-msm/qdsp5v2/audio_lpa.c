@@ -28,6 +28,7 @@
 #include <linux/earlysuspend.h>
 #include <linux/list.h>
 #include <linux/android_pmem.h>
+#include <linux/math64.h>
 #include <asm/atomic.h>
 #include <asm/ioctls.h>
 #include <mach/msm_adsp.h>
@@ -42,6 +43,8 @@
 #include <mach/qdsp5v2/codec_utils.h>
 #include <mach/qdsp5v2/mp3_funcs.h>
 #include <mach/qdsp5v2/pcm_funcs.h>
+#include <mach/qdsp5v2/aac_funcs.h>
+#include <mach/qdsp5v2/wma_funcs.h>
 #include <mach/debug_audio_mm.h>
 
 #define ADRV_STATUS_AIO_INTF 0x00000001
@@ -57,6 +60,14 @@
 
 #define AUDDEC_DEC_PCM 0
 #define AUDDEC_DEC_MP3 2
+#define AUDDEC_DEC_WMA 4
+#define AUDDEC_DEC_AAC 5
+
+/* Chunk size advertised through AUDIO_GET_CONFIG. Each bitstream buffer
+ * is handed to the DSP whole, so the ARM is woken once per buffer; with
+ * 256KB of compressed data that is several seconds of playback.
+ */
+#define AUDLPA_BUFSZ_HINT (256 * 1024)
 
 #define PCM_BUFSZ_MIN 4800	/* Hold one stereo MP3 frame */
 
@@ -154,12 +165,18 @@ struct audlpa_dec {
 	int dec_attrb;
 	long (*ioctl)(struct file *, unsigned int, unsigned long);
 	void (*adec_params)(struct audio *);
+	void (*set_defaults)(struct audio *);
 };
 
 struct audlpa_dec audlpa_decs[] = {
-	{"msm_mp3_lp", AUDDEC_DEC_MP3, &mp3_ioctl, &audpp_cmd_cfg_mp3_params},
+	{"msm_mp3_lp", AUDDEC_DEC_MP3, &mp3_ioctl, &audpp_cmd_cfg_mp3_params,
+		NULL},
 	{"msm_pcm_lp_dec", AUDDEC_DEC_PCM, &pcm_ioctl,
-		&audpp_cmd_cfg_pcm_params},
+		&audpp_cmd_cfg_pcm_params, NULL},
+	{"msm_aac_lp", AUDDEC_DEC_AAC, &aac_ioctl, &audpp_cmd_cfg_aac_params,
+		&aac_set_defaults},
+	{"msm_wma_lp", AUDDEC_DEC_WMA, &wma_ioctl, &audpp_cmd_cfg_wma_params,
+		&wma_set_defaults},
 };
 
 static int auddec_dsp_config(struct audio *audio, int enable);
@@ -311,6 +328,40 @@ static int audio_disable(struct audio *audio)
 }
 
 /* ------------------- dsp --------------------- */
+
+/* Every DSP message is an interrupt that pulls the apps processor out of
+ * power collapse, so count them to see how long it gets to sleep.
+ */
+static void audlpa_count_wakeup(struct audio *audio)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&audio->dsp_lock, flags);
+	if (audio->running)
+		audio->dsp_wakeups++;
+	spin_unlock_irqrestore(&audio->dsp_lock, flags);
+}
+
+/* Milliseconds spent with the decoder enabled */
+static unsigned long audlpa_run_msecs(struct audio *audio)
+{
+	unsigned long run = audio->run_jiffies;
+
+	if (audio->running)
+		run += jiffies - audio->run_start;
+	return jiffies_to_msecs(run);
+}
+
+static uint32_t audlpa_wakeups_per_min(struct audio *audio)
+{
+	unsigned long msecs = audlpa_run_msecs(audio);
+
+	if (!msecs)
+		return 0;
+	return (uint32_t) div_u64((uint64_t) audio->dsp_wakeups * 60000,
+				msecs);
+}
+
 static void audplay_dsp_event(void *data, unsigned id, size_t len,
 			      void (*getevent) (void *ptr, size_t len))
 {
@@ -318,6 +369,8 @@ static void audplay_dsp_event(void *data, unsigned id, size_t len,
 	uint32_t msg[28];
 	getevent(msg, sizeof(msg));
 
+	audlpa_count_wakeup(audio);
+
 	MM_DBG("msg_id=%x\n", id);
 
 	switch (id) {
@@ -337,6 +390,8 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 {
 	struct audio *audio = private;
 
+	audlpa_count_wakeup(audio);
+
 	switch (id) {
 	case AUDPP_MSG_STATUS_MSG:{
 			unsigned status = msg[1];
@@ -387,6 +442,7 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 			MM_DBG("CFG_MSG ENABLE\n");
 			auddec_dsp_config(audio, 1);
 			audio->out_needed = 0;
+			audio->run_start = jiffies;
 			audio->running = 1;
 			audpp_dsp_set_vol_pan(AUDPP_CMD_CFG_DEV_MIXER_ID_4,
 						&audio->vol_pan,
@@ -395,6 +451,9 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 					&audio->eq, POPP);
 		} else if (msg[0] == AUDPP_MSG_ENA_DIS) {
 			MM_DBG("CFG_MSG DISABLE\n");
+			if (audio->running)
+				audio->run_jiffies +=
+					jiffies - audio->run_start;
 			audio->running = 0;
 		} else {
 			MM_DBG("CFG_MSG %d?\n", msg[0]);
@@ -481,6 +540,8 @@ static void audlpa_async_send_buffer(struct audio *audio)
 			audio->bytecount_given += next_buf->buf.data_len;
 			wmb();
 			audplay_send_queue0(audio, &cmd, sizeof(cmd));
+			audio->bufs_given++;
+			audio->bytes_given += next_buf->buf.data_len;
 			audio->out_needed = 0;
 			audio->drv_status |= ADRV_STATUS_OBUF_GIVEN;
 		}
@@ -509,6 +570,8 @@ static void audlpa_async_send_buffer(struct audio *audio)
 					audio->bytecount_consumed + temp;
 				wmb();
 				audplay_send_queue0(audio, &cmd, sizeof(cmd));
+				audio->bufs_given++;
+				audio->bytes_given += temp;
 				audio->out_needed = 0;
 				audio->drv_status |= ADRV_STATUS_OBUF_GIVEN;
 			}
@@ -1146,6 +1209,7 @@ static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 
 	case AUDIO_GET_CONFIG:{
 		struct msm_audio_config config;
+		config.buffer_size = AUDLPA_BUFSZ_HINT;
 		config.buffer_count = 2;
 		config.sample_rate = audio->out_sample_rate;
 		if (audio->out_channel_mode == AUDPP_CMD_PCM_INTF_MONO_V)
@@ -1307,6 +1371,9 @@ static int audio_release(struct inode *inode, struct file *file)
 	MM_INFO("audio instance 0x%08x freeing\n", (int)audio);
 	mutex_lock(&audio->lock);
 	auddev_unregister_evt_listner(AUDDEV_CLNT_DEC, audio->dec_id);
+	MM_INFO("played %lu ms, %u dsp wakeups (%u/min), %u buffers\n",
+		audlpa_run_msecs(audio), audio->dsp_wakeups,
+		audlpa_wakeups_per_min(audio), audio->bufs_given);
 	audio_disable(audio);
 	audlpa_async_flush(audio);
 	audlpa_reset_pmem_region(audio);
@@ -1423,6 +1490,21 @@ static ssize_t audlpa_debug_read(struct file *file, char __user *buf,
 					"dec state %d\n", audio->dec_state);
 	n += scnprintf(buffer + n, debug_bufmax - n,
 					"out_needed %d\n", audio->out_needed);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+					"run time %lu ms\n",
+					audlpa_run_msecs(audio));
+	n += scnprintf(buffer + n, debug_bufmax - n,
+					"dsp wakeups %u\n", audio->dsp_wakeups);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+					"wakeups per min %u\n",
+					audlpa_wakeups_per_min(audio));
+	n += scnprintf(buffer + n, debug_bufmax - n,
+					"buffers given %u\n", audio->bufs_given);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+					"avg buffer size %u\n",
+					audio->bufs_given ? (unsigned)
+					div_u64(audio->bytes_given,
+						audio->bufs_given) : 0);
 	buffer[n] = 0;
 	return simple_read_from_buffer(buf, count, ppos, buffer, n);
 }
@@ -1509,6 +1591,8 @@ static int audio_open(struct inode *inode, struct file *file)
 	audio->out_channel_mode = AUDPP_CMD_PCM_INTF_STEREO_V;
 	audio->out_bits = AUDPP_CMD_WAV_PCM_WIDTH_16;
 	audio->vol_pan.volume = 0x2000;
+	if (audlpa_decs[audio->minor_no].set_defaults)
+		audlpa_decs[audio->minor_no].set_defaults(audio);
 
 	audlpa_async_flush(audio);
 
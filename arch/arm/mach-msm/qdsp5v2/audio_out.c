@@ -26,6 +26,8 @@
 #include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/wakelock.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
 
 #include <linux/msm_audio.h>
 
@@ -37,12 +39,17 @@
 #include <mach/qdsp5v2/audio_dev_ctl.h>
 #include <mach/qdsp5v2/audpp.h>
 #include <mach/qdsp5v2/audio_dev_ctl.h>
+#include <mach/qdsp5v2/audio_stats.h>
 
 #include <mach/htc_pwrsink.h>
 
 #define BUFSZ (960 * 5)
 #define DMASZ (BUFSZ * 2)
 
+/* limits for the mmap'd PCM ring, a period has to fit in a dsp buffer */
+#define MMAP_MIN_PERIOD 256
+#define MMAP_MAX_PERIODS 32
+
 #define HOSTPCM_STREAM_ID 5
 
 struct buffer {
@@ -50,6 +57,7 @@ struct buffer {
 	unsigned size;
 	unsigned used;
 	unsigned addr;
+	ktime_t queued; /* when the data was handed over by the writer */
 };
 
 struct audio {
@@ -90,6 +98,21 @@ struct audio {
 	struct wake_lock idlelock;
 
 	struct audpp_cmd_cfg_object_params_volume vol_pan;
+
+	/* mmap'd PCM ring: a status page followed by the periods; the dsp
+	 * only takes the two fixed buffers in out[], so each period is
+	 * copied into the buffer the dsp has just released */
+	char *mmap_data;
+	dma_addr_t mmap_phys;
+	unsigned mmap_size;
+	unsigned mmap_mapped; /* vmas mapping the ring */
+	struct msm_audio_mmap_status *mmap_status;
+	char *mmap_ring;
+	unsigned mmap_pos; /* ring offset of hw_ptr */
+	unsigned period_size;
+	unsigned period_count;
+
+	struct audio_stats stats;
 };
 
 static void audio_out_listener(u32 evt_id, union auddev_evt_data *evt_payload,
@@ -102,12 +125,16 @@ static void audio_out_listener(u32 evt_id, union auddev_evt_data *evt_payload,
 		audio->source |= (0x1 << evt_payload->routing_id);
 		if (audio->running == 1 && audio->enabled == 1)
 			audpp_route_stream(audio->dec_id, audio->source);
+		audio_stats_interrupt_end(&audio->stats);
 		break;
 	case AUDDEV_EVT_DEV_RLS:
 		MM_DBG(":AUDDEV_EVT_DEV_RLS\n");
 		audio->source &= ~(0x1 << evt_payload->routing_id);
 		if (audio->running == 1 && audio->enabled == 1)
 			audpp_route_stream(audio->dec_id, audio->source);
+		/* nothing is audible until the next device comes up */
+		if (!audio->source && audio->enabled)
+			audio_stats_interrupt_begin(&audio->stats);
 		break;
 	case AUDDEV_EVT_STREAM_VOL_CHG:
 		audio->vol_pan.volume = evt_payload->session_vol;
@@ -143,6 +170,42 @@ static int audio_dsp_send_buffer(struct audio *audio, unsigned id,
 
 static void audio_dsp_event(void *private, unsigned id, uint16_t *msg);
 
+static inline unsigned audio_mmap_avail(struct audio *audio)
+{
+	return ACCESS_ONCE(audio->mmap_status->appl_ptr) -
+		audio->mmap_status->hw_ptr;
+}
+
+/* Move the next period from the ring into dsp buffer idx, or silence if
+ * the application has fallen behind, so the dsp never runs dry */
+static void audio_mmap_fill(struct audio *audio, unsigned idx)
+{
+	struct msm_audio_mmap_status *status = audio->mmap_status;
+	unsigned avail = audio_mmap_avail(audio);
+
+	/* the application has written over data not yet played */
+	if (avail > audio->period_size * audio->period_count)
+		audio_stats_overrun(&audio->stats, avail);
+
+	if (avail >= audio->period_size) {
+		/* read the samples only after seeing appl_ptr move */
+		rmb();
+		memcpy(audio->out[idx].data, audio->mmap_ring + audio->mmap_pos,
+			audio->period_size);
+		audio->mmap_pos += audio->period_size;
+		if (audio->mmap_pos == audio->period_size * audio->period_count)
+			audio->mmap_pos = 0;
+		wmb();
+		status->hw_ptr += audio->period_size;
+	} else {
+		memset(audio->out[idx].data, 0, audio->period_size);
+		status->underruns++;
+		audio_stats_underrun(&audio->stats, avail);
+	}
+	audio->out[idx].used = audio->period_size;
+	audio->out[idx].queued = ktime_get();
+}
+
 /* must be called with audio->lock held */
 static int audio_enable(struct audio *audio)
 {
@@ -151,6 +214,14 @@ static int audio_enable(struct audio *audio)
 	if (audio->enabled)
 		return 0;
 
+	/* prime both dsp buffers from the ring */
+	if (audio->mmap_data) {
+		audio->out[0].size = audio->period_size;
+		audio->out[1].size = audio->period_size;
+		audio_mmap_fill(audio, 0);
+		audio_mmap_fill(audio, 1);
+	}
+
 	/* refuse to start if we're not ready */
 	if (!audio->out[0].used || !audio->out[1].used)
 		return -EIO;
@@ -214,7 +285,19 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 			break;
 		}
 		spin_lock_irqsave(&audio->dsp_lock, flags);
-		if (audio->running) {
+		if (audio->running && audio->out[idx].used)
+			audio_stats_latency(&audio->stats,
+					audio->out[idx].queued);
+		if (audio->running && audio->mmap_data) {
+			atomic_add(audio->out[idx].used, &audio->out_bytes);
+			audio->out[idx].used = 0;
+			audio->teos = 0;
+			audio_mmap_fill(audio, audio->out_tail);
+			audio_dsp_send_buffer(audio, audio->out_tail,
+					audio->period_size);
+			audio->out_tail ^= 1;
+			wake_up(&audio->wait);
+		} else if (audio->running) {
 			atomic_add(audio->out[idx].used, &audio->out_bytes);
 			audio->out[idx].used = 0;
 			frame = audio->out + audio->out_tail;
@@ -241,6 +324,8 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 			printk(KERN_INFO "[%s:%s] PCMDMAMISSED %d\n",
 			__MM_FILE__, __func__, msg[0]);
 		audio->teos++;
+		if (audio->running)
+			audio_stats_underrun(&audio->stats, msg[0]);
 		MM_DBG("PCMDMAMISSED Count per Buffer %d\n", audio->teos);
 		wake_up(&audio->wait);
 		break;
@@ -305,6 +390,14 @@ static int audio_dsp_send_buffer(struct audio *audio, unsigned idx,
 {
 	struct audpp_cmd_pcm_intf_send_buffer cmd;
 
+	if (audio->mmap_data)
+		audio_stats_fill(&audio->stats, audio_mmap_avail(audio),
+			audio->period_size * audio->period_count);
+	else
+		audio_stats_fill(&audio->stats,
+			audio->out[0].used + audio->out[1].used,
+			audio->out[0].size + audio->out[1].size);
+
 	cmd.cmd_id	= AUDPP_CMD_PCM_INTF;
 	cmd.stream	= AUDPP_CMD_POPP_STREAM;
 	cmd.stream_id	= audio->dec_id;
@@ -325,6 +418,59 @@ static void audio_flush(struct audio *audio)
 	audio->out_head = 0;
 	audio->out_tail = 0;
 	audio->stopped = 0;
+	if (audio->mmap_status) {
+		audio->mmap_status->hw_ptr = 0;
+		audio->mmap_status->appl_ptr = 0;
+		audio->mmap_pos = 0;
+	}
+}
+
+static void audio_mmap_free(struct audio *audio)
+{
+	if (!audio->mmap_data)
+		return;
+	dma_free_coherent(NULL, audio->mmap_size, audio->mmap_data,
+		audio->mmap_phys);
+	audio->mmap_data = NULL;
+	audio->mmap_status = NULL;
+	audio->mmap_ring = NULL;
+	audio->mmap_mapped = 0;
+}
+
+/* must be called with audio->lock held */
+static int audio_mmap_config(struct audio *audio,
+		struct msm_audio_mmap_config *config)
+{
+	unsigned size;
+
+	if (audio->enabled || audio->mmap_mapped)
+		return -EBUSY;
+	if (config->period_size < MMAP_MIN_PERIOD ||
+	    config->period_size > BUFSZ || config->period_size % 4 ||
+	    config->period_count < 2 ||
+	    config->period_count > MMAP_MAX_PERIODS)
+		return -EINVAL;
+
+	audio_mmap_free(audio);
+
+	size = PAGE_SIZE +
+		PAGE_ALIGN(config->period_size * config->period_count);
+	audio->mmap_data = dma_alloc_coherent(NULL, size, &audio->mmap_phys,
+						GFP_KERNEL);
+	if (!audio->mmap_data) {
+		MM_ERR("could not allocate mmap ring\n");
+		return -ENOMEM;
+	}
+	memset(audio->mmap_data, 0, size);
+	audio->mmap_size = size;
+	audio->mmap_status = (struct msm_audio_mmap_status *)audio->mmap_data;
+	audio->mmap_ring = audio->mmap_data + PAGE_SIZE;
+	audio->period_size = config->period_size;
+	audio->period_count = config->period_count;
+	audio_flush(audio);
+	MM_INFO("mmap ring %u x %u bytes\n", audio->period_count,
+		audio->period_size);
+	return 0;
 }
 
 static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
@@ -403,8 +549,13 @@ static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	}
 	case AUDIO_GET_CONFIG: {
 		struct msm_audio_config config;
-		config.buffer_size = BUFSZ;
-		config.buffer_count = 2;
+		if (audio->mmap_data) {
+			config.buffer_size = audio->period_size;
+			config.buffer_count = audio->period_count;
+		} else {
+			config.buffer_size = BUFSZ;
+			config.buffer_count = 2;
+		}
 		config.sample_rate = audio->out_sample_rate;
 		if (audio->out_channel_mode == AUDPP_CMD_PCM_INTF_MONO_V)
 			config.channel_count = 1;
@@ -420,6 +571,31 @@ static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			rc = 0;
 		break;
 	}
+	case AUDIO_SET_MMAP_CONFIG: {
+		struct msm_audio_mmap_config config;
+		if (copy_from_user(&config, (void *) arg, sizeof(config))) {
+			rc = -EFAULT;
+			break;
+		}
+		rc = audio_mmap_config(audio, &config);
+		break;
+	}
+	case AUDIO_GET_MMAP_CONFIG: {
+		struct msm_audio_mmap_config config;
+		if (!audio->mmap_data) {
+			rc = -EINVAL;
+			break;
+		}
+		config.period_size = audio->period_size;
+		config.period_count = audio->period_count;
+		config.status_offset = 0;
+		config.ring_offset = PAGE_SIZE;
+		if (copy_to_user((void *) arg, &config, sizeof(config)))
+			rc = -EFAULT;
+		else
+			rc = 0;
+		break;
+	}
 	case AUDIO_GET_SESSION_ID: {
 		if (copy_to_user((void *) arg, &audio->dec_id,
 					sizeof(unsigned short)))
@@ -446,6 +622,15 @@ static int audio_fsync(struct file *file, struct dentry *dentry,
 
 	mutex_lock(&audio->write_lock);
 
+	/* with the mmap ring the dsp keeps playing silence once it runs
+	 * out, so wait for the last whole period to be taken instead */
+	if (audio->mmap_data) {
+		rc = wait_event_interruptible(audio->wait,
+			audio_mmap_avail(audio) < audio->period_size ||
+			!audio->running);
+		goto done;
+	}
+
 	/* PCM DMAMISS message is sent only once in
 	 * hpcm interface. So, wait for buffer complete
 	 * and teos flag.
@@ -496,6 +681,8 @@ static ssize_t audio_write(struct file *file, const char __user *buf,
 	int cap_nice = cap_raised(current_cap(), CAP_SYS_NICE);
 	int rc = 0;
 
+	if (audio->mmap_data)
+		return -EINVAL;
 
 	/* just for this write, set us real-time */
 	if (!task_has_rt_policy(current)) {
@@ -526,6 +713,7 @@ static ssize_t audio_write(struct file *file, const char __user *buf,
 			break;
 		}
 		frame->used = xfer;
+		frame->queued = ktime_get();
 		audio->out_head ^= 1;
 		count -= xfer;
 		buf += xfer;
@@ -564,6 +752,67 @@ static ssize_t audio_write(struct file *file, const char __user *buf,
 	return rc;
 }
 
+static void audio_vm_open(struct vm_area_struct *vma)
+{
+	struct audio *audio = vma->vm_file->private_data;
+
+	mutex_lock(&audio->lock);
+	audio->mmap_mapped++;
+	mutex_unlock(&audio->lock);
+}
+
+static void audio_vm_close(struct vm_area_struct *vma)
+{
+	struct audio *audio = vma->vm_file->private_data;
+
+	mutex_lock(&audio->lock);
+	if (audio->mmap_mapped)
+		audio->mmap_mapped--;
+	mutex_unlock(&audio->lock);
+}
+
+static struct vm_operations_struct audio_vm_ops = {
+	.open = audio_vm_open,
+	.close = audio_vm_close,
+};
+
+static int audio_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct audio *audio = file->private_data;
+	int rc = -EINVAL;
+
+	mutex_lock(&audio->lock);
+	if (audio->mmap_data && vma->vm_pgoff == 0 &&
+	    vma->vm_end - vma->vm_start <= audio->mmap_size) {
+		rc = dma_mmap_coherent(NULL, vma, audio->mmap_data,
+				audio->mmap_phys, audio->mmap_size);
+		if (!rc) {
+			vma->vm_ops = &audio_vm_ops;
+			audio->mmap_mapped++;
+		}
+	}
+	mutex_unlock(&audio->lock);
+	return rc;
+}
+
+static unsigned int audio_poll(struct file *file,
+		struct poll_table_struct *wait)
+{
+	struct audio *audio = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &audio->wait, wait);
+	if (audio->stopped)
+		mask |= POLLERR;
+	else if (audio->mmap_data) {
+		if (audio->period_size * audio->period_count -
+				audio_mmap_avail(audio) >= audio->period_size)
+			mask |= POLLOUT | POLLWRNORM;
+	} else if (!audio->out[audio->out_head].used)
+		mask |= POLLOUT | POLLWRNORM;
+	return mask;
+}
+
 static int audio_release(struct inode *inode, struct file *file)
 {
 	struct audio *audio = file->private_data;
@@ -571,6 +820,7 @@ static int audio_release(struct inode *inode, struct file *file)
 	mutex_lock(&audio->lock);
 	auddev_unregister_evt_listner(AUDDEV_CLNT_DEC, audio->dec_id);
 	audio_disable(audio);
+	audio_mmap_free(audio);
 	audio_flush(audio);
 	audio->opened = 0;
 	mutex_unlock(&audio->lock);
@@ -655,6 +905,8 @@ static const struct file_operations audio_fops = {
 	.write		= audio_write,
 	.unlocked_ioctl	= audio_ioctl,
 	.fsync		= audio_fsync,
+	.mmap		= audio_mmap,
+	.poll		= audio_poll,
 };
 
 struct miscdevice audio_misc = {
@@ -669,6 +921,7 @@ static int __init audio_init(void)
 	mutex_init(&the_audio.write_lock);
 	spin_lock_init(&the_audio.dsp_lock);
 	init_waitqueue_head(&the_audio.wait);
+	audio_stats_register(&the_audio.stats, "pcm_out");
 	wake_lock_init(&the_audio.wakelock, WAKE_LOCK_SUSPEND, "audio_pcm");
 	wake_lock_init(&the_audio.idlelock, WAKE_LOCK_IDLE, "audio_pcm_idle");
 	return misc_register(&audio_misc);
@@ -0,0 +1,379 @@
+/* arch/arm/mach-msm/qdsp5v2/audio_stats.c
+ *
+ * Latency, fill level and underrun accounting for the qdsp5v2 audio path
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/debugfs.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/cpufreq.h>
+#include <linux/suspend.h>
+#include <linux/math64.h>
+
+#include <mach/qdsp5v2/audio_stats.h>
+#include <mach/debug_audio_mm.h>
+
+/* Underruns, overruns and output interruptions are also logged to a
+ * single timeline, stamped with the printk clock and the cpu frequency
+ * at the time, next to suspend and resume.  This is what lets a glitch
+ * heard in the field be matched against dvfs and power collapse.
+ */
+#define AUDIO_STATS_MAX_EVENTS 64
+
+enum {
+	AUDIO_STATS_EV_UNDERRUN,
+	AUDIO_STATS_EV_OVERRUN,
+	AUDIO_STATS_EV_INTERRUPT,
+	AUDIO_STATS_EV_SUSPEND,
+	AUDIO_STATS_EV_RESUME,
+};
+
+static const char *audio_stats_ev_names[] = {
+	"underrun", "overrun", "interrupt", "suspend", "resume",
+};
+
+struct audio_stats_event {
+	unsigned long long time;	/* ns, same clock as printk */
+	const char *name;
+	unsigned type;
+	unsigned val;
+	unsigned khz;
+};
+
+static struct audio_stats_event audio_stats_events[AUDIO_STATS_MAX_EVENTS];
+static unsigned audio_stats_event_head;
+static DEFINE_SPINLOCK(audio_stats_event_lock);
+static unsigned audio_stats_khz;
+
+static DEFINE_MUTEX(audio_stats_dir_lock);
+static struct dentry *audio_stats_dir;
+
+static void audio_stats_log(const char *name, unsigned type, unsigned val)
+{
+	struct audio_stats_event *ev;
+	unsigned long flags;
+
+	spin_lock_irqsave(&audio_stats_event_lock, flags);
+	ev = &audio_stats_events[audio_stats_event_head++ %
+				AUDIO_STATS_MAX_EVENTS];
+	ev->time = cpu_clock(smp_processor_id());
+	ev->name = name;
+	ev->type = type;
+	ev->val = val;
+	ev->khz = audio_stats_khz;
+	spin_unlock_irqrestore(&audio_stats_event_lock, flags);
+}
+
+static void audio_stats_hist_add(struct audio_stats_hist *hist, s64 us)
+{
+	uint32_t val;
+
+	if (us < 0)
+		val = 0;
+	else if (us > UINT_MAX)
+		val = UINT_MAX;
+	else
+		val = us;
+
+	hist->count++;
+	hist->sum += val;
+	if (val > hist->max)
+		hist->max = val;
+	hist->bucket[min(val ? fls(val) - 1 : 0,
+			AUDIO_STATS_HIST_BUCKETS - 1)]++;
+}
+
+void audio_stats_underrun(struct audio_stats *stats, unsigned val)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	stats->underruns++;
+	spin_unlock_irqrestore(&stats->lock, flags);
+	audio_stats_log(stats->name, AUDIO_STATS_EV_UNDERRUN, val);
+}
+EXPORT_SYMBOL(audio_stats_underrun);
+
+void audio_stats_overrun(struct audio_stats *stats, unsigned val)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	stats->overruns++;
+	spin_unlock_irqrestore(&stats->lock, flags);
+	audio_stats_log(stats->name, AUDIO_STATS_EV_OVERRUN, val);
+}
+EXPORT_SYMBOL(audio_stats_overrun);
+
+void audio_stats_latency(struct audio_stats *stats, ktime_t queued)
+{
+	unsigned long flags;
+	s64 us = ktime_us_delta(ktime_get(), queued);
+
+	spin_lock_irqsave(&stats->lock, flags);
+	audio_stats_hist_add(&stats->latency, us);
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+EXPORT_SYMBOL(audio_stats_latency);
+
+void audio_stats_fill(struct audio_stats *stats, unsigned used,
+		unsigned size)
+{
+	unsigned long flags;
+	unsigned n;
+
+	if (!size)
+		return;
+	n = used >= size ? AUDIO_STATS_FILL_BUCKETS - 1 :
+		(unsigned) div_u64((uint64_t) used *
+				(AUDIO_STATS_FILL_BUCKETS - 1), size);
+
+	spin_lock_irqsave(&stats->lock, flags);
+	stats->fill[n]++;
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+EXPORT_SYMBOL(audio_stats_fill);
+
+/* Nested begins keep the earliest start */
+void audio_stats_interrupt_begin(struct audio_stats *stats)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	if (!stats->interrupt_start.tv64)
+		stats->interrupt_start = ktime_get();
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+EXPORT_SYMBOL(audio_stats_interrupt_begin);
+
+void audio_stats_interrupt_end(struct audio_stats *stats)
+{
+	unsigned long flags;
+	s64 us;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	if (!stats->interrupt_start.tv64) {
+		spin_unlock_irqrestore(&stats->lock, flags);
+		return;
+	}
+	us = ktime_us_delta(ktime_get(), stats->interrupt_start);
+	stats->interrupt_start.tv64 = 0;
+	audio_stats_hist_add(&stats->interrupt, us);
+	spin_unlock_irqrestore(&stats->lock, flags);
+	audio_stats_log(stats->name, AUDIO_STATS_EV_INTERRUPT,
+			us > UINT_MAX ? UINT_MAX : (unsigned) us);
+}
+EXPORT_SYMBOL(audio_stats_interrupt_end);
+
+#ifdef CONFIG_DEBUG_FS
+static int audio_stats_hist_show(char *buf, int size,
+		const char *title, struct audio_stats_hist *hist)
+{
+	int n, i;
+
+	n = scnprintf(buf, size, "%s: count %u avg %u max %u\n", title,
+			hist->count, hist->count ? (unsigned)
+			div_u64(hist->sum, hist->count) : 0, hist->max);
+	for (i = 0; i < AUDIO_STATS_HIST_BUCKETS; i++) {
+		if (!hist->bucket[i])
+			continue;
+		if (i == AUDIO_STATS_HIST_BUCKETS - 1)
+			n += scnprintf(buf + n, size - n,
+					"  %8u -         : %u\n",
+					1 << i, hist->bucket[i]);
+		else
+			n += scnprintf(buf + n, size - n,
+					"  %8u - %8u: %u\n",
+					i ? 1 << i : 0, (2 << i) - 1,
+					hist->bucket[i]);
+	}
+	return n;
+}
+
+static int audio_stats_debug_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static ssize_t audio_stats_debug_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	const int debug_bufmax = 4096;
+	static char buffer[4096];
+	struct audio_stats *stats = file->private_data;
+	struct audio_stats copy;
+	unsigned long flags;
+	int n, i;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	copy = *stats;
+	spin_unlock_irqrestore(&stats->lock, flags);
+
+	n = scnprintf(buffer, debug_bufmax, "underruns %u\n", copy.underruns);
+	n += scnprintf(buffer + n, debug_bufmax - n, "overruns %u\n",
+			copy.overruns);
+	n += audio_stats_hist_show(buffer + n, debug_bufmax - n,
+			"latency us", &copy.latency);
+	n += audio_stats_hist_show(buffer + n, debug_bufmax - n,
+			"interrupt us", &copy.interrupt);
+	n += scnprintf(buffer + n, debug_bufmax - n, "fill at send:\n");
+	for (i = 0; i < AUDIO_STATS_FILL_BUCKETS; i++)
+		n += scnprintf(buffer + n, debug_bufmax - n,
+				"  %3u%%: %u\n", i * 10, copy.fill[i]);
+	return simple_read_from_buffer(buf, count, ppos, buffer, n);
+}
+
+/* any write clears the counters */
+static ssize_t audio_stats_debug_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct audio_stats *stats = file->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	stats->underruns = 0;
+	stats->overruns = 0;
+	memset(&stats->latency, 0, sizeof(stats->latency));
+	memset(&stats->interrupt, 0, sizeof(stats->interrupt));
+	memset(stats->fill, 0, sizeof(stats->fill));
+	spin_unlock_irqrestore(&stats->lock, flags);
+	return count;
+}
+
+static const struct file_operations audio_stats_debug_fops = {
+	.read = audio_stats_debug_read,
+	.write = audio_stats_debug_write,
+	.open = audio_stats_debug_open,
+};
+
+static ssize_t audio_stats_events_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	const int debug_bufmax = 8192;
+	static char buffer[8192];
+	struct audio_stats_event ev;
+	unsigned long flags;
+	unsigned head, i;
+	int n = 0;
+
+	spin_lock_irqsave(&audio_stats_event_lock, flags);
+	head = audio_stats_event_head;
+	spin_unlock_irqrestore(&audio_stats_event_lock, flags);
+
+	i = head > AUDIO_STATS_MAX_EVENTS ? head - AUDIO_STATS_MAX_EVENTS : 0;
+	for (; i < head; i++) {
+		unsigned long rem;
+
+		spin_lock_irqsave(&audio_stats_event_lock, flags);
+		ev = audio_stats_events[i % AUDIO_STATS_MAX_EVENTS];
+		spin_unlock_irqrestore(&audio_stats_event_lock, flags);
+
+		rem = do_div(ev.time, 1000000000);
+		n += scnprintf(buffer + n, debug_bufmax - n,
+				"[%5lu.%06lu] %-10s %-9s %8u %7u kHz\n",
+				(unsigned long) ev.time, rem / 1000,
+				ev.name ? ev.name : "-",
+				audio_stats_ev_names[ev.type], ev.val, ev.khz);
+	}
+	return simple_read_from_buffer(buf, count, ppos, buffer, n);
+}
+
+static const struct file_operations audio_stats_events_fops = {
+	.read = audio_stats_events_read,
+};
+
+static struct dentry *audio_stats_get_dir(void)
+{
+	mutex_lock(&audio_stats_dir_lock);
+	if (!audio_stats_dir) {
+		audio_stats_dir = debugfs_create_dir("audio_stats", NULL);
+		if (IS_ERR(audio_stats_dir))
+			audio_stats_dir = NULL;
+		else if (audio_stats_dir)
+			debugfs_create_file("events", S_IFREG | S_IRUGO,
+				audio_stats_dir, NULL,
+				&audio_stats_events_fops);
+	}
+	mutex_unlock(&audio_stats_dir_lock);
+	return audio_stats_dir;
+}
+#endif
+
+void audio_stats_register(struct audio_stats *stats, const char *name)
+{
+	memset(stats, 0, sizeof(*stats));
+	spin_lock_init(&stats->lock);
+	stats->name = name;
+#ifdef CONFIG_DEBUG_FS
+	if (audio_stats_get_dir())
+		stats->dentry = debugfs_create_file(name,
+				S_IFREG | S_IRUGO | S_IWUSR,
+				audio_stats_dir, stats,
+				&audio_stats_debug_fops);
+	if (!stats->dentry)
+		MM_DBG("debugfs_create_file failed\n");
+#endif
+}
+EXPORT_SYMBOL(audio_stats_register);
+
+void audio_stats_unregister(struct audio_stats *stats)
+{
+#ifdef CONFIG_DEBUG_FS
+	if (stats->dentry)
+		debugfs_remove(stats->dentry);
+	stats->dentry = NULL;
+#endif
+}
+EXPORT_SYMBOL(audio_stats_unregister);
+
+static int audio_stats_cpufreq_notify(struct notifier_block *nb,
+		unsigned long event, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+
+	if (event == CPUFREQ_POSTCHANGE && freqs->cpu == 0)
+		audio_stats_khz = freqs->new;
+	return NOTIFY_OK;
+}
+
+static struct notifier_block audio_stats_cpufreq_nb = {
+	.notifier_call = audio_stats_cpufreq_notify,
+};
+
+static int audio_stats_pm_notify(struct notifier_block *nb,
+		unsigned long event, void *unused)
+{
+	if (event == PM_SUSPEND_PREPARE)
+		audio_stats_log(NULL, AUDIO_STATS_EV_SUSPEND, 0);
+	else if (event == PM_POST_SUSPEND)
+		audio_stats_log(NULL, AUDIO_STATS_EV_RESUME, 0);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block audio_stats_pm_nb = {
+	.notifier_call = audio_stats_pm_notify,
+};
+
+static int __init audio_stats_init(void)
+{
+	audio_stats_khz = cpufreq_quick_get(0);
+	cpufreq_register_notifier(&audio_stats_cpufreq_nb,
+			CPUFREQ_TRANSITION_NOTIFIER);
+	register_pm_notifier(&audio_stats_pm_nb);
+	return 0;
+}
+
+subsys_initcall(audio_stats_init);
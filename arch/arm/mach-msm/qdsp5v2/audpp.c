@@ -35,6 +35,7 @@
 #include <mach/qdsp5v2/qdsp5audppmsg.h>
 #include <mach/qdsp5v2/audpp.h>
 #include <mach/qdsp5v2/audio_dev_ctl.h>
+#include <mach/qdsp5v2/audio_stats.h>
 
 #include "../qdsp5/evlog.h"
 
@@ -127,6 +128,9 @@ struct audpp_state {
 						 type enabled */
 
 	wait_queue_head_t event_wait;
+
+	/* dma misses of all streams, time from enable to AUDPPTASK up */
+	struct audio_stats stats;
 };
 
 struct audpp_state the_audpp_state = {
@@ -254,6 +258,7 @@ static void audpp_handle_pcmdmamiss(struct audpp_state *audpp,
 {
 	uint8_t b_index;
 
+	audio_stats_underrun(&audpp->stats, bit_mask);
 	for (b_index = 0; b_index < AUDPP_CLNT_MAX_COUNT; b_index++) {
 		if (bit_mask & (0x1 << b_index))
 			if (audpp->func[b_index])
@@ -295,6 +300,7 @@ static void audpp_dsp_event(void *data, unsigned id, size_t len,
 		if (msg[0] == AUDPP_MSG_ENA_ENA) {
 			pr_info("audpp: ENABLE\n");
 			audpp->enabled = 1;
+			audio_stats_interrupt_end(&audpp->stats);
 			audpp_broadcast(audpp, id, msg);
 		} else if (msg[0] == AUDPP_MSG_ENA_DIS) {
 			pr_info("audpp: DISABLE\n");
@@ -364,6 +370,7 @@ int audpp_enable(int id, audpp_event_func func, void *private)
 		}
 		LOG(EV_ENABLE, 2);
 		prevent_suspend();
+		audio_stats_interrupt_begin(&audpp->stats);
 		msm_adsp_enable(audpp->mod);
 		audpp_dsp_config(1);
 	} else {
@@ -957,6 +964,7 @@ static int audpp_probe(struct platform_device *pdev)
 	pr_info("Number of concurrency supported  %d\n",
 		audpp->dec_database->num_concurrency_support);
 	init_waitqueue_head(&audpp->event_wait);
+	audio_stats_register(&audpp->stats, "audpp");
 	for (idx = 0; idx < audpp->dec_database->num_dec; idx++) {
 		audpp->dec_info_table[idx].codec = -1;
 		audpp->dec_info_table[idx].pid = 0;
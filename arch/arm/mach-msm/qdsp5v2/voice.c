@@ -70,6 +70,7 @@
 #include <linux/completion.h>
 #include <linux/wait.h>
 #include <mach/qdsp5v2/voice.h>
+#include <mach/qdsp5v2/audio_stats.h>
 #include <mach/debug_audio_mm.h>
 
 struct voice_data {
@@ -99,6 +100,8 @@ struct voice_data {
 	int v_call_status; /* Start or End */
 	s32 max_rx_vol[VOC_RX_VOL_ARRAY_NUM]; /* [0] is for NB, [1] for WB */
 	s32 min_rx_vol[VOC_RX_VOL_ARRAY_NUM];
+	/* in-call device switch: DEV_CHG_VOICE to new device info sent */
+	struct audio_stats stats;
 };
 
 static struct voice_data voice;
@@ -170,6 +173,7 @@ static void voice_auddev_cb_function(u32 evt_id,
 			v->dev_tx.enabled = VOICE_DEV_DISABLED;
 			v->dev_state = DEV_CHANGE;
 			if (v->voc_state == VOICE_ACQUIRE) {
+				audio_stats_interrupt_begin(&v->stats);
 				msm_snddev_enable_sidetone(v->dev_rx.dev_id,
 				0);
 				/* send device change to modem */
@@ -644,6 +648,7 @@ static int voice_thread(void *data)
 				1);
 				/* send device info to modem */
 				voice_cmd_device_info(v);
+				audio_stats_interrupt_end(&v->stats);
 				/* update voice state */
 				v->voc_state = VOICE_ACQUIRE;
 			} else
@@ -691,6 +696,7 @@ static int __init voice_init(void)
 	atomic_set(&v->acq_start_flag, 0);
 	v->dev_event = 0;
 	v->voc_event = 0;
+	audio_stats_register(&v->stats, "voice");
 	init_completion(&voice.complete);
 	init_waitqueue_head(&v->dev_wait);
 	init_waitqueue_head(&v->voc_wait);
@@ -0,0 +1,85 @@
+/* Copyright (c) 2010, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+
+#include <linux/msm_audio.h>
+#include <linux/msm_audio_wma.h>
+
+#include <mach/qdsp5v2/qdsp5audppmsg.h>
+#include <mach/qdsp5v2/qdsp5audplaycmdi.h>
+#include <mach/qdsp5v2/qdsp5audplaymsg.h>
+#include <mach/qdsp5v2/audpp.h>
+#include <mach/qdsp5v2/codec_utils.h>
+#include <mach/qdsp5v2/wma_funcs.h>
+#include <mach/debug_audio_mm.h>
+
+long wma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct audio *audio = file->private_data;
+	int rc = -EINVAL;
+
+	MM_DBG("wma_ioctl() cmd = %d\n", cmd);
+
+	switch (cmd) {
+	case AUDIO_GET_WMA_CONFIG:
+		if (copy_to_user((void *)arg, &audio->wma_config,
+			sizeof(audio->wma_config)))
+			rc = -EFAULT;
+		else
+			rc = 0;
+		break;
+	case AUDIO_SET_WMA_CONFIG:
+		if (copy_from_user(&audio->wma_config, (void *)arg,
+			sizeof(audio->wma_config)))
+			rc = -EFAULT;
+		else
+			rc = 0;
+		break;
+	}
+
+	return rc;
+}
+
+void wma_set_defaults(struct audio *audio)
+{
+	audio->wma_config.armdatareqthr =  1262;
+	audio->wma_config.channelsdecoded = 2;
+	audio->wma_config.wmabytespersec = 6003;
+	audio->wma_config.wmasamplingfreq = 44100;
+	audio->wma_config.wmaencoderopts = 31;
+}
+
+void audpp_cmd_cfg_wma_params(struct audio *audio)
+{
+	struct audpp_cmd_cfg_adec_params_wma cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.common.cmd_id = AUDPP_CMD_CFG_ADEC_PARAMS;
+	cmd.common.length = AUDPP_CMD_CFG_ADEC_PARAMS_WMA_LEN;
+	cmd.common.dec_id = audio->dec_id;
+	cmd.common.input_sampling_frequency = audio->out_sample_rate;
+	cmd.armdatareqthr = audio->wma_config.armdatareqthr;
+	cmd.channelsdecoded = audio->wma_config.channelsdecoded;
+	cmd.wmabytespersec = audio->wma_config.wmabytespersec;
+	cmd.wmasamplingfreq = audio->wma_config.wmasamplingfreq;
+	cmd.wmaencoderopts = audio->wma_config.wmaencoderopts;
+
+	audpp_send_queue2(&cmd, sizeof(cmd));
+}
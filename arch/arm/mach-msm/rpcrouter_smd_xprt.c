@@ -113,6 +113,11 @@ static int rpcrouter_smd_remote_close(void)
 	return smd_close(smd_remote_xprt.channel);
 }
 
+static void rpcrouter_smd_remote_read_flush(void)
+{
+	smd_read_notify(smd_remote_xprt.channel);
+}
+
 static void rpcrouter_smd_remote_notify(void *_dev, unsigned event)
 {
 	if (event == SMD_EVENT_DATA)
@@ -199,6 +204,7 @@ static int rpcrouter_smd_remote_probe(struct platform_device *pdev)
 	smd_remote_xprt.xprt.write_avail = rpcrouter_smd_remote_write_avail;
 	smd_remote_xprt.xprt.write = rpcrouter_smd_remote_write;
 	smd_remote_xprt.xprt.close = rpcrouter_smd_remote_close;
+	smd_remote_xprt.xprt.read_flush = rpcrouter_smd_remote_read_flush;
 
 	/* Open up SMD channel */
 	rc = smd_open("RPCCALL", &smd_remote_xprt.channel, NULL,
@@ -206,6 +212,11 @@ static int rpcrouter_smd_remote_probe(struct platform_device *pdev)
 	if (rc < 0)
 		return rc;
 
+	/* the router reads each packet as header + body; only tell the
+	 * modem about freed FIFO space once the reader runs dry
+	 */
+	smd_set_batch_notify(smd_remote_xprt.channel, 1);
+
 	msm_rpcrouter_xprt_notify(&smd_remote_xprt.xprt,
 				  RPCROUTER_XPRT_EVENT_OPEN);
 	return 0;
@@ -23,6 +23,7 @@
 #include <linux/wait.h>
 #include <linux/interrupt.h>
 #include <linux/irq.h>
+#include <linux/hrtimer.h>
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/delay.h>
@@ -144,8 +145,90 @@ static void notify_other_smsm(uint32_t smsm_entry, uint32_t notify_mask)
 	}
 }
 
-static inline void notify_modem_smd(void)
+/* Interrupt mitigation on the apps-modem edge.
+ *
+ * During data bursts every packet can cause an interrupt in each
+ * direction. Once more than smd_poll_threshold interrupts arrive from the
+ * modem within a millisecond, the interrupt is masked and the channels
+ * are polled every smd_poll_us instead; interrupts to the modem are then
+ * batched into at most one per poll pass. After smd_poll_idle consecutive
+ * passes find nothing to do the interrupt is unmasked again.
+ */
+static int smd_poll_threshold = 16;
+module_param_named(poll_threshold, smd_poll_threshold,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+static int smd_poll_us = 500;
+module_param_named(poll_us, smd_poll_us,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+static int smd_poll_idle = 4;
+module_param_named(poll_idle, smd_poll_idle,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+struct smd_irq_stats smd_modem_irq_stats;
+
+static struct hrtimer smd_poll_timer;
+static ktime_t smd_irq_window_start;
+static unsigned smd_irq_window_count;
+static unsigned smd_poll_idle_count;
+/* polling and the pending notification are only changed together, under
+ * smd_notify_lock, so a notification can not be deferred to a poll pass
+ * that has already done its final flush.
+ */
+static DEFINE_SPINLOCK(smd_notify_lock);
+static int smd_modem_notify_pending;
+static ktime_t smd_modem_notify_deferred_at;
+
+static void notify_modem_smd(void)
 {
+	unsigned long flags;
+
+	spin_lock_irqsave(&smd_notify_lock, flags);
+	if (smd_modem_irq_stats.polling) {
+		if (!smd_modem_notify_pending) {
+			smd_modem_notify_pending = 1;
+			smd_modem_notify_deferred_at = ktime_get();
+		} else {
+			smd_modem_irq_stats.notify_saved++;
+		}
+		spin_unlock_irqrestore(&smd_notify_lock, flags);
+		return;
+	}
+	spin_unlock_irqrestore(&smd_notify_lock, flags);
+
+	smd_modem_irq_stats.notify_sent++;
+	MSM_TRIG_A2M_INT(0);
+}
+
+/* send the interrupt to the modem batched up by notify_modem_smd(),
+ * leaving polling mode first if stop_polling is set
+ */
+static void flush_modem_smd_notify(int stop_polling)
+{
+	unsigned long flags;
+	ktime_t deferred_at;
+	unsigned delay;
+	int pending;
+
+	spin_lock_irqsave(&smd_notify_lock, flags);
+	if (stop_polling)
+		smd_modem_irq_stats.polling = 0;
+	pending = smd_modem_notify_pending;
+	smd_modem_notify_pending = 0;
+	deferred_at = smd_modem_notify_deferred_at;
+	spin_unlock_irqrestore(&smd_notify_lock, flags);
+
+	if (!pending)
+		return;
+
+	delay = ktime_to_us(ktime_sub(ktime_get(), deferred_at));
+	smd_modem_irq_stats.notify_delay_us += delay;
+	if (delay > smd_modem_irq_stats.notify_delay_max_us)
+		smd_modem_irq_stats.notify_delay_max_us = delay;
+
+	smd_modem_irq_stats.notify_batches++;
+	smd_modem_irq_stats.notify_sent++;
 	MSM_TRIG_A2M_INT(0);
 }
 
@@ -252,6 +335,12 @@ struct smd_channel {
 	unsigned last_state;
 	void (*notify_other_cpu)(void);
 
+	/* in batch notify mode, freed fifo space is only signalled
+	 * to the other cpu by smd_read_notify()
+	 */
+	unsigned batch_notify;
+	unsigned read_notify_pending;
+
 	char name[20];
 	struct platform_device pdev;
 	unsigned type;
@@ -383,6 +472,28 @@ static int ch_read(struct smd_channel *ch, void *_data, int len)
 	return orig_len - len;
 }
 
+/* let the other cpu know that fifo space was freed, now or, in batch
+ * notify mode, when the reader calls smd_read_notify()
+ *
+ * must be called with smd_lock held
+ */
+static void __ch_notify_read(struct smd_channel *ch)
+{
+	if (ch->batch_notify)
+		ch->read_notify_pending = 1;
+	else
+		ch->notify_other_cpu();
+}
+
+static void ch_notify_read(struct smd_channel *ch)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&smd_lock, flags);
+	__ch_notify_read(ch);
+	spin_unlock_irqrestore(&smd_lock, flags);
+}
+
 static void update_stream_state(struct smd_channel *ch)
 {
 	/* streams have no special state requiring updating */
@@ -495,7 +606,8 @@ static void smd_state_change(struct smd_channel *ch,
 	}
 }
 
-static void handle_smd_irq(struct list_head *list, void (*notify)(void))
+/* returns non-zero if any channel on the list had events to process */
+static int handle_smd_irq(struct list_head *list, void (*notify)(void))
 {
 	unsigned long flags;
 	struct smd_channel *ch;
@@ -535,11 +647,70 @@ static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 		notify();
 	spin_unlock_irqrestore(&smd_lock, flags);
 	do_smd_probe();
+
+	return do_notify;
+}
+
+static int smd_modem_irq_storm(void)
+{
+	ktime_t now = ktime_get();
+
+	if (ktime_to_ns(ktime_sub(now, smd_irq_window_start)) >
+	    NSEC_PER_MSEC) {
+		smd_irq_window_start = now;
+		smd_irq_window_count = 0;
+	}
+
+	return ++smd_irq_window_count > smd_poll_threshold;
+}
+
+/* poll_us is writable at any time; never let it stall or spin the timer */
+static ktime_t smd_poll_period(void)
+{
+	int us = ACCESS_ONCE(smd_poll_us);
+
+	return ns_to_ktime((u64)max(us, 1) * NSEC_PER_USEC);
+}
+
+static enum hrtimer_restart smd_poll_timer_func(struct hrtimer *timer)
+{
+	smd_modem_irq_stats.polls++;
+	if (handle_smd_irq(&smd_ch_list_modem, notify_modem_smd)) {
+		smd_modem_irq_stats.irqs_saved++;
+		smd_poll_idle_count = 0;
+	} else {
+		smd_poll_idle_count++;
+	}
+	if (smd_poll_idle_count >= smd_poll_idle) {
+		flush_modem_smd_notify(1);
+		enable_irq(INT_A9_M2A_0);
+		/* an edge may have been missed while the irq was masked */
+		handle_smd_irq(&smd_ch_list_modem, notify_modem_smd);
+		return HRTIMER_NORESTART;
+	}
+
+	flush_modem_smd_notify(0);
+	hrtimer_forward_now(timer, smd_poll_period());
+	return HRTIMER_RESTART;
 }
 
 static irqreturn_t smd_modem_irq_handler(int irq, void *data)
 {
+	smd_modem_irq_stats.irqs++;
 	handle_smd_irq(&smd_ch_list_modem, notify_modem_smd);
+
+	if (smd_poll_threshold && smd_poll_us > 0 &&
+	    !smd_modem_irq_stats.polling && smd_modem_irq_storm()) {
+		disable_irq_nosync(irq);
+		spin_lock(&smd_notify_lock);
+		smd_modem_irq_stats.polling = 1;
+		spin_unlock(&smd_notify_lock);
+		smd_modem_irq_stats.poll_mode_entries++;
+		smd_poll_idle_count = 0;
+		hrtimer_start(&smd_poll_timer, smd_poll_period(),
+			      HRTIMER_MODE_REL);
+	}
+
 	return IRQ_HANDLED;
 }
 
@@ -692,7 +863,21 @@ static int smd_stream_read(smd_channel_t *ch, void *data, int len)
 
 	r = ch_read(ch, data, len);
 	if (r > 0)
-		ch->notify_other_cpu();
+		ch_notify_read(ch);
+
+	return r;
+}
+
+static int smd_stream_read_from_cb(smd_channel_t *ch, void *data, int len)
+{
+	int r;
+
+	if (len < 0)
+		return -EINVAL;
+
+	r = ch_read(ch, data, len);
+	if (r > 0)
+		__ch_notify_read(ch);
 
 	return r;
 }
@@ -709,10 +894,10 @@ static int smd_packet_read(smd_channel_t *ch, void *data, int len)
 		len = ch->current_packet;
 
 	r = ch_read(ch, data, len);
-	if (r > 0)
-		ch->notify_other_cpu();
 
 	spin_lock_irqsave(&smd_lock, flags);
+	if (r > 0)
+		__ch_notify_read(ch);
 	ch->current_packet -= r;
 	update_packet_state(ch);
 	spin_unlock_irqrestore(&smd_lock, flags);
@@ -732,7 +917,7 @@ static int smd_packet_read_from_cb(smd_channel_t *ch, void *data, int len)
 
 	r = ch_read(ch, data, len);
 	if (r > 0)
-		ch->notify_other_cpu();
+		__ch_notify_read(ch);
 
 	ch->current_packet -= r;
 	update_packet_state(ch);
@@ -823,7 +1008,7 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 		ch->read_avail = smd_stream_read_avail;
 		ch->write_avail = smd_stream_write_avail;
 		ch->update_state = update_stream_state;
-		ch->read_from_cb = smd_stream_read;
+		ch->read_from_cb = smd_stream_read_from_cb;
 	}
 
 	memcpy(ch->name, alloc_elm->name, 20);
@@ -883,7 +1068,7 @@ static int smd_alloc_loopback_channel(void)
 	ch->read_avail = smd_stream_read_avail;
 	ch->write_avail = smd_stream_write_avail;
 	ch->update_state = update_stream_state;
-	ch->read_from_cb = smd_stream_read;
+	ch->read_from_cb = smd_stream_read_from_cb;
 
 	memset(ch->name, 0, 20);
 	memcpy(ch->name, "local_loopback", 14);
@@ -962,6 +1147,8 @@ int smd_named_open_on_edge(const char *name, uint32_t edge,
 	SMD_DBG("smd_open: opening '%s'\n", ch->name);
 
 	spin_lock_irqsave(&smd_lock, flags);
+	ch->batch_notify = 0;
+	ch->read_notify_pending = 0;
 	if (SMD_CHANNEL_TYPE(ch->type) == SMD_APPS_MODEM)
 		list_add(&ch->ch_list, &smd_ch_list_modem);
 	else if (SMD_CHANNEL_TYPE(ch->type) == SMD_APPS_QDSP_I)
@@ -1030,6 +1217,37 @@ int smd_read_from_cb(smd_channel_t *ch, void *data, int len)
 }
 EXPORT_SYMBOL(smd_read_from_cb);
 
+/* must be called with smd_lock held */
+static void __smd_read_notify(smd_channel_t *ch)
+{
+	if (ch->read_notify_pending) {
+		ch->read_notify_pending = 0;
+		ch->notify_other_cpu();
+	}
+}
+
+void smd_set_batch_notify(smd_channel_t *ch, int enable)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&smd_lock, flags);
+	ch->batch_notify = !!enable;
+	if (!enable)
+		__smd_read_notify(ch);
+	spin_unlock_irqrestore(&smd_lock, flags);
+}
+EXPORT_SYMBOL(smd_set_batch_notify);
+
+void smd_read_notify(smd_channel_t *ch)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&smd_lock, flags);
+	__smd_read_notify(ch);
+	spin_unlock_irqrestore(&smd_lock, flags);
+}
+EXPORT_SYMBOL(smd_read_notify);
+
 int smd_write(smd_channel_t *ch, const void *data, int len)
 {
 	return ch->write(ch, data, len);
@@ -1372,6 +1590,9 @@ int smd_core_init(void)
 	int r;
 	SMD_INFO("smd_core_init()\n");
 
+	hrtimer_init(&smd_poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	smd_poll_timer.function = smd_poll_timer_func;
+
 	r = request_irq(INT_A9_M2A_0, smd_modem_irq_handler,
 			IRQF_TRIGGER_RISING, "smd_dev", 0);
 	if (r < 0)
@@ -1459,8 +1680,21 @@ static int __init msm_smd_probe(struct platform_device *pdev)
 	return 0;
 }
 
+/* the modem interrupt must be unmasked to wake us up from suspend */
+static int msm_smd_suspend_late(struct platform_device *pdev,
+				pm_message_t state)
+{
+	if (hrtimer_cancel(&smd_poll_timer)) {
+		flush_modem_smd_notify(1);
+		enable_irq(INT_A9_M2A_0);
+		handle_smd_irq(&smd_ch_list_modem, notify_modem_smd);
+	}
+	return 0;
+}
+
 static struct platform_driver msm_smd_driver = {
 	.probe = msm_smd_probe,
+	.suspend_late = msm_smd_suspend_late,
 	.driver = {
 		.name = MODULE_NAME,
 		.owner = THIS_MODULE,
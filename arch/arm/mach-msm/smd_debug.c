@@ -18,6 +18,7 @@
 #include <linux/debugfs.h>
 #include <linux/list.h>
 #include <linux/ctype.h>
+#include <linux/math64.h>
 
 #include <mach/msm_iomap.h>
 
@@ -409,6 +410,29 @@ static int debug_read_intr_mux(char *buf, int max)
 	return i;
 }
 
+static int debug_read_irq_stats(char *buf, int max)
+{
+	struct smd_irq_stats *s = &smd_modem_irq_stats;
+	unsigned avg = 0;
+
+	if (s->notify_batches)
+		avg = (unsigned)div_u64(s->notify_delay_us, s->notify_batches);
+
+	return scnprintf(buf, max,
+			 "mode: %s\n"
+			 "irqs from modem: %u\n"
+			 "poll mode entries: %u\n"
+			 "poll passes: %u\n"
+			 "irqs saved: %u\n"
+			 "irqs to modem: %u\n"
+			 "irqs to modem saved: %u\n"
+			 "added latency (us): total %llu avg %u max %u\n",
+			 s->polling ? "polled" : "interrupt",
+			 s->irqs, s->poll_mode_entries, s->polls,
+			 s->irqs_saved, s->notify_sent, s->notify_saved,
+			 s->notify_delay_us, avg, s->notify_delay_max_us);
+}
+
 #define DEBUG_BUFMAX 4096
 static char debug_buffer[DEBUG_BUFMAX];
 
@@ -462,6 +486,7 @@ static int __init smd_debugfs_init(void)
 	debug_create("modem_err_f3", 0444, dent, debug_modem_err_f3);
 	debug_create("print_diag", 0444, dent, debug_diag);
 	debug_create("print_f3", 0444, dent, debug_f3);
+	debug_create("irq", 0444, dent, debug_read_irq_stats);
 
 	/* NNV: this is google only stuff */
 	debug_create("build", 0444, dent, debug_read_build_id);
@@ -318,6 +318,22 @@ struct smd_half_channel {
 
 extern spinlock_t smem_lock;
 
+/* interrupt mitigation counters for the apps-modem edge */
+struct smd_irq_stats {
+	unsigned irqs;			/* interrupts taken from the modem */
+	unsigned poll_mode_entries;	/* switches to polled operation */
+	unsigned polls;			/* poll passes while polled */
+	unsigned irqs_saved;		/* poll passes that found work */
+	unsigned notify_sent;		/* interrupts sent to the modem */
+	unsigned notify_saved;		/* interrupts to the modem batched */
+	unsigned notify_batches;	/* batched interrupts sent */
+	unsigned long long notify_delay_us; /* total delay of batched ones */
+	unsigned notify_delay_max_us;
+	int polling;
+};
+
+extern struct smd_irq_stats smd_modem_irq_stats;
+
 extern int (*msm_check_for_modem_crash)(void);
 void *smem_find(unsigned id, unsigned size);
 void *smem_get_entry(unsigned id, unsigned *size);
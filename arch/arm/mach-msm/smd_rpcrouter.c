@@ -39,6 +39,7 @@
 #include <linux/platform_device.h>
 #include <linux/uaccess.h>
 #include <linux/debugfs.h>
+#include <linux/hash.h>
 
 #include <asm/byteorder.h>
 
@@ -134,6 +135,34 @@ if (smd_rpcrouter_debug_mask & NTFY_MSG) \
 static LIST_HEAD(local_endpoints);
 static LIST_HEAD(remote_endpoints);
 
+/* Every packet is routed through a server, local endpoint and remote
+ * endpoint lookup; the lists above are kept for iteration only and the
+ * lookups go through these hash tables, protected by the same locks.
+ */
+#define RPCROUTER_HASH_BITS 5
+#define RPCROUTER_HASH_SIZE (1 << RPCROUTER_HASH_BITS)
+
+static struct hlist_head server_hash[RPCROUTER_HASH_SIZE];
+static struct hlist_head local_endpoint_hash[RPCROUTER_HASH_SIZE];
+static struct hlist_head remote_endpoint_hash[RPCROUTER_HASH_SIZE];
+
+static inline struct hlist_head *server_hash_head(uint32_t prog)
+{
+	return &server_hash[hash_long(prog, RPCROUTER_HASH_BITS)];
+}
+
+static inline struct hlist_head *local_endpoint_hash_head(uint32_t cid)
+{
+	return &local_endpoint_hash[hash_long(cid, RPCROUTER_HASH_BITS)];
+}
+
+static inline struct hlist_head *remote_endpoint_hash_head(uint32_t pid,
+							   uint32_t cid)
+{
+	return &remote_endpoint_hash[hash_long(cid ^ (pid << 24),
+					       RPCROUTER_HASH_BITS)];
+}
+
 static LIST_HEAD(server_list);
 
 static wait_queue_head_t newserver_wait;
@@ -347,6 +376,24 @@ static void modem_reset_start_cleanup(void)
 }
 
 
+/* Servers are looked up by program, oldest first as on server_list, so
+ * keep each hash chain in order of creation.
+ */
+static void add_server_hash(struct rr_server *server)
+{
+	struct hlist_head *head = server_hash_head(server->prog);
+	struct hlist_node *last;
+
+	if (hlist_empty(head)) {
+		hlist_add_head(&server->hash, head);
+		return;
+	}
+
+	for (last = head->first; last->next; last = last->next)
+		;
+	hlist_add_after(last, &server->hash);
+}
+
 static struct rr_server *rpcrouter_create_server(uint32_t pid,
 							uint32_t cid,
 							uint32_t prog,
@@ -368,6 +415,7 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_add_tail(&server->list, &server_list);
+	add_server_hash(server);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 
 	rc = msm_rpcrouter_create_server_cdev(server);
@@ -378,6 +426,7 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 out_fail:
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_del(&server->list);
+	hlist_del(&server->hash);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 	kfree(server);
 	return ERR_PTR(rc);
@@ -389,6 +438,7 @@ static void rpcrouter_destroy_server(struct rr_server *server)
 
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_del(&server->list);
+	hlist_del(&server->hash);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 	device_destroy(msm_rpcrouter_class, server->device_number);
 	kfree(server);
@@ -397,10 +447,11 @@ static void rpcrouter_destroy_server(struct rr_server *server)
 static struct rr_server *rpcrouter_lookup_server(uint32_t prog, uint32_t ver)
 {
 	struct rr_server *server;
+	struct hlist_node *node;
 	unsigned long flags;
 
 	spin_lock_irqsave(&server_list_lock, flags);
-	list_for_each_entry(server, &server_list, list) {
+	hlist_for_each_entry(server, node, server_hash_head(prog), hash) {
 		if (server->prog == prog
 		 && server->vers == ver) {
 			spin_unlock_irqrestore(&server_list_lock, flags);
@@ -476,6 +527,7 @@ struct msm_rpc_endpoint *msm_rpcrouter_create_local_endpoint(dev_t dev)
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_add_tail(&ept->list, &local_endpoints);
+	hlist_add_head(&ept->hash, local_endpoint_hash_head(ept->cid));
 	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	return ept;
 }
@@ -517,7 +569,10 @@ int msm_rpcrouter_destroy_local_endpoint(struct msm_rpc_endpoint *ept)
 
 	wake_lock_destroy(&ept->read_q_wake_lock);
 	wake_lock_destroy(&ept->reply_q_wake_lock);
+	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_del(&ept->list);
+	hlist_del(&ept->hash);
+	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	kfree(ept);
 	return 0;
 }
@@ -539,6 +594,7 @@ static int rpcrouter_create_remote_endpoint(uint32_t pid, uint32_t cid)
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
 	list_add_tail(&new_c->list, &remote_endpoints);
+	hlist_add_head(&new_c->hash, remote_endpoint_hash_head(pid, cid));
 	new_c->quota_restart_state = RESTART_NORMAL;
 	spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 	return 0;
@@ -547,10 +603,11 @@ static int rpcrouter_create_remote_endpoint(uint32_t pid, uint32_t cid)
 static struct msm_rpc_endpoint *rpcrouter_lookup_local_endpoint(uint32_t cid)
 {
 	struct msm_rpc_endpoint *ept;
+	struct hlist_node *node;
 	unsigned long flags;
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
-	list_for_each_entry(ept, &local_endpoints, list) {
+	hlist_for_each_entry(ept, node, local_endpoint_hash_head(cid), hash) {
 		if (ept->cid == cid) {
 			spin_unlock_irqrestore(&local_endpoints_lock, flags);
 			return ept;
@@ -564,10 +621,12 @@ static struct rr_remote_endpoint *rpcrouter_lookup_remote_endpoint(uint32_t pid,
 								   uint32_t cid)
 {
 	struct rr_remote_endpoint *ept;
+	struct hlist_node *node;
 	unsigned long flags;
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
-	list_for_each_entry(ept, &remote_endpoints, list) {
+	hlist_for_each_entry(ept, node, remote_endpoint_hash_head(pid, cid),
+			     hash) {
 		if ((ept->pid == pid) && (ept->cid == cid)) {
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			return ept;
@@ -755,6 +814,7 @@ static int process_control_msg(struct rpcrouter_xprt_info *xprt_info,
 		if (r_ept) {
 			spin_lock_irqsave(&remote_endpoints_lock, flags);
 			list_del(&r_ept->list);
+			hlist_del(&r_ept->hash);
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			kfree(r_ept);
 		}
@@ -836,6 +896,12 @@ static int rr_read(struct rpcrouter_xprt_info *xprt_info,
 		wake_unlock(&xprt_info->wakelock);
 		spin_unlock_irqrestore(&xprt_info->lock, flags);
 
+		/* everything available has been consumed; let the remote
+		 * end refill before we sleep
+		 */
+		if (xprt_info->xprt->read_flush)
+			xprt_info->xprt->read_flush();
+
 		wait_event(xprt_info->read_wait,
 			   xprt_info->xprt->read_avail() >= len);
 	}
@@ -1738,6 +1804,7 @@ static struct rr_server *msm_rpc_get_server(uint32_t prog, uint32_t vers,
 					    uint32_t *found_prog)
 {
 	struct rr_server *server;
+	struct hlist_node *node;
 	unsigned long     flags;
 
 	if (found_prog == NULL)
@@ -1745,7 +1812,7 @@ static struct rr_server *msm_rpc_get_server(uint32_t prog, uint32_t vers,
 
 	*found_prog = 0;
 	spin_lock_irqsave(&server_list_lock, flags);
-	list_for_each_entry(server, &server_list, list) {
+	hlist_for_each_entry(server, node, server_hash_head(prog), hash) {
 		if (server->prog == prog) {
 			*found_prog = 1;
 			spin_unlock_irqrestore(&server_list_lock, flags);
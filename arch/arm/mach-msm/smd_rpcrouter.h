@@ -118,6 +118,7 @@ static inline uint32_t PACMARK(uint32_t len, uint32_t mid, uint32_t first,
 
 struct rr_server {
 	struct list_head list;
+	struct hlist_node hash;	/* server_hash, keyed by prog */
 
 	uint32_t pid;
 	uint32_t cid;
@@ -141,6 +142,7 @@ struct rr_remote_endpoint {
 	wait_queue_head_t quota_wait;
 
 	struct list_head list;
+	struct hlist_node hash;	/* remote_endpoint_hash, keyed by pid/cid */
 };
 
 struct msm_rpc_reply {
@@ -154,6 +156,7 @@ struct msm_rpc_reply {
 
 struct msm_rpc_endpoint {
 	struct list_head list;
+	struct hlist_node hash;	/* local_endpoint_hash, keyed by cid */
 
 	/* incomplete packets waiting for assembly */
 	struct list_head incomplete;
@@ -204,6 +207,11 @@ struct rpcrouter_xprt {
 	int (*write_avail)(void);
 	int (*write)(void *data, uint32_t len);
 	int (*close)(void);
+
+	/* optional: signal the remote end about data consumed by read()
+	 * when the transport batches these notifications
+	 */
+	void (*read_flush)(void);
 };
 
 /* shared between smd_rpcrouter*.c */
@@ -15,9 +15,11 @@
 #include <linux/signal.h>
 #include <linux/sched.h>
 #include <linux/init.h>
+#include <linux/hardirq.h>
 
 #include <asm/thread_notify.h>
 #include <asm/vfp.h>
+#include <asm/neon.h>
 
 #include "vfpinstr.h"
 #include "vfp.h"
@@ -372,6 +374,30 @@ void vfp_reinit(void)
 	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
 }
 
+#ifdef CONFIG_NEON
+/*
+ * Kernel mode NEON: whatever thread owns the hardware state has it saved
+ * and loses ownership, so that its next VFP instruction traps and
+ * reloads it.  Preemption stays off until kernel_neon_end().
+ */
+void kernel_neon_begin(void)
+{
+	BUG_ON(in_interrupt());
+	preempt_disable();
+	vfp_flush_context();
+	fmxr(FPEXC, fmrx(FPEXC) | FPEXC_EN);
+	isb();
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	preempt_enable();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+#endif
+
 #ifdef CONFIG_PM
 #include <linux/sysdev.h>
 
@@ -4,10 +4,12 @@
 #include <linux/module.h>
 #include <linux/proc_fs.h>
 #include <asm/uaccess.h>	/* for copy_from_user */
+#include <asm/div64.h>
 
 
 #include "../../../arch/arm/mach-msm/smd_private.h"
 #include "diagfwd.h"
+#include "diagchar.h"
 
 #define MAGIC_WORD_UNLOCK	"unlock_john"
 #define MAGIC_WORD_LOCK		"lock_john"
@@ -94,6 +96,48 @@ static int proc_debug_smem_write(struct file *file, const char *buf, size_t size
 
 
 
+/* Modem SMD -> USB forwarding counters, see diag_smd_send_req() */
+static int proc_diag_fwd_stats_read(char *page, char **start, off_t off,
+				    int count, int *eof, void *data)
+{
+	unsigned long secs;
+	unsigned long long rate;
+	int len;
+
+	if (!driver) {
+		*eof = 1;
+		return 0;
+	}
+
+	secs = driver->usb_connected ?
+		(jiffies - driver->usb_connect_jiffies) / HZ : 0;
+	rate = driver->smd_in_bytes - driver->usb_connect_bytes;
+	do_div(rate, secs ? secs : 1);
+
+	len = sprintf(page,
+		      "smd_pkts: %lu\n"
+		      "smd_bytes: %llu\n"
+		      "usb_writes: %lu\n"
+		      "pkts_per_write: %lu\n"
+		      "stalls: %lu\n"
+		      "drops: %lu\n"
+		      "dropped_apps: %d\n"
+		      "connected_secs: %lu\n"
+		      "bytes_per_sec: %llu\n",
+		      driver->smd_in_pkts,
+		      driver->smd_in_bytes,
+		      driver->usb_in_writes,
+		      driver->usb_in_writes ?
+			driver->smd_in_pkts / driver->usb_in_writes : 0,
+		      driver->smd_in_stalls,
+		      driver->smd_in_drops,
+		      driver->dropped_count,
+		      secs, rate);
+
+	*eof = 1;
+	return len;
+}
+
 static int __init init_debug_status(void)
 {
 
@@ -101,6 +145,8 @@ static int __init init_debug_status(void)
 	p = create_proc_entry ("debug_smem", S_IFREG | S_IRUGO | S_IWUGO, NULL);
 	if(p)
 		p->proc_fops = &proc_debug_smem_fops;
+	create_proc_read_entry("diag_fwd_stats", S_IRUGO, NULL,
+			       proc_diag_fwd_stats_read, NULL);
 	return 0;
 }
 
@@ -108,6 +154,7 @@ static void __exit cleanup_debug_status(void)
 {
 	pr_debug("cleanup testdebug\n");
 	remove_proc_entry ("debug_smem", NULL);
+	remove_proc_entry("diag_fwd_stats", NULL);
 }
 
 module_init(init_debug_status);
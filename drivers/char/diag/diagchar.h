@@ -34,6 +34,7 @@
 #include <linux/mempool.h>
 #include <linux/mutex.h>
 #include <linux/workqueue.h>
+#include <linux/spinlock.h>
 #include <mach/msm_smd.h>
 #include <asm/atomic.h>
 
@@ -41,6 +42,8 @@
 #define USB_MAX_OUT_BUF 4096
 #define USB_MAX_IN_BUF  8192
 #define MAX_BUF_SIZE  	32768
+/* Number of modem SMD -> USB buffers that may be in flight at once */
+#define NUM_SMD_IN_BUFS 4
 /* Size of the buffer used for deframing a packet
   reveived from the PC tool*/
 #define HDLC_MAX 4096
@@ -99,12 +102,16 @@ struct diagchar_dev {
 	int used;
 
 	/* State for diag forwarding */
-	unsigned char *usb_buf_in;
+	unsigned char *usb_buf_in[NUM_SMD_IN_BUFS];
+	unsigned int usb_buf_in_size[NUM_SMD_IN_BUFS];
 	unsigned char *usb_buf_in_qdsp;
 	unsigned char *usb_buf_out;
 	smd_channel_t *ch;
 	smd_channel_t *chqdsp;
-	int in_busy;
+	int in_busy[NUM_SMD_IN_BUFS];
+	spinlock_t in_lock;
+	int in_draining;
+	int in_drain_again;
 	int in_busy_qdsp;
 	int read_len;
 	unsigned char *hdlc_buf;
@@ -120,10 +127,18 @@ struct diagchar_dev {
 	struct diag_master_table *table;
 	uint8_t *pkt_buf;
 	int pkt_length;
-	struct diag_request *usb_write_ptr;
+	struct diag_request *usb_write_ptr[NUM_SMD_IN_BUFS];
 	struct diag_request *usb_read_ptr;
 	struct diag_request *usb_write_ptr_svc;
 	struct diag_request *usb_write_ptr_qdsp;
+	/* Modem SMD -> USB forwarding statistics */
+	unsigned long smd_in_pkts;
+	unsigned long long smd_in_bytes;
+	unsigned long usb_in_writes;
+	unsigned long smd_in_stalls;
+	unsigned long smd_in_drops;
+	unsigned long usb_connect_jiffies;
+	unsigned long long usb_connect_bytes;
 };
 
 extern struct diagchar_dev *driver;
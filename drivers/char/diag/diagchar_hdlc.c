@@ -62,6 +62,7 @@
 #include <linux/device.h>
 #include <linux/uaccess.h>
 #include <linux/crc-ccitt.h>
+#include <linux/string.h>
 #include "diagchar_hdlc.h"
 
 
@@ -72,6 +73,41 @@ MODULE_LICENSE("GPL v2");
 #define CRC_16_L_STEP(xx_crc, xx_c) \
 	crc_ccitt_byte(xx_crc, xx_c)
 
+#define HDLC_ONES	0x01010101UL
+#define HDLC_HIGHS	0x80808080UL
+#define HDLC_HASZERO(v)	(((v) - HDLC_ONES) & ~(v) & HDLC_HIGHS)
+
+/*
+ * Return the number of leading bytes in p[0..len) that are neither
+ * CONTROL_CHAR nor ESC_CHAR and so pass through HDLC unchanged.
+ * Aligned words are tested four bytes at a time.
+ */
+static unsigned int diag_hdlc_scan(const uint8_t *p, unsigned int len)
+{
+	const uint8_t *start = p;
+	const uint8_t *end = p + len;
+	unsigned long v;
+
+	while (p < end && ((unsigned long)p & 3)) {
+		if (*p == CONTROL_CHAR || *p == ESC_CHAR)
+			return p - start;
+		p++;
+	}
+
+	while (end - p >= 4) {
+		v = *(const uint32_t *)p;
+		if (HDLC_HASZERO(v ^ (CONTROL_CHAR * HDLC_ONES)) ||
+		    HDLC_HASZERO(v ^ (ESC_CHAR * HDLC_ONES)))
+			break;
+		p += 4;
+	}
+
+	while (p < end && *p != CONTROL_CHAR && *p != ESC_CHAR)
+		p++;
+
+	return p - start;
+}
+
 void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 		      struct diag_hdlc_dest_type *enc)
 {
@@ -83,6 +119,7 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 	unsigned char src_byte = 0;
 	enum diag_send_state_enum_type state;
 	unsigned int used = 0;
+	unsigned int run;
 
 	if (src_desc && enc) {
 
@@ -108,6 +145,19 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 			   of 2 dest bytes for an escaped byte */
 			while (src <= src_last && dest <= dest_last) {
 
+				/* Copy a run of bytes needing no escape */
+				run = diag_hdlc_scan(src,
+					min(src_last - src, dest_last - dest)
+					+ 1);
+				if (run) {
+					crc = crc_ccitt(crc, src, run);
+					memcpy(dest, src, run);
+					src += run;
+					dest += run;
+					used += run;
+					continue;
+				}
+
 				src_byte = *src++;
 
 				if ((src_byte == CONTROL_CHAR) ||
@@ -212,6 +262,7 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 
 	unsigned int len = 0;
 	unsigned int i;
+	unsigned int run;
 	uint8_t src_byte;
 
 	int pkt_bnd = 0;
@@ -230,6 +281,18 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 
 		for (i = 0; i < src_length; i++) {
 
+			/* Copy a run of unescaped bytes */
+			if (!hdlc->escaping) {
+				run = diag_hdlc_scan(&src_ptr[i],
+					min(src_length - i,
+					    dest_length - len));
+				memcpy(&dest_ptr[len], &src_ptr[i], run);
+				len += run;
+				i += run;
+				if (len >= dest_length || i >= src_length)
+					break;
+			}
+
 			src_byte = src_ptr[i];
 
 			if (hdlc->escaping) {
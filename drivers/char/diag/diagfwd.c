@@ -144,65 +144,193 @@ do {							\
 	(diag_debug_buf_idx++) : (diag_debug_buf_idx = 0); \
 } while (0)
 
-static void diag_smd_send_req(int context)
+/*
+ * Modem data is forwarded through NUM_SMD_IN_BUFS buffers so that SMD
+ * can be drained while earlier USB transfers are still in flight.  Each
+ * buffer is filled with as many whole SMD packets as fit before it is
+ * handed to USB, so bursts of small log packets go out in one transfer.
+ */
+#define DIAG_IN_FREE	0
+#define DIAG_IN_HELD	1	/* not forwarded: USB down or diag locked */
+#define DIAG_IN_QUEUED	2	/* owned by USB until write completion */
+#define DIAG_IN_FILLING	3	/* being filled by diag_smd_send_req() */
+
+/*
+ * in_lock only guards the in_busy[] states and the drain flags.  The
+ * SMD reads, buffer growth and USB writes run outside it on a buffer
+ * claimed as DIAG_IN_FILLING: the SMD callback calls in with smd_lock
+ * held, and write completion takes in_lock too.
+ */
+static int diag_smd_get_in_buf(void)
 {
-	void *buf;
+	int i;
 
+	for (i = 0; i < NUM_SMD_IN_BUFS; i++)
+		if (driver->in_busy[i] == DIAG_IN_FREE && driver->usb_buf_in[i])
+			return i;
 #if defined(CONFIG_QXDM_LOG)
-	if (driver->ch && ((!driver->in_busy) || enable_qxdm_log)) {
-#else
-	if (driver->ch && (!driver->in_busy)) {
+	/* logging to circular_buf keeps running while forwarding is held */
+	if (enable_qxdm_log)
+		for (i = 0; i < NUM_SMD_IN_BUFS; i++)
+			if (driver->in_busy[i] == DIAG_IN_HELD &&
+			    driver->usb_buf_in[i])
+				return i;
 #endif
-		int r = smd_read_avail(driver->ch);
+	return -1;
+}
 
-	if (r > USB_MAX_IN_BUF) {
-		if (r < MAX_BUF_SIZE) {
-				printk(KERN_ALERT "\n diag: SMD sending in "
-					   "packets upto %d bytes", r);
-				driver->usb_buf_in = krealloc(
-					driver->usb_buf_in, r, GFP_KERNEL);
-		} else {
-			printk(KERN_ALERT "\n diag: SMD sending in "
-				 "packets more than %d bytes", MAX_BUF_SIZE);
-			return;
-		}
+static void diag_smd_set_in_busy(int busy)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&driver->in_lock, flags);
+	for (i = 0; i < NUM_SMD_IN_BUFS; i++) {
+		if (driver->in_busy[i] == DIAG_IN_FILLING)
+			continue;
+		if (busy && driver->in_busy[i] == DIAG_IN_QUEUED)
+			continue;
+		driver->in_busy[i] = busy ? DIAG_IN_HELD : DIAG_IN_FREE;
 	}
-		if (r > 0) {
+	spin_unlock_irqrestore(&driver->in_lock, flags);
+}
 
-			buf = driver->usb_buf_in;
+static void diag_smd_set_in_state(int i, int state)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&driver->in_lock, flags);
+	driver->in_busy[i] = state;
+	spin_unlock_irqrestore(&driver->in_lock, flags);
+}
+
+/* Claim a free buffer for the drain, returning its previous state too */
+static int diag_smd_claim_in_buf(int *prev)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&driver->in_lock, flags);
+	i = diag_smd_get_in_buf();
+	if (i >= 0) {
+		*prev = driver->in_busy[i];
+		driver->in_busy[i] = DIAG_IN_FILLING;
+	} else {
+		/* all buffers in flight, write completion resumes */
+		driver->smd_in_stalls++;
+	}
+	spin_unlock_irqrestore(&driver->in_lock, flags);
+	return i;
+}
+
+static void diag_smd_drain(int context)
+{
+	unsigned char *buf;
+	int i, r, used, pkts, prev;
+
+	while ((r = smd_read_avail(driver->ch)) > 0) {
+		i = diag_smd_claim_in_buf(&prev);
+		if (i < 0)
+			break;
+
+		if (r > driver->usb_buf_in_size[i]) {
+			if (r >= MAX_BUF_SIZE) {
+				printk(KERN_ALERT "\n diag: SMD sending in "
+					 "packets more than %d bytes", MAX_BUF_SIZE);
+				driver->smd_in_drops++;
+				diag_smd_set_in_state(i, prev);
+				break;
+			}
+			printk(KERN_ALERT "\n diag: SMD sending in "
+				   "packets upto %d bytes", r);
+			buf = krealloc(driver->usb_buf_in[i], r, GFP_ATOMIC);
 			if (!buf) {
 				printk(KERN_INFO "Out of diagmem for a9\n");
-			} else {
-				APPEND_DEBUG('i');
-				if (context == SMD_CONTEXT)
-					smd_read_from_cb(driver->ch, buf, r);
-				else
-					smd_read(driver->ch, buf, r);
-				APPEND_DEBUG('j');
-				driver->in_busy = 1;
-				driver->usb_write_ptr->buf = buf;
-				driver->usb_write_ptr->length = r;
+				diag_smd_set_in_state(i, prev);
+				break;
+			}
+			driver->usb_buf_in[i] = buf;
+			driver->usb_buf_in_size[i] = r;
+		}
+		buf = driver->usb_buf_in[i];
+
+		APPEND_DEBUG('i');
+		used = 0;
+		pkts = 0;
+		do {
+			if (context == SMD_CONTEXT)
+				smd_read_from_cb(driver->ch, buf + used, r);
+			else
+				smd_read(driver->ch, buf + used, r);
+			used += r;
+			pkts++;
+			r = smd_read_avail(driver->ch);
+		} while (r > 0 && used + r <= driver->usb_buf_in_size[i]);
+		APPEND_DEBUG('j');
+
+		driver->smd_in_pkts += pkts;
+		driver->smd_in_bytes += used;
 #if defined(CONFIG_QXDM_LOG)
-				if (enable_qxdm_log)
-					fillbuffer(buf, r);
+		if (enable_qxdm_log) {
+			fillbuffer(buf, used);
+			diag_smd_set_in_state(i, prev);
+			continue;
+		}
+		/* locked: hold the buffer, as before, until reconnect */
+		if (!debug_mode_enable && diag_lock) {
+			diag_smd_set_in_state(i, DIAG_IN_HELD);
+			continue;
+		}
 #endif
 #ifdef DIAG_DEBUG
-				printk(KERN_INFO "writing data to USB,"
-						 " pkt length %d \n", r);
-				print_hex_dump(KERN_DEBUG, "Written Packet Data"
-					       " to USB: ", 16, 1,
-					       DUMP_PREFIX_ADDRESS, buf, r, 1);
+		printk(KERN_INFO "writing data to USB,"
+				 " pkt length %d \n", used);
+		print_hex_dump(KERN_DEBUG, "Written Packet Data"
+			       " to USB: ", 16, 1,
+			       DUMP_PREFIX_ADDRESS, buf, used, 1);
 #endif
-#if defined(CONFIG_QXDM_LOG)
-				if((debug_mode_enable || !diag_lock) && !enable_qxdm_log)
-#endif
-				diag_write(driver->usb_write_ptr);
-				APPEND_DEBUG('k');
-			}
+		driver->usb_write_ptr[i]->buf = buf;
+		driver->usb_write_ptr[i]->length = used;
+		/* completion may run before diag_write() returns */
+		diag_smd_set_in_state(i, DIAG_IN_QUEUED);
+		if (diag_write(driver->usb_write_ptr[i])) {
+			/* USB is gone; leave the rest in SMD, don't drop it */
+			diag_smd_set_in_state(i, DIAG_IN_HELD);
+			driver->smd_in_drops += pkts;
+			break;
 		}
+		driver->usb_in_writes++;
+		APPEND_DEBUG('k');
 	}
 }
 
+static void diag_smd_send_req(int context)
+{
+	unsigned long flags;
+
+	if (!driver->ch)
+		return;
+
+	/* one drain at a time keeps SMD packets in order on USB */
+	spin_lock_irqsave(&driver->in_lock, flags);
+	if (driver->in_draining) {
+		driver->in_drain_again = 1;
+		spin_unlock_irqrestore(&driver->in_lock, flags);
+		return;
+	}
+	driver->in_draining = 1;
+	do {
+		driver->in_drain_again = 0;
+		spin_unlock_irqrestore(&driver->in_lock, flags);
+
+		diag_smd_drain(context);
+
+		spin_lock_irqsave(&driver->in_lock, flags);
+	} while (driver->in_drain_again);
+	driver->in_draining = 0;
+	spin_unlock_irqrestore(&driver->in_lock, flags);
+}
+
 static void diag_smd_qdsp_send_req(int context)
 {
 	void *buf;
@@ -553,10 +681,13 @@ static void diag_process_hdlc(void *data, unsigned len)
 int diagfwd_connect(void)
 {
 	printk(KERN_DEBUG "diag: USB connected\n");
-	diag_open(driver->poolsize + 3); /* 2 for A9 ; 1 for q6*/
+	/* NUM_SMD_IN_BUFS + 1 for A9 ; 1 for q6 */
+	diag_open(driver->poolsize + NUM_SMD_IN_BUFS + 2);
 
 	driver->usb_connected = 1;
-	driver->in_busy = 0;
+	driver->usb_connect_jiffies = jiffies;
+	driver->usb_connect_bytes = driver->smd_in_bytes;
+	diag_smd_set_in_busy(0);
 	driver->in_busy_qdsp = 0;
 
 	/* Poll SMD channels to check for data*/
@@ -579,7 +710,7 @@ int diagfwd_disconnect(void)
 #endif
 	printk(KERN_DEBUG "diag: USB disconnected\n");
 	driver->usb_connected = 0;
-	driver->in_busy = 1;
+	diag_smd_set_in_busy(1);
 	driver->in_busy_qdsp = 1;
 	driver->debug_flag = 1;
 	connect_to_PC_QXDM = 0;
@@ -591,10 +722,19 @@ int diagfwd_disconnect(void)
 int diagfwd_write_complete(struct diag_request *diag_write_ptr)
 {
 	unsigned char *buf = diag_write_ptr->buf;
+	unsigned long flags;
+	int i;
+
 	/*Determine if the write complete is for data from arm9/apps/q6 */
 	/* Need a context variable here instead */
-	if (buf == (void *)driver->usb_buf_in) {
-		driver->in_busy = 0;
+	for (i = 0; i < NUM_SMD_IN_BUFS; i++)
+		if (buf == (void *)driver->usb_buf_in[i])
+			break;
+
+	if (i < NUM_SMD_IN_BUFS) {
+		spin_lock_irqsave(&driver->in_lock, flags);
+		driver->in_busy[i] = DIAG_IN_FREE;
+		spin_unlock_irqrestore(&driver->in_lock, flags);
 		APPEND_DEBUG('o');
 		diag_smd_send_req(NON_SMD_CONTEXT);
 	} else if (buf == (void *)driver->usb_buf_in_qdsp) {
@@ -649,14 +789,16 @@ static void diag_smd_qdsp_notify(void *ctxt, unsigned event)
 static int diag_smd_probe(struct platform_device *pdev)
 {
 	int r = 0;
+	int i;
 
 	if (pdev->id == 0) {
-		if (driver->usb_buf_in == NULL &&
-			(driver->usb_buf_in =
-			kzalloc(USB_MAX_IN_BUF, GFP_KERNEL)) == NULL)
-
-			goto err;
-		else
+		for (i = 0; i < NUM_SMD_IN_BUFS; i++) {
+			if (driver->usb_buf_in[i] == NULL &&
+				(driver->usb_buf_in[i] =
+				kzalloc(USB_MAX_IN_BUF, GFP_KERNEL)) == NULL)
+				goto err;
+			driver->usb_buf_in_size[i] = USB_MAX_IN_BUF;
+		}
 
 		r = smd_open("DIAG", &driver->ch, driver, diag_smd_notify);
 	}
@@ -712,7 +854,10 @@ void diag_read_work_fn(struct work_struct *work)
 
 void diagfwd_init(void)
 {
+	int i;
+
 	diag_debug_buf_idx = 0;
+	spin_lock_init(&driver->in_lock);
 	if (driver->usb_buf_out  == NULL &&
 	     (driver->usb_buf_out = kzalloc(USB_MAX_OUT_BUF,
 					 GFP_KERNEL)) == NULL)
@@ -744,11 +889,13 @@ void diagfwd_init(void)
 				      sizeof(struct diag_master_table),
 				       GFP_KERNEL)) == NULL)
 		goto err;
-	if (driver->usb_write_ptr == NULL)
-			driver->usb_write_ptr = kzalloc(
+	for (i = 0; i < NUM_SMD_IN_BUFS; i++) {
+		if (driver->usb_write_ptr[i] == NULL)
+			driver->usb_write_ptr[i] = kzalloc(
 				sizeof(struct diag_request), GFP_KERNEL);
-			if (driver->usb_write_ptr == NULL)
-					goto err;
+		if (driver->usb_write_ptr[i] == NULL)
+			goto err;
+	}
 	if (driver->usb_write_ptr_qdsp == NULL)
 			driver->usb_write_ptr_qdsp = kzalloc(
 				sizeof(struct diag_request), GFP_KERNEL);
@@ -798,13 +945,16 @@ err:
 		kfree(driver->data_ready);
 		kfree(driver->table);
 		kfree(driver->pkt_buf);
-		kfree(driver->usb_write_ptr);
+		for (i = 0; i < NUM_SMD_IN_BUFS; i++)
+			kfree(driver->usb_write_ptr[i]);
 		kfree(driver->usb_write_ptr_qdsp);
 		kfree(driver->usb_read_ptr);
 }
 
 void diagfwd_exit(void)
 {
+	int i;
+
 	smd_close(driver->ch);
 	smd_close(driver->chqdsp);
 	driver->ch = 0;		/*SMD can make this NULL */
@@ -817,7 +967,8 @@ void diagfwd_exit(void)
 
 	diag_usb_unregister();
 
-	kfree(driver->usb_buf_in);
+	for (i = 0; i < NUM_SMD_IN_BUFS; i++)
+		kfree(driver->usb_buf_in[i]);
 	kfree(driver->usb_buf_in_qdsp);
 	kfree(driver->usb_buf_out);
 	kfree(driver->hdlc_buf);
@@ -828,7 +979,8 @@ void diagfwd_exit(void)
 	kfree(driver->data_ready);
 	kfree(driver->table);
 	kfree(driver->pkt_buf);
-	kfree(driver->usb_write_ptr);
+	for (i = 0; i < NUM_SMD_IN_BUFS; i++)
+		kfree(driver->usb_write_ptr[i]);
 	kfree(driver->usb_write_ptr_qdsp);
 	kfree(driver->usb_read_ptr);
 }
@@ -38,7 +38,8 @@
 #define PMEM_MAX_DEVICES \
 	(PMEM_MAX_USER_SPACE_DEVICES + PMEM_MAX_KERNEL_SPACE_DEVICES)
 
-#define PMEM_MAX_ORDER (128)
+/* orders a buddy block can have, bounded by the width of num_entries */
+#define PMEM_BUDDY_NR_ORDERS (BITS_PER_LONG)
 #define PMEM_MIN_ALLOC PAGE_SIZE
 
 #define PMEM_INITIAL_NUM_BITMAP_ALLOCATIONS (64)
@@ -100,6 +101,9 @@ struct pmem_data {
 struct pmem_bits {
 	unsigned allocated:1;		/* 1 if allocated, 0 if free */
 	unsigned order:7;		/* size of the region in pmem space */
+	/* on free_area[order] while this is the head of a free block,
+	 * empty otherwise */
+	struct list_head free_list;
 };
 
 struct pmem_region_node {
@@ -190,12 +194,22 @@ struct pmem_info {
 			 */
 
 			struct pmem_bits *buddy_bitmap;
+			/* free blocks of each order, so allocation and
+			 * merging never walk the bitmap */
+			struct list_head free_area[PMEM_BUDDY_NR_ORDERS];
+			unsigned int nr_free[PMEM_BUDDY_NR_ORDERS];
 		} buddy_bestfit;
 
 		struct {
 			unsigned int bitmap_free; /* # of zero bits/quanta */
 			uint32_t *bitmap;
 			int32_t bitmap_allocs;
+			/* the first bitmap_nallocs entries of bitm_alloc are
+			 * in use and kept sorted by bit, the rest are -1 */
+			int32_t bitmap_nallocs;
+			/* place allocations in the smallest free run that
+			 * fits instead of the first one */
+			unsigned best_fit;
 			struct {
 				short bit;
 				unsigned short quanta;
@@ -203,6 +217,9 @@ struct pmem_info {
 		} bitmap;
 	} allocator;
 
+	/* allocation requests the allocator could not satisfy */
+	unsigned long alloc_failures;
+
 	int id;
 	struct kobject kobj;
 
@@ -271,6 +288,20 @@ static struct kset *pmem_kset;
 	((data->flags & PMEM_FLAGS_SUBMAP) && \
 	(!(data->flags & PMEM_FLAGS_UNSUBMAP)))
 
+/* the allocation bitmap is an array of 32 bit words, which is the
+ * unsigned long layout the find_*_bit helpers expect on this platform */
+static inline int bitmap_next_free_bit(uint32_t *bitp, int total_bits,
+		int bit)
+{
+	return find_next_zero_bit((unsigned long *)bitp, total_bits, bit);
+}
+
+static inline int bitmap_next_used_bit(uint32_t *bitp, int total_bits,
+		int bit)
+{
+	return find_next_bit((unsigned long *)bitp, total_bits, bit);
+}
+
 static int pmem_release(struct inode *, struct file *);
 static int pmem_mmap(struct file *, struct vm_area_struct *);
 static int pmem_open(struct inode *, struct file *);
@@ -440,6 +471,64 @@ static ssize_t show_pmem_quantum_size(int id, char *buf)
 }
 RO_PMEM_ATTR(quantum_size);
 
+static ssize_t show_pmem_fragmentation(int id, char *buf)
+{
+	unsigned long free = 0, largest = 0, extents = 0;
+	ssize_t ret = 0;
+	int i;
+
+	mutex_lock(&pmem[id].arena_mutex);
+
+	if (pmem[id].allocator_type == PMEM_ALLOCATORTYPE_BUDDYBESTFIT) {
+		for (i = 0; i < PMEM_BUDDY_NR_ORDERS; i++) {
+			unsigned int n =
+				pmem[id].allocator.buddy_bestfit.nr_free[i];
+
+			if (!n)
+				continue;
+			free += (unsigned long)n << i;
+			extents += n;
+			largest = 1UL << i;
+		}
+	} else {
+		uint32_t *bitp = pmem[id].allocator.bitmap.bitmap;
+		int total = pmem[id].num_entries, start, end;
+
+		for (start = bitmap_next_free_bit(bitp, total, 0);
+				start < total;
+				start = bitmap_next_free_bit(bitp, total, end)) {
+			end = bitmap_next_used_bit(bitp, total, start);
+			free += end - start;
+			extents++;
+			largest = max(largest, (unsigned long)(end - start));
+		}
+	}
+
+	/* unusable index: share of the free space, in per mille, that
+	 * lies outside the largest free extent */
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+		"free quanta: %lu\nfree extents: %lu\n"
+		"largest free extent: %lu\nunusable index: %lu\n"
+		"allocation failures: %lu\n",
+		free, extents, largest,
+		free ? (free - largest) * 1000 / free : 0,
+		pmem[id].alloc_failures);
+
+	if (pmem[id].allocator_type == PMEM_ALLOCATORTYPE_BUDDYBESTFIT) {
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+			"order\tfree blocks\n");
+		for (i = 0; i < PMEM_BUDDY_NR_ORDERS; i++)
+			if (pmem[id].allocator.buddy_bestfit.nr_free[i])
+				ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+					"%d\t%u\n", i, pmem[id].allocator.
+					buddy_bestfit.nr_free[i]);
+	}
+
+	mutex_unlock(&pmem[id].arena_mutex);
+	return ret;
+}
+RO_PMEM_ATTR(fragmentation);
+
 static ssize_t show_pmem_buddy_bitmap_dump(int id, char *buf)
 {
 	int ret, i;
@@ -461,7 +550,8 @@ RO_PMEM_ATTR(buddy_bitmap_dump);
 
 #define PMEM_BITMAP_BUDDY_BESTFIT_COMMON_SYSFS_ATTRS \
 	&pmem_attr_quantum_size.attr, \
-	&pmem_attr_total_entries.attr
+	&pmem_attr_total_entries.attr, \
+	&pmem_attr_fragmentation.attr
 
 static struct attribute *pmem_buddy_bestfit_attrs[] = {
 	PMEM_COMMON_SYSFS_ATTRS,
@@ -514,6 +604,22 @@ static ssize_t show_pmem_bits_allocated(int id, char *buf)
 }
 RO_PMEM_ATTR(bits_allocated);
 
+static ssize_t show_pmem_best_fit(int id, char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+		pmem[id].allocator.bitmap.best_fit);
+}
+
+static ssize_t store_pmem_best_fit(int id, const char *buf,
+		const size_t count)
+{
+	mutex_lock(&pmem[id].arena_mutex);
+	pmem[id].allocator.bitmap.best_fit = !!simple_strtoul(buf, NULL, 0);
+	mutex_unlock(&pmem[id].arena_mutex);
+	return count;
+}
+RW_PMEM_ATTR(best_fit);
+
 static struct attribute *pmem_bitmap_attrs[] = {
 	PMEM_COMMON_SYSFS_ATTRS,
 
@@ -521,6 +627,7 @@ static struct attribute *pmem_bitmap_attrs[] = {
 
 	&pmem_attr_free_quanta.attr,
 	&pmem_attr_bits_allocated.attr,
+	&pmem_attr_best_fit.attr,
 
 	NULL
 };
@@ -590,25 +697,61 @@ static int pmem_free_all_or_nothing(int id, int index)
 	return 0;
 }
 
+static void pmem_buddy_add_free(int id, int index)
+{
+	struct pmem_bits *bits =
+		&pmem[id].allocator.buddy_bestfit.buddy_bitmap[index];
+
+	list_add(&bits->free_list,
+		&pmem[id].allocator.buddy_bestfit.free_area[bits->order]);
+	pmem[id].allocator.buddy_bestfit.nr_free[bits->order]++;
+}
+
+static void pmem_buddy_del_free(int id, int index)
+{
+	struct pmem_bits *bits =
+		&pmem[id].allocator.buddy_bestfit.buddy_bitmap[index];
+
+	list_del_init(&bits->free_list);
+	pmem[id].allocator.buddy_bestfit.nr_free[bits->order]--;
+}
+
+static inline int pmem_buddy_on_free_list(int id, int index)
+{
+	return !list_empty(
+		&pmem[id].allocator.buddy_bestfit.buddy_bitmap[index].free_list);
+}
+
 static int pmem_free_buddy_bestfit(int id, int index)
 {
 	/* caller should hold the lock on arena_mutex! */
 	int curr = index;
+	char currtask_name[FIELD_SIZEOF(struct task_struct, comm) + 1];
+
 	DLOG("index %d\n", index);
 
+	if (index < 0 || index >= pmem[id].num_entries ||
+	    PMEM_IS_FREE_BUDDY(id, index)) {
+		printk(KERN_ALERT "pmem: %s: Attempt to free unallocated "
+			"index %d, id %d, pid %d(%s)\n", __func__, index, id,
+			current->pid, get_task_comm(currtask_name, current));
+		return -1;
+	}
 
 	/* clean up the bitmap, merging any buddies */
 	pmem[id].allocator.buddy_bestfit.buddy_bitmap[curr].allocated = 0;
 	/* find a slots buddy Buddy# = Slot# ^ (1 << order)
-	 * if the buddy is also free merge them
+	 * if the buddy is the head of a free block of the same order, take
+	 * it off its free list and merge them
 	 * repeat until the buddy is not free or end of the bitmap is reached
 	 */
 	do {
 		int buddy = PMEM_BUDDY_INDEX(id, curr);
 		if (buddy < pmem[id].num_entries &&
-		    PMEM_IS_FREE_BUDDY(id, buddy) &&
+		    pmem_buddy_on_free_list(id, buddy) &&
 		    PMEM_BUDDY_ORDER(id, buddy) ==
 				PMEM_BUDDY_ORDER(id, curr)) {
+			pmem_buddy_del_free(id, buddy);
 			PMEM_BUDDY_ORDER(id, buddy)++;
 			PMEM_BUDDY_ORDER(id, curr)++;
 			curr = min(buddy, curr);
@@ -617,6 +760,7 @@ static int pmem_free_buddy_bestfit(int id, int index)
 		}
 	} while (curr < pmem[id].num_entries);
 
+	pmem_buddy_add_free(id, curr);
 	return 0;
 }
 
@@ -662,28 +806,49 @@ static void bitmap_bits_clear_all(uint32_t *bitp, int bit_start, int bit_end)
 	}
 }
 
+/* binary search the sorted bitm_alloc array for the first entry at or
+ * after bitnum */
+static int bitm_alloc_lookup(int id, int bitnum)
+{
+	int lo = 0, hi = pmem[id].allocator.bitmap.bitmap_nallocs;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (pmem[id].allocator.bitmap.bitm_alloc[mid].bit < bitnum)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 static int pmem_free_bitmap(int id, int bitnum)
 {
 	/* caller should hold the lock on arena_mutex! */
-	int i;
+	int i, n = pmem[id].allocator.bitmap.bitmap_nallocs;
 	char currtask_name[FIELD_SIZEOF(struct task_struct, comm) + 1];
 
 	DLOG("bitnum %d\n", bitnum);
 
-	for (i = 0; i < pmem[id].allocator.bitmap.bitmap_allocs; i++) {
-		const int curr_bit =
-			pmem[id].allocator.bitmap.bitm_alloc[i].bit;
-
-		if (curr_bit == bitnum) {
-			const int curr_quanta =
-				pmem[id].allocator.bitmap.bitm_alloc[i].quanta;
-
-			bitmap_bits_clear_all(pmem[id].allocator.bitmap.bitmap,
-				curr_bit, curr_bit + curr_quanta);
-			pmem[id].allocator.bitmap.bitmap_free += curr_quanta;
-			pmem[id].allocator.bitmap.bitm_alloc[i].bit = -1;
-			return 0;
-		}
+	i = bitm_alloc_lookup(id, bitnum);
+	if (i < n && pmem[id].allocator.bitmap.bitm_alloc[i].bit == bitnum) {
+		const int curr_quanta =
+			pmem[id].allocator.bitmap.bitm_alloc[i].quanta;
+
+		bitmap_bits_clear_all(pmem[id].allocator.bitmap.bitmap,
+			bitnum, bitnum + curr_quanta);
+		pmem[id].allocator.bitmap.bitmap_free += curr_quanta;
+
+		memmove(&pmem[id].allocator.bitmap.bitm_alloc[i],
+			&pmem[id].allocator.bitmap.bitm_alloc[i + 1],
+			(n - i - 1) *
+			sizeof(*pmem[id].allocator.bitmap.bitm_alloc));
+		n--;
+		pmem[id].allocator.bitmap.bitm_alloc[n].bit = -1;
+		pmem[id].allocator.bitmap.bitm_alloc[n].quanta = 0;
+		pmem[id].allocator.bitmap.bitmap_nallocs = n;
+		return 0;
 	}
 	printk(KERN_ALERT "pmem: %s: Attempt to free unallocated index %d, id"
 		" %d, pid %d(%s)\n", __func__, bitnum, id,  current->pid,
@@ -837,41 +1002,27 @@ static int pmem_allocator_buddy_bestfit(const int id,
 		unsigned int align)
 {
 	/* caller should hold the lock on arena_mutex! */
-	int curr;
+	struct pmem_bits *bits;
 	int best_fit = -1;
-	unsigned long order;
+	unsigned long order, curr;
 
 	DLOG("buddy bestfit\n");
 	order = pmem_order(len, id);
-	if (order > PMEM_MAX_ORDER)
+	if (order >= PMEM_BUDDY_NR_ORDERS)
 		goto out;
 
 	DLOG("order %lx\n", order);
 
-	/* Look through the bitmap.
-	 * 	If a free slot of the correct order is found, use it.
-	 * 	Otherwise, use the best fit (smallest with size > order) slot.
+	/* The best fit is the first block on the lowest order free list
+	 * at or above the requested order.
 	 */
-	for (curr = 0;
-	     curr < pmem[id].num_entries;
-	     curr = PMEM_BUDDY_NEXT_INDEX(id, curr))
-		if (PMEM_IS_FREE_BUDDY(id, curr)) {
-			if (PMEM_BUDDY_ORDER(id, curr) ==
-					(unsigned char)order) {
-				/* set the not free bit and clear others */
-				best_fit = curr;
-				break;
-			}
-			if (PMEM_BUDDY_ORDER(id, curr) >
-					(unsigned char)order &&
-			    (best_fit < 0 ||
-			     PMEM_BUDDY_ORDER(id, curr) <
-					PMEM_BUDDY_ORDER(id, best_fit)))
-				best_fit = curr;
-		}
+	for (curr = order; curr < PMEM_BUDDY_NR_ORDERS; curr++)
+		if (!list_empty(
+			&pmem[id].allocator.buddy_bestfit.free_area[curr]))
+			break;
 
-	/* if best_fit < 0, there are no suitable slots; return an error */
-	if (best_fit < 0) {
+	/* if there is no such list, there are no suitable slots */
+	if (curr >= PMEM_BUDDY_NR_ORDERS) {
 #if PMEM_DEBUG
 		printk(KERN_ALERT "pmem: %s: no space left to allocate!\n",
 			__func__);
@@ -879,8 +1030,15 @@ static int pmem_allocator_buddy_bestfit(const int id,
 		goto out;
 	}
 
+	bits = list_first_entry(
+		&pmem[id].allocator.buddy_bestfit.free_area[curr],
+		struct pmem_bits, free_list);
+	best_fit = bits - pmem[id].allocator.buddy_bestfit.buddy_bitmap;
+	pmem_buddy_del_free(id, best_fit);
+
 	/* now partition the best fit:
-	 * 	split the slot into 2 buddies of order - 1
+	 * 	split the slot into 2 buddies of order - 1, the upper one
+	 * 	going back on the free list
 	 * 	repeat until the slot is of the correct order
 	 */
 	while (PMEM_BUDDY_ORDER(id, best_fit) > (unsigned char)order) {
@@ -888,9 +1046,14 @@ static int pmem_allocator_buddy_bestfit(const int id,
 		PMEM_BUDDY_ORDER(id, best_fit) -= 1;
 		buddy = PMEM_BUDDY_INDEX(id, best_fit);
 		PMEM_BUDDY_ORDER(id, buddy) = PMEM_BUDDY_ORDER(id, best_fit);
+		pmem[id].allocator.buddy_bestfit.buddy_bitmap[buddy].allocated =
+			0;
+		pmem_buddy_add_free(id, buddy);
 	}
 	pmem[id].allocator.buddy_bestfit.buddy_bitmap[best_fit].allocated = 1;
 out:
+	if (best_fit < 0)
+		pmem[id].alloc_failures++;
 	return best_fit;
 }
 
@@ -931,61 +1094,39 @@ static void bitmap_bits_set_all(uint32_t *bitp, int bit_start, int bit_end)
 	}
 }
 
+/* Walk the runs of free bits a word at a time. With best_fit set the
+ * smallest run that can hold the aligned request is used, so large runs
+ * stay intact for the large camera and video buffers; otherwise the
+ * first run that fits is taken. */
 static int
 bitmap_allocate_contiguous(uint32_t *bitp, int num_bits_to_alloc,
-		int total_bits, int spacing)
+		int total_bits, int spacing, int best_fit)
 {
-	int bit_start, last_bit, word_index;
+	int bit_start, bit_end, best = -1, best_len = 0;
 
 	if (num_bits_to_alloc <= 0)
 		return -1;
 
-	for (bit_start = 0; ;
-		bit_start = (last_bit +
-			(word_index << PMEM_32BIT_WORD_ORDER) + spacing - 1)
-			& ~(spacing - 1)) {
-		int bit_end = bit_start + num_bits_to_alloc, total_words;
+	for (bit_start = bitmap_next_free_bit(bitp, total_bits, 0);
+		bit_start < total_bits;
+		bit_start = bitmap_next_free_bit(bitp, total_bits, bit_end)) {
+		int aligned = ALIGN(bit_start, spacing);
 
-		if (bit_end > total_bits)
-			return -1; /* out of contiguous memory */
-
-		word_index = bit_start >> PMEM_32BIT_WORD_ORDER;
-		total_words = compute_total_words(bit_end, word_index);
-
-		if (total_words <= 0)
-			return -1;
-
-		if (total_words == 1) {
-			last_bit = fls(bitp[word_index] &
-					(start_mask(bit_start) &
-						end_mask(bit_end)));
-			if (last_bit)
-				continue;
-		} else {
-			int end_word = word_index + (total_words - 1);
-			last_bit =
-				fls(bitp[word_index] & start_mask(bit_start));
-			if (last_bit)
-				continue;
-
-			for (word_index++;
-					word_index < end_word;
-					word_index++) {
-				last_bit = fls(bitp[word_index]);
-				if (last_bit)
-					break;
-			}
-			if (last_bit)
-				continue;
+		bit_end = bitmap_next_used_bit(bitp, total_bits, bit_start);
+		if (aligned + num_bits_to_alloc > bit_end)
+			continue;
 
-			last_bit = fls(bitp[word_index] & end_mask(bit_end));
-			if (last_bit)
-				continue;
+		if (best < 0 || bit_end - bit_start < best_len) {
+			best = aligned;
+			best_len = bit_end - bit_start;
 		}
-		bitmap_bits_set_all(bitp, bit_start, bit_end);
-		return bit_start;
+		if (!best_fit || best_len == num_bits_to_alloc)
+			break;
 	}
-	return -1;
+
+	if (best >= 0)
+		bitmap_bits_set_all(bitp, best, best + num_bits_to_alloc);
+	return best;
 }
 
 static int reserve_quanta(const unsigned int quanta_needed,
@@ -1021,7 +1162,7 @@ static int reserve_quanta(const unsigned int quanta_needed,
 	ret = bitmap_allocate_contiguous(pmem[id].allocator.bitmap.bitmap,
 		quanta_needed,
 		(pmem[id].size + pmem[id].quantum - 1) / pmem[id].quantum,
-		spacing);
+		spacing, pmem[id].allocator.bitmap.best_fit);
 
 #if PMEM_DEBUG
 	if (ret < 0)
@@ -1039,7 +1180,7 @@ static int pmem_allocator_bitmap(const int id,
 		const unsigned int align)
 {
 	/* caller should hold the lock on arena_mutex! */
-	int bitnum, i;
+	int bitnum = -1, i, n;
 	unsigned int quanta_needed;
 
 	DLOG("bitmap id %d, len %ld, align %u\n", id, len, align);
@@ -1048,7 +1189,7 @@ static int pmem_allocator_bitmap(const int id,
 		printk(KERN_ALERT "pmem: bitm_alloc not present! id: %d\n",
 			id);
 #endif
-		return -1;
+		goto leave;
 	}
 
 	quanta_needed = (len + pmem[id].quantum - 1) / pmem[id].quantum;
@@ -1062,20 +1203,13 @@ static int pmem_allocator_bitmap(const int id,
 			"PMEM memory region exhausted, id %d."
 			" Unable to comply with allocation request.\n", id);
 #endif
-		return -1;
-	}
-
-	bitnum = reserve_quanta(quanta_needed, id, align);
-	if (bitnum == -1)
 		goto leave;
+	}
 
-	for (i = 0;
-		i < pmem[id].allocator.bitmap.bitmap_allocs &&
-			pmem[id].allocator.bitmap.bitm_alloc[i].bit != -1;
-		i++)
-		;
-
-	if (i >= pmem[id].allocator.bitmap.bitmap_allocs) {
+	/* make room for the new entry before touching the bitmap so a
+	 * failed realloc can't leak the reserved quanta */
+	n = pmem[id].allocator.bitmap.bitmap_nallocs;
+	if (n >= pmem[id].allocator.bitmap.bitmap_allocs) {
 		void *temp;
 		int32_t new_bitmap_allocs =
 			pmem[id].allocator.bitmap.bitmap_allocs << 1;
@@ -1087,7 +1221,7 @@ static int pmem_allocator_bitmap(const int id,
 				" wrapped around to zero! Something "
 				"is VERY wrong.\n");
 #endif
-			return -1;
+			goto leave;
 		}
 
 		if (new_bitmap_allocs > pmem[id].num_entries) {
@@ -1097,7 +1231,7 @@ static int pmem_allocator_bitmap(const int id,
 				" number exceeds maximum entries possible"
 				" for current quanta\n");
 #endif
-			return -1;
+			goto leave;
 		}
 
 		temp = krealloc(pmem[id].allocator.bitmap.bitm_alloc,
@@ -1110,26 +1244,39 @@ static int pmem_allocator_bitmap(const int id,
 				"id %d, current num bitmap allocs %d\n",
 				id, pmem[id].allocator.bitmap.bitmap_allocs);
 #endif
-			return -1;
+			goto leave;
 		}
 		pmem[id].allocator.bitmap.bitmap_allocs = new_bitmap_allocs;
 		pmem[id].allocator.bitmap.bitm_alloc = temp;
 
-		for (j = i; j < new_bitmap_allocs; j++) {
+		for (j = n; j < new_bitmap_allocs; j++) {
 			pmem[id].allocator.bitmap.bitm_alloc[j].bit = -1;
-			pmem[id].allocator.bitmap.bitm_alloc[i].quanta = 0;
+			pmem[id].allocator.bitmap.bitm_alloc[j].quanta = 0;
 		}
 
 		DLOG("increased # of allocated regions to %d for id %d\n",
 			pmem[id].allocator.bitmap.bitmap_allocs, id);
 	}
 
+	bitnum = reserve_quanta(quanta_needed, id, align);
+	if (bitnum == -1)
+		goto leave;
+
+	/* keep bitm_alloc sorted so frees and length lookups can bisect */
+	i = bitm_alloc_lookup(id, bitnum);
+	memmove(&pmem[id].allocator.bitmap.bitm_alloc[i + 1],
+		&pmem[id].allocator.bitmap.bitm_alloc[i],
+		(n - i) * sizeof(*pmem[id].allocator.bitmap.bitm_alloc));
+
 	DLOG("bitnum %d, bitm_alloc index %d\n", bitnum, i);
 
 	pmem[id].allocator.bitmap.bitmap_free -= quanta_needed;
 	pmem[id].allocator.bitmap.bitm_alloc[i].bit = bitnum;
 	pmem[id].allocator.bitmap.bitm_alloc[i].quanta = quanta_needed;
+	pmem[id].allocator.bitmap.bitmap_nallocs = n + 1;
 leave:
+	if (bitnum < 0)
+		pmem[id].alloc_failures++;
 	return bitnum;
 }
 
@@ -1187,17 +1334,15 @@ static unsigned long pmem_len_bitmap(int id, struct pmem_data *data)
 
 	mutex_lock(&pmem[id].arena_mutex);
 
-	for (i = 0; i < pmem[id].allocator.bitmap.bitmap_allocs; i++)
-		if (pmem[id].allocator.bitmap.bitm_alloc[i].bit ==
-				data->index) {
-			ret = pmem[id].allocator.bitmap.bitm_alloc[i].quanta *
-				pmem[id].quantum;
-			break;
-		}
+	i = bitm_alloc_lookup(id, data->index);
+	if (i < pmem[id].allocator.bitmap.bitmap_nallocs &&
+	    pmem[id].allocator.bitmap.bitm_alloc[i].bit == data->index)
+		ret = pmem[id].allocator.bitmap.bitm_alloc[i].quanta *
+			pmem[id].quantum;
 
 	mutex_unlock(&pmem[id].arena_mutex);
 #if PMEM_DEBUG
-	if (i >= pmem[id].allocator.bitmap.bitmap_allocs)
+	if (!ret)
 		printk(KERN_ALERT "pmem: %s: can't find bitnum %d in "
 			"alloc'd array!\n", __func__, data->index);
 #endif
@@ -1841,9 +1986,15 @@ int pmem_kfree(const int32_t physaddr)
 			return -EINVAL;
 		}
 
+		mutex_lock(&pmem[id].arena_mutex);
 		index = pmem[id].kapi_free_index(physaddr, id);
-		if (index >= 0)
-			return pmem[id].free(id, index) ?  -EINVAL : 0;
+		if (index >= 0) {
+			int ret = pmem[id].free(id, index);
+
+			mutex_unlock(&pmem[id].arena_mutex);
+			return ret ? -EINVAL : 0;
+		}
+		mutex_unlock(&pmem[id].arena_mutex);
 	}
 #if PMEM_DEBUG
 	printk(KERN_ALERT "pmem: %s: Failed to free physaddr %#x, does not "
@@ -2673,10 +2824,19 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 
 		memset(pmem[id].allocator.buddy_bestfit.buddy_bitmap, 0,
 			sizeof(struct pmem_bits) * pmem[id].num_entries);
+		for (i = 0; i < pmem[id].num_entries; i++)
+			INIT_LIST_HEAD(&pmem[id].allocator.buddy_bestfit.
+				buddy_bitmap[i].free_list);
+		for (i = 0; i < PMEM_BUDDY_NR_ORDERS; i++) {
+			INIT_LIST_HEAD(
+				&pmem[id].allocator.buddy_bestfit.free_area[i]);
+			pmem[id].allocator.buddy_bestfit.nr_free[i] = 0;
+		}
 
 		for (i = sizeof(pmem[id].num_entries) * 8 - 1; i >= 0; i--)
 			if ((pmem[id].num_entries) &  1<<i) {
 				PMEM_BUDDY_ORDER(id, index) = i;
+				pmem_buddy_add_free(id, index);
 				index = PMEM_BUDDY_NEXT_INDEX(id, index);
 			}
 		pmem[id].allocate = pmem_allocator_buddy_bestfit;
@@ -2716,6 +2876,8 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 
 		pmem[id].allocator.bitmap.bitmap_allocs =
 			PMEM_INITIAL_NUM_BITMAP_ALLOCATIONS;
+		pmem[id].allocator.bitmap.bitmap_nallocs = 0;
+		pmem[id].allocator.bitmap.best_fit = 1;
 
 		pmem[id].allocator.bitmap.bitmap =
 			kcalloc((pmem[id].num_entries + 31) / 32,
@@ -304,6 +304,9 @@ static void smd_net_data_handler(unsigned long arg)
 		if (smd_read(p->ch, ptr, sz) != sz)
 			pr_err("rmnet_recv() smd lied about avail?!");
 	}
+
+	/* one interrupt to the modem for all the packets drained above */
+	smd_read_notify(p->ch);
 }
 
 static DECLARE_TASKLET(smd_net_data_tasklet, smd_net_data_handler, 0);
@@ -386,6 +389,8 @@ static int rmnet_open(struct net_device *dev)
 
 		if (r < 0)
 			return -ENODEV;
+
+		smd_set_batch_notify(p->ch, 1);
 	}
 
 	netif_start_queue(dev);
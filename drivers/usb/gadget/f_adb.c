@@ -37,10 +37,35 @@
 #include "f_adb.h"
 
 #define BULK_BUFFER_SIZE           4096
+#define BULK_BUFFER_SIZE_MAX       65536
 
 /* number of rx and tx requests to allocate */
 #define RX_REQ_MAX 4
-#define TX_REQ_MAX 4
+#define TX_REQ_MAX 8
+#define REQ_MAX_LIMIT 32
+
+/*
+ * Request sizes and queue depths, applied on the next bind.  Large IN
+ * requests cut the per-transfer overhead of big pulls and a deep TX queue
+ * keeps the IN endpoint busy while adbd refills it.  If the buffers cannot
+ * be allocated at the requested size, smaller sizes are tried down to
+ * BULK_BUFFER_SIZE.
+ *
+ * OUT requests stay at BULK_BUFFER_SIZE: the adb host sends 4096 byte
+ * payloads without a zero length packet, so a larger OUT request would
+ * not complete until more data arrived.
+ */
+static unsigned int adb_tx_req_size = 16384;
+module_param(adb_tx_req_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_tx_req_size, "adb IN request size in bytes");
+
+static unsigned int adb_rx_reqs = RX_REQ_MAX;
+module_param(adb_rx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_rx_reqs, "number of adb OUT requests");
+
+static unsigned int adb_tx_reqs = TX_REQ_MAX;
+module_param(adb_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_tx_reqs, "number of adb IN requests");
 
 static const char shortname[] = "android_adb";
 
@@ -70,6 +95,9 @@ struct adb_dev {
 	struct usb_request *read_req;
 	unsigned char *read_buf;
 	unsigned read_count;
+
+	/* buffer size of the allocated IN requests */
+	unsigned tx_req_size;
 };
 
 static struct usb_interface_descriptor adb_interface_desc = {
@@ -233,14 +261,59 @@ static void adb_complete_out(struct usb_ep *ep, struct usb_request *req)
 	wake_up(&dev->read_wq);
 }
 
+static unsigned adb_clamp_req_size(unsigned size)
+{
+	if (size < BULK_BUFFER_SIZE)
+		return BULK_BUFFER_SIZE;
+	if (size > BULK_BUFFER_SIZE_MAX)
+		return BULK_BUFFER_SIZE_MAX;
+	return size & ~511;
+}
+
+static unsigned adb_clamp_reqs(unsigned count)
+{
+	return clamp_t(unsigned, count, 1, REQ_MAX_LIMIT);
+}
+
+/*
+ * Allocate count requests of *size bytes onto head, halving the size
+ * when high-order buffers are not available.
+ */
+static int adb_alloc_requests(struct adb_dev *dev, struct usb_ep *ep,
+			      struct list_head *head, unsigned count,
+			      unsigned *size,
+			      void (*complete)(struct usb_ep *,
+					       struct usb_request *))
+{
+	struct usb_request *req;
+	unsigned i, sz;
+
+	for (sz = *size; sz >= BULK_BUFFER_SIZE; sz >>= 1) {
+		for (i = 0; i < count; i++) {
+			req = adb_request_new(ep, sz);
+			if (!req)
+				break;
+			req->complete = complete;
+			req_put(dev, head, req);
+		}
+		if (i == count) {
+			*size = sz;
+			return 0;
+		}
+		while ((req = req_get(dev, head)))
+			adb_request_free(req, ep);
+	}
+
+	return -ENOMEM;
+}
+
 static int create_bulk_endpoints(struct adb_dev *dev,
 				struct usb_endpoint_descriptor *in_desc,
 				struct usb_endpoint_descriptor *out_desc)
 {
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *req;
 	struct usb_ep *ep;
-	int i;
+	unsigned rx_req_size;
 
 	DBG(cdev, "create_bulk_endpoints dev: %p\n", dev);
 
@@ -261,21 +334,21 @@ static int create_bulk_endpoints(struct adb_dev *dev,
 	dev->ep_out = ep;
 
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = adb_request_new(dev->ep_out, BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
-		req->complete = adb_complete_out;
-		req_put(dev, &dev->rx_idle, req);
-	}
-
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = adb_request_new(dev->ep_in, BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
-		req->complete = adb_complete_in;
-		req_put(dev, &dev->tx_idle, req);
-	}
+	rx_req_size = BULK_BUFFER_SIZE;
+	if (adb_alloc_requests(dev, dev->ep_out, &dev->rx_idle,
+			       adb_clamp_reqs(adb_rx_reqs),
+			       &rx_req_size, adb_complete_out))
+		goto fail;
+
+	dev->tx_req_size = adb_clamp_req_size(adb_tx_req_size);
+	if (adb_alloc_requests(dev, dev->ep_in, &dev->tx_idle,
+			       adb_clamp_reqs(adb_tx_reqs),
+			       &dev->tx_req_size, adb_complete_in))
+		goto fail;
+
+	DBG(cdev, "adb requests: rx %u x %u, tx %u x %u\n",
+	    adb_clamp_reqs(adb_rx_reqs), rx_req_size,
+	    adb_clamp_reqs(adb_tx_reqs), dev->tx_req_size);
 
 	return 0;
 
@@ -424,8 +497,8 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 		}
 
 		if (req != 0) {
-			if (count > BULK_BUFFER_SIZE)
-				xfer = BULK_BUFFER_SIZE;
+			if (count > dev->tx_req_size)
+				xfer = dev->tx_req_size;
 			else
 				xfer = count;
 			if (copy_from_user(req->buf, buf, xfer)) {
@@ -59,6 +59,7 @@
 #include <linux/kref.h>
 #include <linux/kthread.h>
 #include <linux/limits.h>
+#include <linux/pagemap.h>
 #include <linux/rwsem.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
@@ -84,6 +85,31 @@
 #define NB_BOOT_WORKAROUND 1
 
 #define BULK_BUFFER_SIZE           16384
+#define BULK_BUFFER_SIZE_MAX       65536
+
+/*
+ * Data pipeline tuning, applied when the function is added:
+ * ums_num_buffers buffers of ums_buf_size bytes are cycled between the
+ * backing file and USB.  Sequential READs start page cache readahead of
+ * ums_readahead_kb beyond the current command; WRITEs start background
+ * writeback every ums_write_behind_kb so SYNCHRONIZE CACHE and eject
+ * do not have to push out everything at once.  0 disables either.
+ */
+static unsigned int ums_num_buffers = 4;
+module_param(ums_num_buffers, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ums_num_buffers, "number of mass storage data buffers");
+
+static unsigned int ums_buf_size = BULK_BUFFER_SIZE;
+module_param(ums_buf_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ums_buf_size, "mass storage data buffer size in bytes");
+
+static unsigned int ums_readahead_kb = 512;
+module_param(ums_readahead_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ums_readahead_kb, "readahead window for sequential READs");
+
+static unsigned int ums_write_behind_kb = 2048;
+module_param(ums_write_behind_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ums_write_behind_kb, "start writeback after this much data");
 
 /*-------------------------------------------------------------------------*/
 
@@ -245,6 +271,10 @@ struct lun {
 	u32		sense_data_info;
 	u32		unit_attention_data;
 
+	u32		ra_next_lba;	/* LBA following the last READ */
+#define FSG_RA_NONE	0xffffffff	/* no READ yet on this medium */
+	unsigned int	dirty_bytes;	/* written since the last writeback */
+
 	struct device	dev;
 };
 
@@ -260,12 +290,13 @@ static struct lun *dev_to_lun(struct device *dev)
 #define EP0_BUFSIZE	256
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
-/* Number of buffers for CBW, DATA and CSW */
+/* Minimum number of buffers for CBW, DATA and CSW */
 #ifdef CONFIG_USB_CSW_HACK
 #define NUM_BUFFERS	4
 #else
 #define NUM_BUFFERS	2
 #endif
+#define MAX_BUFFERS	16
 
 enum fsg_buffer_state {
 	BUF_STATE_EMPTY = 0,
@@ -347,7 +378,8 @@ struct fsg_dev {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[NUM_BUFFERS];
+	struct fsg_buffhd	buffhds[MAX_BUFFERS];
+	unsigned int		num_buffers;
 
 	int			thread_wakeup_needed;
 	struct completion	thread_notifier;
@@ -785,6 +817,28 @@ static int sleep_thread(struct fsg_dev *fsg)
 
 /*-------------------------------------------------------------------------*/
 
+/* When a READ continues where the previous one ended, get the page
+ * cache working on the data beyond it while this command goes out. */
+static void fsg_readahead(struct lun *curlun, u32 lba, u32 length)
+{
+	struct file	*filp = curlun->filp;
+	u32		next = lba + (length >> 9);
+	pgoff_t		index, last;
+	unsigned long	nr;
+
+	if (ums_readahead_kb && lba == curlun->ra_next_lba) {
+		index = ((loff_t) next << 9) >> PAGE_CACHE_SHIFT;
+		last = (curlun->file_length - 1) >> PAGE_CACHE_SHIFT;
+		if (index <= last) {
+			nr = ums_readahead_kb >> (PAGE_CACHE_SHIFT - 10);
+			nr = min_t(unsigned long, nr, last - index + 1);
+			page_cache_sync_readahead(filp->f_mapping,
+					&filp->f_ra, filp, index, nr);
+		}
+	}
+	curlun->ra_next_lba = next;
+}
+
 static int do_read(struct fsg_dev *fsg)
 {
 	struct lun		*curlun = fsg->curlun;
@@ -823,6 +877,8 @@ static int do_read(struct fsg_dev *fsg)
 	if (unlikely(amount_left == 0))
 		return -EIO;		/* No default reply */
 
+	fsg_readahead(curlun, lba, amount_left);
+
 	for (;;) {
 
 		/* Figure out how much we need to read:
@@ -1080,6 +1136,14 @@ static int do_write(struct fsg_dev *fsg)
 			amount_left_to_write -= nwritten;
 			fsg->residue -= nwritten;
 
+			/* Write-behind: start writeback in the background */
+			curlun->dirty_bytes += nwritten;
+			if (ums_write_behind_kb &&
+			    curlun->dirty_bytes >= (ums_write_behind_kb << 10)) {
+				filemap_flush(curlun->filp->f_mapping);
+				curlun->dirty_bytes = 0;
+			}
+
 			/* If an error occurred, report it and its position */
 			if (nwritten < amount) {
 #ifdef CONFIG_USB_CSW_HACK
@@ -1113,12 +1177,13 @@ static int do_write(struct fsg_dev *fsg)
 				 * yet from the host. So there is no point in
 				 * csw right away without the complete data.
 				 */
-				for (i = 0; i < NUM_BUFFERS; i++) {
+				for (i = 0; i < fsg->num_buffers; i++) {
 					if (fsg->buffhds[i].state ==
 							BUF_STATE_BUSY)
 						break;
 				}
-				if (!amount_left_to_req && i == NUM_BUFFERS) {
+				if (!amount_left_to_req &&
+				    i == fsg->num_buffers) {
 					csw_hack_sent = 1;
 					send_status(fsg);
 				}
@@ -1158,6 +1223,8 @@ static int fsync_sub(struct lun *curlun)
 	if (!filp->f_op->fsync)
 		return -EINVAL;
 
+	curlun->dirty_bytes = 0;
+
 	inode = filp->f_path.dentry->d_inode;
 	mutex_lock(&inode->i_mutex);
 	rc = filemap_fdatawrite(inode->i_mapping);
@@ -1698,7 +1765,7 @@ static int finish_reply(struct fsg_dev *fsg)
 		} else {
 			if (can_stall) {
 				bh->state = BUF_STATE_EMPTY;
-				for (i = 0; i < NUM_BUFFERS; ++i) {
+				for (i = 0; i < fsg->num_buffers; ++i) {
 					struct fsg_buffhd
 							*bh = &fsg->buffhds[i];
 					while (bh->state != BUF_STATE_EMPTY) {
@@ -2305,7 +2372,7 @@ static int do_set_interface(struct fsg_dev *fsg, int altsetting)
 
 reset:
 	/* Deallocate the requests */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd *bh = &fsg->buffhds[i];
 
 		if (bh->inreq) {
@@ -2349,7 +2416,7 @@ reset:
 	fsg->bulk_out_maxpacket = le16_to_cpu(d->wMaxPacketSize);
 
 	/* Allocate the requests */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &fsg->buffhds[i];
 
 		rc = alloc_request(fsg, fsg->bulk_in, &bh->inreq);
@@ -2461,7 +2528,7 @@ static void handle_exception(struct fsg_dev *fsg)
 	 * state, and the exception.  Then invoke the handler. */
 	spin_lock_irq(&fsg->lock);
 
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		bh = &fsg->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2675,6 +2742,7 @@ static int open_backing_file(struct fsg_dev *fsg, struct lun *curlun,
 	curlun->filp = filp;
 	curlun->file_length = size;
 	curlun->num_sectors = num_sectors;
+	curlun->ra_next_lba = FSG_RA_NONE;
 	LDBG(curlun, "open backing file: %s size: %lld num_sectors: %lld\n",
 			filename, size, num_sectors);
 	rc = 0;
@@ -2706,6 +2774,7 @@ static void close_backing_file(struct fsg_dev *fsg, struct lun *curlun)
 		LDBG(curlun, "close backing file\n");
 		fput(curlun->filp);
 		curlun->filp = NULL;
+		curlun->ra_next_lba = FSG_RA_NONE;
 		adjust_wake_lock(fsg);
 	}
 }
@@ -2863,7 +2932,7 @@ fsg_function_unbind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	/* Free the data buffers */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		kfree(fsg->buffhds[i].buf);
 		fsg->buffhds[i].buf = NULL;
 	}
@@ -2961,7 +3030,7 @@ fsg_function_bind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	/* Allocate the data buffers */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &fsg->buffhds[i];
 
 		/* Allocate for the bulk-in endpoint.  We assume that
@@ -2972,7 +3041,7 @@ fsg_function_bind(struct usb_configuration *c, struct usb_function *f)
 			goto out;
 		bh->next = bh + 1;
 	}
-	fsg->buffhds[NUM_BUFFERS - 1].next = &fsg->buffhds[0];
+	fsg->buffhds[fsg->num_buffers - 1].next = &fsg->buffhds[0];
 
 	fsg->thread_task = kthread_create(fsg_main_thread, fsg,
 			shortname);
@@ -3062,7 +3131,11 @@ int mass_storage_function_add(struct usb_composite_dev *cdev,
 	kref_init(&fsg->ref);
 	init_completion(&fsg->thread_notifier);
 
-	the_fsg->buf_size = BULK_BUFFER_SIZE;
+	the_fsg->num_buffers = clamp_t(unsigned int, ums_num_buffers,
+				       NUM_BUFFERS, MAX_BUFFERS);
+	the_fsg->buf_size = clamp_t(unsigned int, ums_buf_size,
+				    PAGE_CACHE_SIZE, BULK_BUFFER_SIZE_MAX)
+			    & ~511;
 	the_fsg->sdev.name = DRIVER_NAME;
 	the_fsg->sdev.print_name = print_switch_name;
 	the_fsg->sdev.print_state = print_switch_state;
@@ -404,6 +404,8 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 	if (status < 0)
 		ERROR(cdev, "RNDIS command error %d, %d/%d\n",
 			status, req->actual, req->length);
+	rndis->port.dl_max_xfer_size =
+		rndis_get_dl_max_xfer_size(rndis->config);
 //	spin_unlock(&dev->lock);
 }
 
@@ -559,6 +561,7 @@ static void rndis_disable(struct usb_function *f)
 	DBG(cdev, "rndis deactivated\n");
 
 	rndis_uninit(rndis->config);
+	rndis->port.dl_max_xfer_size = 0;
 	gether_disconnect(&rndis->port);
 
 	usb_ep_disable(rndis->notify);
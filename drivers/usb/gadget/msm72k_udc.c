@@ -79,6 +79,19 @@ static int vbus;
 /*To release the wakelock from debugfs*/
 static int release_wlocks;
 
+/* link requests queued behind a live transfer straight into the hardware
+ * dTD chain, instead of holding them back until the completion interrupt
+ */
+static int chain_xfers = 1;
+module_param(chain_xfers, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(chain_xfers, "append to live dTD chains (0 = reprime)");
+
+/* dTDs preallocated for each endpoint, in one coherent block;
+ * requests beyond that fall back to the dma_pool
+ */
+#define DTD_PER_EPT	16
+#define DTD_POOL_SIZE	(32 * DTD_PER_EPT * sizeof(struct ept_queue_item))
+
 struct msm_request {
 	struct usb_request req;
 
@@ -90,6 +103,8 @@ struct msm_request {
 	struct usb_info *ui;
 	struct msm_request *next;
 	struct msm_request *prev;
+	/* on the list of requests reaped in one handle_endpoint() pass */
+	struct list_head done;
 
 	unsigned busy:1;
 	unsigned live:1;
@@ -124,6 +139,14 @@ struct msm_endpoint {
 	/* pointers to DMA transfer list area */
 	/* these are allocated from the usb_info dma space */
 	struct ept_queue_head *head;
+
+	/* free slots of this endpoint's share of usb_info->dtd */
+	unsigned long dtd_free;
+
+	/* statistics, shown in debugfs status */
+	unsigned long primes;
+	unsigned long chained;
+	unsigned max_reaped;
 };
 
 static void usb_do_work(struct work_struct *w);
@@ -169,6 +192,10 @@ struct usb_info {
 
 	struct ept_queue_head *head;
 
+	/* preallocated dTDs, DTD_PER_EPT for each endpoint */
+	struct ept_queue_item *dtd;
+	dma_addr_t dtd_dma;
+
 	/* used for allocation */
 	unsigned next_item;
 	unsigned next_ifc_num;
@@ -404,6 +431,7 @@ static void init_endpoints(struct usb_info *ui)
 		ept->num = n & 15;
 		ept->ep.name = ep_name[n];
 		ept->ep.ops = &msm72k_ep_ops;
+		ept->dtd_free = (1UL << DTD_PER_EPT) - 1;
 
 		if (ept->bit > 15) {
 			/* IN endpoint */
@@ -446,6 +474,40 @@ static void configure_endpoints(struct usb_info *ui)
 		config_ept(ui->ept + n);
 }
 
+static struct ept_queue_item *dtd_alloc(struct msm_endpoint *ept,
+			dma_addr_t *dma, gfp_t gfp_flags)
+{
+	struct usb_info *ui = ept->ui;
+	unsigned n;
+
+	do {
+		n = find_first_bit(&ept->dtd_free, DTD_PER_EPT);
+		if (n >= DTD_PER_EPT)
+			return dma_pool_alloc(ui->pool, gfp_flags, dma);
+	} while (!test_and_clear_bit(n, &ept->dtd_free));
+
+	n += ept->bit * DTD_PER_EPT;
+	*dma = ui->dtd_dma + n * sizeof(struct ept_queue_item);
+	return ui->dtd + n;
+}
+
+static void dtd_free(struct usb_info *ui, struct ept_queue_item *item,
+			dma_addr_t dma)
+{
+	unsigned n;
+
+	if (item < ui->dtd || item >= ui->dtd + 32 * DTD_PER_EPT) {
+		dma_pool_free(ui->pool, item, dma);
+		return;
+	}
+
+	/* back to the endpoint it was carved for, which may differ
+	 * from the one it was last queued on (ep0in/ep0out)
+	 */
+	n = item - ui->dtd;
+	set_bit(n % DTD_PER_EPT, &ui->ept[n / DTD_PER_EPT].dtd_free);
+}
+
 struct usb_request *usb_ept_alloc_req(struct msm_endpoint *ept,
 			unsigned bufsize, gfp_t gfp_flags)
 {
@@ -455,10 +517,13 @@ struct usb_request *usb_ept_alloc_req(struct msm_endpoint *ept,
 	req = kzalloc(sizeof(*req), gfp_flags);
 	if (!req)
 		goto fail1;
+	INIT_LIST_HEAD(&req->done);
 
-	req->item = dma_pool_alloc(ui->pool, gfp_flags, &req->item_dma);
+	req->item = dtd_alloc(ept, &req->item_dma, gfp_flags);
 	if (!req->item)
 		goto fail2;
+	req->item->next = TERMINATE;
+	req->item->info = 0;
 
 	if (bufsize) {
 		req->req.buf = kmalloc(bufsize, gfp_flags);
@@ -470,7 +535,7 @@ struct usb_request *usb_ept_alloc_req(struct msm_endpoint *ept,
 	return &req->req;
 
 fail3:
-	dma_pool_free(ui->pool, req->item, req->item_dma);
+	dtd_free(ui, req->item, req->item_dma);
 fail2:
 	kfree(req);
 fail1:
@@ -482,7 +547,7 @@ static void do_free_req(struct usb_info *ui, struct msm_request *req)
 	if (req->alloced)
 		kfree(req->req.buf);
 
-	dma_pool_free(ui->pool, req->item, req->item_dma);
+	dtd_free(ui, req->item, req->item_dma);
 	kfree(req);
 }
 
@@ -519,36 +584,30 @@ static void usb_ept_enable(struct msm_endpoint *ept, int yes,
 	       ept->num, in ? "in" : "out", yes ? "enabled" : "disabled");
 }
 
-static void usb_ept_start(struct msm_endpoint *ept)
+/* prepare the transaction descriptor item for the hardware */
+static void usb_ept_fill_item(struct msm_request *req)
+{
+	req->live = 1;
+	req->item->info =
+		INFO_BYTES(req->req.length) | INFO_IOC | INFO_ACTIVE;
+	req->item->page0 = req->dma;
+	req->item->page1 = (req->dma + 0x1000) & 0xfffff000;
+	req->item->page2 = (req->dma + 0x2000) & 0xfffff000;
+	req->item->page3 = (req->dma + 0x3000) & 0xfffff000;
+	req->item->next = TERMINATE;
+}
+
+/* point the queue head at @req's item and prime the endpoint */
+static void usb_ept_prime(struct msm_endpoint *ept, struct msm_request *req)
 {
 	struct usb_info *ui = ept->ui;
-	struct msm_request *req = ept->req;
 	int i, cnt;
 	unsigned n = 1 << ept->bit;
 
-	BUG_ON(req->live);
-
-	while (req) {
-		req->live = 1;
-		/* prepare the transaction descriptor item for the hardware */
-		req->item->info =
-			INFO_BYTES(req->req.length) | INFO_IOC | INFO_ACTIVE;
-		req->item->page0 = req->dma;
-		req->item->page1 = (req->dma + 0x1000) & 0xfffff000;
-		req->item->page2 = (req->dma + 0x2000) & 0xfffff000;
-		req->item->page3 = (req->dma + 0x3000) & 0xfffff000;
-
-		if (req->next == NULL) {
-			req->item->next = TERMINATE;
-			break;
-		}
-		req->item->next = req->next->item_dma;
-		req = req->next;
-	}
-
 	/* link the hw queue head to the request's transaction item */
-	ept->head->next = ept->req->item_dma;
+	ept->head->next = req->item_dma;
 	ept->head->info = 0;
+	ept->primes++;
 
 	/* flush buffers before priming ept */
 	dma_coherent_pre_ops();
@@ -575,6 +634,54 @@ static void usb_ept_start(struct msm_endpoint *ept)
 				ept->flags & EPT_FLAG_IN ? "in" : "out");
 }
 
+static void usb_ept_start(struct msm_endpoint *ept)
+{
+	struct msm_request *req = ept->req;
+
+	BUG_ON(req->live);
+
+	while (req) {
+		usb_ept_fill_item(req);
+		if (req->next)
+			req->item->next = req->next->item_dma;
+		req = req->next;
+	}
+
+	usb_ept_prime(ept, ept->req);
+}
+
+/* Append @req to the live dTD chain ending in @last.  Uses the add dTD
+ * tripwire to tell whether the controller still had the endpoint active
+ * when the link was made; if not, it stopped at the old end of the chain
+ * and is re-primed at @req.
+ */
+static void usb_ept_chain(struct msm_endpoint *ept, struct msm_request *last,
+			struct msm_request *req)
+{
+	struct usb_info *ui = ept->ui;
+	unsigned n = 1 << ept->bit;
+	unsigned stat;
+
+	usb_ept_fill_item(req);
+	dma_coherent_pre_ops();
+	last->item->next = req->item_dma;
+	dma_coherent_pre_ops();
+	ept->chained++;
+
+	/* a prime is already pending: it will pick up the new item */
+	if (readl(USB_ENDPTPRIME) & n)
+		return;
+
+	do {
+		writel(readl(USB_USBCMD) | USBCMD_ATDTW, USB_USBCMD);
+		stat = readl(USB_ENDPTSTAT) & n;
+	} while (!(readl(USB_USBCMD) & USBCMD_ATDTW));
+	writel(readl(USB_USBCMD) & ~USBCMD_ATDTW, USB_USBCMD);
+
+	if (!stat)
+		usb_ept_prime(ept, req);
+}
+
 int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 {
 	unsigned long flags;
@@ -653,11 +760,13 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 	last = ept->last;
 	if (last) {
 		/* Already requests in the queue. add us to the
-		 * end, but let the completion interrupt actually
-		 * start things going, to avoid hw issues
+		 * end; unless chaining, let the completion interrupt
+		 * actually start things going, to avoid hw issues
 		 */
 		last->next = req;
 		req->prev = last;
+		if (chain_xfers && last->live)
+			usb_ept_chain(ept, last, req);
 
 	} else {
 		/* queue was empty -- kick the hardware */
@@ -915,8 +1024,10 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 {
 	struct msm_endpoint *ept = ui->ept + bit;
 	struct msm_request *req;
+	LIST_HEAD(done);
 	unsigned long flags;
 	unsigned info;
+	unsigned reaped = 0;
 
 	/*
 	INFO("handle_endpoint() %d %s req=%p(%08x)\n",
@@ -924,8 +1035,12 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 		ept->req, ept->req ? ept->req->item_dma : 0);
 	*/
 
-	/* expire all requests that are no longer active */
+	/* expire all requests that are no longer active, and collect
+	 * them so they can be completed in one pass with the lock dropped
+	 */
 	spin_lock_irqsave(&ui->lock, flags);
+	/* clean speculative fetches on req->item->info */
+	dma_coherent_post_ops();
 	while ((req = ept->req)) {
 		/* if we've processed all live requests, time to
 		 * restart the hardware on the next non-live request
@@ -935,8 +1050,6 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 			break;
 		}
 
-		/* clean speculative fetches on req->item->info */
-		dma_coherent_post_ops();
 		info = req->item->info;
 		/* if the transaction is still in-flight, stop here */
 		if (info & INFO_ACTIVE)
@@ -966,14 +1079,30 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 		}
 		req->busy = 0;
 		req->live = 0;
-		if (req->dead)
+		reaped++;
+
+		/* freed while in flight: nobody is waiting for it */
+		if (req->dead) {
 			do_free_req(ui, req);
+			continue;
+		}
 
-		if (req->req.complete) {
-			spin_unlock_irqrestore(&ui->lock, flags);
+		list_add_tail(&req->done, &done);
+	}
+	if (reaped > ept->max_reaped)
+		ept->max_reaped = reaped;
+
+	/* completions may requeue, which appends to the live chain, or
+	 * free a request still on the done list, which takes it off; so
+	 * each one is popped under the lock before its completion runs
+	 */
+	while (!list_empty(&done)) {
+		req = list_first_entry(&done, struct msm_request, done);
+		list_del_init(&req->done);
+		spin_unlock_irqrestore(&ui->lock, flags);
+		if (req->req.complete)
 			req->req.complete(&ept->ep, &req->req);
-			spin_lock_irqsave(&ui->lock, flags);
-		}
+		spin_lock_irqsave(&ui->lock, flags);
 	}
 	spin_unlock_irqrestore(&ui->lock, flags);
 }
@@ -1273,6 +1402,9 @@ static int usb_free(struct usb_info *ui, int ret)
 		dma_pool_destroy(ui->pool);
 	if (ui->dma)
 		dma_free_coherent(&ui->pdev->dev, 4096, ui->buf, ui->dma);
+	if (ui->dtd)
+		dma_free_coherent(&ui->pdev->dev, DTD_POOL_SIZE,
+				  ui->dtd, ui->dtd_dma);
 	kfree(ui);
 	pm_qos_remove_requirement(PM_QOS_CPU_DMA_LATENCY, DRIVER_NAME);
 	pm_qos_remove_requirement(PM_QOS_SYSTEM_BUS_FREQ, DRIVER_NAME);
@@ -1608,6 +1740,10 @@ static ssize_t debug_read_status(struct file *file, char __user *ubuf,
 				req->item->info, req->item->page0,
 				req->busy ? 'B' : ' ',
 				req->live ? 'L' : ' ');
+
+		i += scnprintf(buf + i, PAGE_SIZE - i,
+			"  primes=%lu chained=%lu max_reaped=%u\n",
+			ept->primes, ept->chained, ept->max_reaped);
 	}
 
 	i += scnprintf(buf + i, PAGE_SIZE - i,
@@ -1764,6 +1900,8 @@ msm72k_free_request(struct usb_ep *_ep, struct usb_request *_req)
 	/* defer freeing resources if request is still busy */
 	if (req->busy)
 		dead = req->dead = 1;
+	/* reaped but not yet completed: there is nobody left to tell */
+	list_del_init(&req->done);
 	spin_unlock_irqrestore(&ui->lock, flags);
 
 	/* if req->dead, then we will clean up when the request finishes */
@@ -2161,6 +2299,11 @@ static int msm72k_probe(struct platform_device *pdev)
 	if (!ui->pool)
 		return usb_free(ui, -ENOMEM);
 
+	ui->dtd = dma_alloc_coherent(&pdev->dev, DTD_POOL_SIZE,
+				     &ui->dtd_dma, GFP_KERNEL);
+	if (!ui->dtd)
+		return usb_free(ui, -ENOMEM);
+
 	ui->xceiv = otg_get_transceiver();
 	if (!ui->xceiv)
 		return usb_free(ui, -ENODEV);
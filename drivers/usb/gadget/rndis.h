@@ -239,6 +239,9 @@ typedef struct rndis_params
 	void			(*resp_avail)(void *v);
 	void			*v;
 	struct list_head	resp_queue;
+
+	/* largest transfer the host will accept, from its INITIALIZE */
+	u32			host_max_xfer_size;
 } rndis_params;
 
 /* RNDIS Message parser and other useless functions */
@@ -254,6 +257,7 @@ void rndis_add_hdr (struct sk_buff *skb);
 int rndis_rm_hdr (struct sk_buff *skb);
 u8   *rndis_get_next_response (int configNr, u32 *length);
 void rndis_free_response (int configNr, u8 *buf);
+u32  rndis_get_dl_max_xfer_size (u8 configNr);
 
 void rndis_uninit (int configNr);
 int  rndis_signal_connect (int configNr);
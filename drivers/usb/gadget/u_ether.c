@@ -28,6 +28,7 @@
 #include <linux/ctype.h>
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
+#include <linux/hrtimer.h>
 
 #include "u_ether.h"
 
@@ -74,6 +75,10 @@ struct eth_dev {
 
 	struct work_struct	work;
 
+	/* IN transfer being filled with several wrapped packets */
+	struct sk_buff		*tx_aggr_skb;
+	struct hrtimer		tx_aggr_timer;
+
 	unsigned long		todo;
 #define	WORK_RX_MEMORY		0
 
@@ -98,6 +103,26 @@ MODULE_PARM_DESC(qmult, "queue length multiplier at high speed");
 #define qmult		1
 #endif
 
+/*
+ * Multi-packet IN transfers, for framings that allow it (RNDIS).  While
+ * earlier transfers are in flight, outgoing packets are packed into one
+ * transfer of up to tx_aggr_size bytes (or the host's limit, if lower).
+ * It is sent when full, when the IN queue drains, or after
+ * tx_aggr_timeout_us at most.  tx_aggr_size of 0 disables packing.
+ */
+static unsigned tx_aggr_size = 8192;
+module_param(tx_aggr_size, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(tx_aggr_size, "max bytes per aggregated IN transfer");
+
+static unsigned tx_aggr_timeout_us = 500;
+module_param(tx_aggr_timeout_us, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(tx_aggr_timeout_us, "max delay of a partly filled transfer");
+
+struct tx_aggr_cb {
+	unsigned	pkts;
+};
+#define TX_AGGR_CB(skb)	((struct tx_aggr_cb *)(skb)->cb)
+
 /* for dual-speed hardware, use deeper queues at highspeed */
 static inline int qlen(struct usb_gadget *gadget)
 {
@@ -466,6 +491,196 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 		netif_wake_queue(dev->net);
 }
 
+static void tx_aggr_complete(struct usb_ep *ep, struct usb_request *req);
+
+/* size of the aggregated transfers for this link, 0 if not worthwhile */
+static unsigned tx_aggr_max(struct eth_dev *dev, struct gether *link)
+{
+	unsigned	max = min(tx_aggr_size, link->dl_max_xfer_size);
+
+	if (max < 2 * (dev->net->mtu + ETH_HLEN + dev->header_len))
+		return 0;
+	return max;
+}
+
+/* Send the pending aggregate, if any.  Returns -EBUSY when there is
+ * no idle request to carry it; tx_aggr_complete() retries then.
+ */
+static int tx_aggr_flush(struct eth_dev *dev, struct usb_ep *in)
+{
+	struct usb_request	*req;
+	struct sk_buff		*skb;
+	unsigned long		flags;
+	int			length, retval;
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	skb = dev->tx_aggr_skb;
+	if (!skb) {
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return 0;
+	}
+	if (list_empty(&dev->tx_reqs)) {
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return -EBUSY;
+	}
+	req = container_of(dev->tx_reqs.next, struct usb_request, list);
+	list_del(&req->list);
+	dev->tx_aggr_skb = NULL;
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	length = skb->len;
+	req->buf = skb->data;
+	req->context = skb;
+	req->complete = tx_aggr_complete;
+	req->zero = 1;
+	if (!dev->zlp && (length % in->maxpacket) == 0)
+		length++;	/* room reserved by eth_aggr_xmit() */
+	req->length = length;
+	req->no_interrupt = 0;
+
+	retval = usb_ep_queue(in, req, GFP_ATOMIC);
+	if (retval) {
+		DBG(dev, "tx queue err %d\n", retval);
+		dev->net->stats.tx_dropped += TX_AGGR_CB(skb)->pkts;
+		dev_kfree_skb_any(skb);
+		spin_lock_irqsave(&dev->req_lock, flags);
+		list_add(&req->list, &dev->tx_reqs);
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return retval;
+	}
+
+	dev->net->trans_start = jiffies;
+	atomic_inc(&dev->tx_qlen);
+	return 0;
+}
+
+static struct usb_ep *tx_aggr_ep(struct eth_dev *dev)
+{
+	struct usb_ep	*in = NULL;
+	unsigned long	flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if (dev->port_usb)
+		in = dev->port_usb->in_ep;
+	spin_unlock_irqrestore(&dev->lock, flags);
+	return in;
+}
+
+static void tx_aggr_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct sk_buff	*skb = req->context;
+	struct eth_dev	*dev = ep->driver_data;
+
+	switch (req->status) {
+	default:
+		dev->net->stats.tx_errors++;
+		VDBG(dev, "tx err %d\n", req->status);
+		/* FALLTHROUGH */
+	case -ECONNRESET:		/* unlink */
+	case -ESHUTDOWN:		/* disconnect etc */
+		break;
+	case 0:
+		dev->net->stats.tx_bytes += skb->len;
+	}
+	dev->net->stats.tx_packets += TX_AGGR_CB(skb)->pkts;
+
+	spin_lock(&dev->req_lock);
+	list_add(&req->list, &dev->tx_reqs);
+	spin_unlock(&dev->req_lock);
+	dev_kfree_skb_any(skb);
+
+	atomic_dec(&dev->tx_qlen);
+
+	/* whatever piled up while we were busy goes out now */
+	if (req->status != -ESHUTDOWN)
+		tx_aggr_flush(dev, ep);
+
+	if (netif_carrier_ok(dev->net))
+		netif_wake_queue(dev->net);
+}
+
+static enum hrtimer_restart tx_aggr_timer_func(struct hrtimer *timer)
+{
+	struct eth_dev	*dev = container_of(timer, struct eth_dev,
+					    tx_aggr_timer);
+	struct usb_ep	*in = tx_aggr_ep(dev);
+
+	if (in)
+		tx_aggr_flush(dev, in);
+	return HRTIMER_NORESTART;
+}
+
+/* Make sure a packet of len bytes fits in the pending aggregate,
+ * flushing it if needed.  Returns -EBUSY when the aggregate is full
+ * and no request is idle to carry it.
+ */
+static int eth_aggr_room(struct eth_dev *dev, struct usb_ep *in,
+			 unsigned max, unsigned len)
+{
+	struct sk_buff		*aggr;
+	unsigned long		flags;
+	int			fits;
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	aggr = dev->tx_aggr_skb;
+	fits = !aggr || aggr->len + len <= max;
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	if (fits || tx_aggr_flush(dev, in) != -EBUSY)
+		return 0;
+	return -EBUSY;
+}
+
+/* Append an already wrapped packet to the pending aggregate.  The
+ * packet is always consumed, so this never asks the stack to requeue;
+ * eth_start_xmit() checks for room before it wraps the packet.
+ */
+static int eth_aggr_xmit(struct eth_dev *dev, struct sk_buff *skb,
+			 struct usb_ep *in, unsigned max)
+{
+	struct sk_buff		*aggr;
+	unsigned long		flags;
+
+	if (eth_aggr_room(dev, in, max, skb->len)) {
+		dev->net->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		return 0;
+	}
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	aggr = dev->tx_aggr_skb;
+
+	if (!aggr) {
+		/* one spare byte for the zlp workaround */
+		aggr = alloc_skb(max + 1, GFP_ATOMIC);
+		if (!aggr) {
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+			dev->net->stats.tx_dropped++;
+			dev_kfree_skb_any(skb);
+			return 0;
+		}
+		TX_AGGR_CB(aggr)->pkts = 0;
+		dev->tx_aggr_skb = aggr;
+	}
+
+	memcpy(skb_put(aggr, skb->len), skb->data, skb->len);
+	TX_AGGR_CB(aggr)->pkts++;
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+	dev_kfree_skb_any(skb);
+
+	/* nothing in flight means nothing to wait for */
+	if (atomic_read(&dev->tx_qlen) == 0) {
+		tx_aggr_flush(dev, in);
+		return 0;
+	}
+
+	if (!hrtimer_active(&dev->tx_aggr_timer))
+		hrtimer_start(&dev->tx_aggr_timer,
+			      ns_to_ktime(tx_aggr_timeout_us * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+	return 0;
+}
+
 static inline int is_promisc(u16 cdc_filter)
 {
 	return cdc_filter & USB_CDC_PACKET_TYPE_PROMISCUOUS;
@@ -480,14 +695,17 @@ static int eth_start_xmit(struct sk_buff *skb, struct net_device *net)
 	unsigned long		flags;
 	struct usb_ep		*in;
 	u16			cdc_filter;
+	unsigned		aggr_max;
 
 	spin_lock_irqsave(&dev->lock, flags);
 	if (dev->port_usb) {
 		in = dev->port_usb->in_ep;
 		cdc_filter = dev->port_usb->cdc_filter;
+		aggr_max = tx_aggr_max(dev, dev->port_usb);
 	} else {
 		in = NULL;
 		cdc_filter = 0;
+		aggr_max = 0;
 	}
 	spin_unlock_irqrestore(&dev->lock, flags);
 
@@ -518,6 +736,28 @@ static int eth_start_xmit(struct sk_buff *skb, struct net_device *net)
 		/* ignores USB_CDC_PACKET_TYPE_DIRECTED */
 	}
 
+	if (aggr_max) {
+		/* the wrapper only prepends header_len bytes */
+		if (eth_aggr_room(dev, in, aggr_max,
+				  skb->len + dev->header_len)) {
+			/* tx_aggr_complete() will flush and wake us */
+			netif_stop_queue(net);
+			return 1;
+		}
+		if (dev->wrap) {
+			struct sk_buff	*skb_new;
+
+			skb_new = dev->wrap(skb);
+			dev_kfree_skb_any(skb);
+			if (!skb_new) {
+				dev->net->stats.tx_dropped++;
+				return 0;
+			}
+			skb = skb_new;
+		}
+		return eth_aggr_xmit(dev, skb, in, aggr_max);
+	}
+
 	spin_lock_irqsave(&dev->req_lock, flags);
 	/*
 	 * this freelist can be empty if an interrupt triggered disconnect()
@@ -755,6 +995,8 @@ int gether_setup(struct usb_gadget *g, u8 ethaddr[ETH_ALEN])
 	spin_lock_init(&dev->lock);
 	spin_lock_init(&dev->req_lock);
 	INIT_WORK(&dev->work, eth_work);
+	hrtimer_init(&dev->tx_aggr_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	dev->tx_aggr_timer.function = tx_aggr_timer_func;
 	INIT_LIST_HEAD(&dev->tx_reqs);
 	INIT_LIST_HEAD(&dev->rx_reqs);
 
@@ -972,4 +1214,15 @@ void gether_disconnect(struct gether *link)
 	dev->port_usb = NULL;
 	link->ioport = NULL;
 	spin_unlock(&dev->lock);
+
+	/* drop any partly filled aggregate */
+	hrtimer_cancel(&dev->tx_aggr_timer);
+	spin_lock(&dev->req_lock);
+	if (dev->tx_aggr_skb) {
+		dev->net->stats.tx_dropped +=
+			TX_AGGR_CB(dev->tx_aggr_skb)->pkts;
+		dev_kfree_skb_any(dev->tx_aggr_skb);
+		dev->tx_aggr_skb = NULL;
+	}
+	spin_unlock(&dev->req_lock);
 }
@@ -67,6 +67,12 @@ struct gether {
 	struct sk_buff			*(*wrap)(struct sk_buff *skb);
 	int				(*unwrap)(struct sk_buff *skb);
 
+	/* nonzero when the framing lets several wrapped packets share one
+	 * IN transfer: the largest transfer the host accepts.  May be
+	 * updated while connected, e.g. once RNDIS is initialized.
+	 */
+	u32				dl_max_xfer_size;
+
 	/* called on network open/close */
 	void				(*open)(struct gether *);
 	void				(*close)(struct gether *);
@@ -1238,6 +1238,12 @@ int get_img(struct mdp_img *img, struct fb_info *info, unsigned long *start,
 	unsigned long vstart;
 #endif
 
+	/* queued blits run from a worker, on images pinned at submission */
+	ret = msmfb_blit_get_pinned(img->memory_id, start, len, pp_file);
+	if (ret != -ENOENT)
+		return ret;
+	ret = 0;
+
 #ifdef CONFIG_ANDROID_PMEM
 	if (!get_pmem_file(img->memory_id, start, &vstart, len, pp_file))
 		return 0;
@@ -1261,7 +1267,7 @@ int get_img(struct mdp_img *img, struct fb_info *info, unsigned long *start,
 void put_img(struct file *p_src_file)
 {
 #ifdef CONFIG_ANDROID_PMEM
-	if (p_src_file)
+	if (p_src_file && !msmfb_blit_pinned(p_src_file))
 		put_pmem_file(p_src_file);
 #endif
 }
@@ -39,6 +39,8 @@
 #include <linux/console.h>
 #include <linux/android_pmem.h>
 #include <linux/leds.h>
+#include <linux/file.h>
+#include <linux/major.h>
 
 #define MSM_FB_C
 #include "msm_fb.h"
@@ -597,7 +599,8 @@ static void msm_fb_fillrect(struct fb_info *info,
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
 
-	cfb_fillrect(info, rect);
+	if (msm_fb_neon_fillrect(info, rect))
+		cfb_fillrect(info, rect);
 	if (!mfd->hw_refresh && (info->var.yoffset == 0) &&
 		!mfd->sw_currently_refreshing) {
 		struct fb_var_screeninfo var;
@@ -617,7 +620,8 @@ static void msm_fb_copyarea(struct fb_info *info,
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
 
-	cfb_copyarea(info, area);
+	if (msm_fb_neon_copyarea(info, area))
+		cfb_copyarea(info, area);
 	if (!mfd->hw_refresh && (info->var.yoffset == 0) &&
 		!mfd->sw_currently_refreshing) {
 		struct fb_var_screeninfo var;
@@ -636,7 +640,8 @@ static void msm_fb_imageblit(struct fb_info *info, const struct fb_image *image)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
 
-	cfb_imageblit(info, image);
+	if (msm_fb_neon_imageblit(info, image))
+		cfb_imageblit(info, image);
 	if (!mfd->hw_refresh && (info->var.yoffset == 0) &&
 		!mfd->sw_currently_refreshing) {
 		struct fb_var_screeninfo var;
@@ -1275,6 +1280,144 @@ static int msm_fb_pan_display(struct fb_var_screeninfo *var,
 	return 0;
 }
 
+/*
+ * Partial updates.  Each DMA to a command mode panel costs a window
+ * setup on top of the pixels it moves, so the dirty rectangles are
+ * merged greedily for as long as a merge wastes fewer pixels than
+ * another DMA would cost, and until at most MSMFB_DIRTY_MAX_DMAS remain.
+ */
+#define MSMFB_DIRTY_MAX_DMAS	4
+
+static unsigned int dirty_dma_cost = 4096;
+module_param(dirty_dma_cost, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(dirty_dma_cost, "pixels one extra partial update DMA is worth");
+
+static unsigned long msmfb_rect_area(const struct mdp_rect *r)
+{
+	return (unsigned long)r->w * r->h;
+}
+
+static void msmfb_rect_union(struct mdp_rect *u, const struct mdp_rect *a,
+			     const struct mdp_rect *b)
+{
+	u32 x1 = max(a->x + a->w, b->x + b->w);
+	u32 y1 = max(a->y + a->h, b->y + b->h);
+
+	u->x = min(a->x, b->x);
+	u->y = min(a->y, b->y);
+	u->w = x1 - u->x;
+	u->h = y1 - u->y;
+}
+
+static unsigned long msmfb_rect_overlap(const struct mdp_rect *a,
+					const struct mdp_rect *b)
+{
+	u32 x0 = max(a->x, b->x), x1 = min(a->x + a->w, b->x + b->w);
+	u32 y0 = max(a->y, b->y), y1 = min(a->y + a->h, b->y + b->h);
+
+	if (x1 <= x0 || y1 <= y0)
+		return 0;
+	return (unsigned long)(x1 - x0) * (y1 - y0);
+}
+
+static int msmfb_merge_dirty(struct mdp_rect *r, int n)
+{
+	struct mdp_rect u, best_u;
+	long waste, best_waste;
+	int i, j, bi, bj;
+
+	while (n > 1) {
+		best_waste = LONG_MAX;
+		bi = bj = 0;
+		for (i = 0; i < n; i++) {
+			for (j = i + 1; j < n; j++) {
+				msmfb_rect_union(&u, &r[i], &r[j]);
+				waste = msmfb_rect_area(&u) -
+					msmfb_rect_area(&r[i]) -
+					msmfb_rect_area(&r[j]) +
+					msmfb_rect_overlap(&r[i], &r[j]);
+				if (waste < best_waste) {
+					best_waste = waste;
+					best_u = u;
+					bi = i;
+					bj = j;
+				}
+			}
+		}
+
+		if (n <= MSMFB_DIRTY_MAX_DMAS &&
+		    best_waste > (long)dirty_dma_cost)
+			break;
+
+		r[bi] = best_u;
+		r[bj] = r[--n];
+	}
+	return n;
+}
+
+static int msmfb_display_dirty(struct fb_info *info, void __user *p)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp_dirty_rects rects;
+	struct mdp_dirty_region dirty;
+	struct mdp_rect *r;
+	int i, n;
+
+	if ((!mfd->op_enable) || (!mfd->panel_power_on))
+		return -EPERM;
+
+	if (copy_from_user(&rects, p, sizeof(rects)))
+		return -EFAULT;
+	if (rects.count > MDP_DIRTY_RECTS_MAX)
+		return -EINVAL;
+
+	/* clip to the visible frame and drop what is left empty */
+	for (i = n = 0; i < rects.count; i++) {
+		r = &rects.rect[i];
+		if (r->x >= info->var.xres || r->y >= info->var.yres)
+			continue;
+		if (r->w > info->var.xres - r->x)
+			r->w = info->var.xres - r->x;
+		if (r->h > info->var.yres - r->y)
+			r->h = info->var.yres - r->y;
+		if (r->w && r->h)
+			rects.rect[n++] = *r;
+	}
+	if (!n)
+		return 0;
+
+	/* video mode panels are refreshed whole: one ordinary pan */
+	if (mfd->panel_info.type != MDDI_PANEL &&
+	    mfd->panel_info.type != EBI2_PANEL)
+		n = 0;
+	else
+		n = msmfb_merge_dirty(rects.rect, n);
+
+	down(&msm_fb_pan_sem);
+#ifdef CONFIG_MACH_ACER_A4
+	down(&msm_fb_ioctl_ppp_sem);
+#endif
+	if (!n) {
+		mdp_set_dma_pan_info(info, NULL, TRUE);
+		mdp_dma_pan_update(info);
+	}
+	for (i = 0; i < n; i++) {
+		dirty.xoffset = rects.rect[i].x;
+		dirty.yoffset = rects.rect[i].y;
+		dirty.width = rects.rect[i].w;
+		dirty.height = rects.rect[i].h;
+		mdp_set_dma_pan_info(info, &dirty, FALSE);
+		mdp_dma_pan_update(info);
+	}
+#ifdef CONFIG_MACH_ACER_A4
+	up(&msm_fb_ioctl_ppp_sem);
+#endif
+	up(&msm_fb_pan_sem);
+
+	++mfd->panel_info.frame_count;
+	return 0;
+}
+
 static int msm_fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
@@ -1956,6 +2099,421 @@ static int msmfb_blit(struct fb_info *info, void __user *p)
 	return 0;
 }
 
+/*
+ * Asynchronous blits: MSMFB_ASYNC_BLIT copies in a whole list of requests,
+ * pins the images they refer to and returns a fence right away.  A worker
+ * thread feeds the lists to the blitter in submission order, and
+ * MSMFB_BLIT_WAIT sleeps until a given fence has been retired and returns
+ * the result of that list, as long as it is one of the last
+ * MSMFB_ASYNC_BLIT_ERRS retired.
+ *
+ * With blit_sw_ref set the worker does the blits with the CPU instead
+ * (unscaled, unrotated, unblended copies only), so that the queueing can
+ * be exercised without the PPP.  On MDP 4.0 mdp_ppp_blit() is only a stub
+ * that fails every request, so there the CPU path is the only one that
+ * does any work.  Documentation/fb/msmfb_async_blit.c checks the queue
+ * and the fences from userspace.
+ */
+#define MSMFB_ASYNC_BLIT_MAX	64
+#define MSMFB_ASYNC_BLIT_DEPTH	4
+#define MSMFB_ASYNC_BLIT_ERRS	32	/* power of two */
+
+static int blit_sw_ref;
+module_param(blit_sw_ref, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(blit_sw_ref, "run queued blits on the CPU (copies only)");
+
+struct msmfb_blit_pin {
+	int memory_id;
+	unsigned long start;
+	unsigned long vstart;
+	unsigned long len;
+	struct file *file;
+	int is_pmem;
+};
+
+struct msmfb_blit_job {
+	struct list_head list;
+	struct fb_info *info;
+	u32 fence;
+	int count;
+	int npins;
+	struct msmfb_blit_pin *pin;
+	struct mdp_blit_req req[0];
+};
+
+static void msmfb_blit_worker(struct work_struct *work);
+
+static LIST_HEAD(msmfb_blit_queue);
+static DEFINE_SPINLOCK(msmfb_blit_lock);
+static DECLARE_WAIT_QUEUE_HEAD(msmfb_blit_wait);
+static DECLARE_WORK(msmfb_blit_work, msmfb_blit_worker);
+static struct workqueue_struct *msmfb_blit_wq;
+static u32 msmfb_blit_fence;		/* last one handed out */
+static u32 msmfb_blit_retired;		/* last one completed */
+static int msmfb_blit_queued;
+/* result of each of the last MSMFB_ASYNC_BLIT_ERRS lists, by fence */
+static int msmfb_blit_err[MSMFB_ASYNC_BLIT_ERRS];
+/* job being blitted; only changed with msm_fb_ioctl_ppp_sem held */
+static struct msmfb_blit_job *msmfb_blit_cur;
+
+static struct msmfb_blit_pin *msmfb_blit_find_pin(struct msmfb_blit_job *job,
+						  int memory_id)
+{
+	int i;
+
+	for (i = 0; i < job->npins; i++)
+		if (job->pin[i].memory_id == memory_id)
+			return &job->pin[i];
+	return NULL;
+}
+
+static int msmfb_blit_pin_img(struct msmfb_blit_job *job, struct mdp_img *img)
+{
+	struct msmfb_blit_pin *pin;
+	struct file *file;
+
+	if (msmfb_blit_find_pin(job, img->memory_id))
+		return 0;
+
+	pin = &job->pin[job->npins];
+	pin->memory_id = img->memory_id;
+#ifdef CONFIG_ANDROID_PMEM
+	if (!get_pmem_file(img->memory_id, &pin->start, &pin->vstart,
+			   &pin->len, &pin->file)) {
+		pin->is_pmem = 1;
+		job->npins++;
+		return 0;
+	}
+#endif
+	file = fget(img->memory_id);
+	if (!file)
+		return -EBADF;
+	if (MAJOR(file->f_dentry->d_inode->i_rdev) != FB_MAJOR) {
+		fput(file);
+		return -EINVAL;
+	}
+	pin->start = job->info->fix.smem_start;
+	pin->vstart = (unsigned long)job->info->screen_base;
+	pin->len = job->info->fix.smem_len;
+	pin->file = file;
+	pin->is_pmem = 0;
+	job->npins++;
+	return 0;
+}
+
+static void msmfb_blit_unpin(struct msmfb_blit_job *job)
+{
+	int i;
+
+	for (i = 0; i < job->npins; i++) {
+#ifdef CONFIG_ANDROID_PMEM
+		if (job->pin[i].is_pmem) {
+			put_pmem_file(job->pin[i].file);
+			continue;
+		}
+#endif
+		fput(job->pin[i].file);
+	}
+	job->npins = 0;
+}
+
+/* get_img() for the blitter while it works through a queued job */
+int msmfb_blit_get_pinned(int memory_id, unsigned long *start,
+			  unsigned long *len, struct file **pp_file)
+{
+	struct msmfb_blit_pin *pin;
+
+	if (!msmfb_blit_cur)
+		return -ENOENT;
+
+	pin = msmfb_blit_find_pin(msmfb_blit_cur, memory_id);
+	if (!pin) {
+		*len = 0;
+		return -EBADF;
+	}
+	*start = pin->start;
+	*len = pin->len;
+	*pp_file = pin->file;
+	return 0;
+}
+
+/* pinned files are released with their job, not by put_img() */
+int msmfb_blit_pinned(struct file *file)
+{
+	struct msmfb_blit_job *job = msmfb_blit_cur;
+	int i;
+
+	if (!job)
+		return 0;
+	for (i = 0; i < job->npins; i++)
+		if (job->pin[i].file == file)
+			return 1;
+	return 0;
+}
+
+static int msmfb_blit_sw_bpp(uint32_t format)
+{
+	switch (format) {
+	case MDP_RGB_565:
+	case MDP_BGR_565:
+	case MDP_YCRYCB_H2V1:
+		return 2;
+	case MDP_RGB_888:
+		return 3;
+	case MDP_XRGB_8888:
+	case MDP_ARGB_8888:
+	case MDP_RGBA_8888:
+	case MDP_BGRA_8888:
+	case MDP_RGBX_8888:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Byte range [*start, *end) of rect r in img, checked against the pinned
+ * length.  Every field comes from userspace, so no sum or product may
+ * wrap: the rect is checked against the image by subtraction, and the
+ * offsets are computed in 64 bits once a row is known to fit in len.
+ */
+static int msmfb_blit_sw_span(struct mdp_img *img, struct mdp_rect *r,
+			      int bpp, unsigned long len,
+			      unsigned long *start, unsigned long *end)
+{
+	u64 stride, first, last;
+
+	if (r->x > img->width || r->w > img->width - r->x ||
+	    r->y > img->height || r->h > img->height - r->y)
+		return -EINVAL;
+
+	stride = (u64)img->width * bpp;
+	if (stride > len)
+		return -EINVAL;
+
+	first = img->offset + r->y * stride + (u64)r->x * bpp;
+	last = img->offset + (u64)(r->y + r->h - 1) * stride +
+		(u64)(r->x + r->w) * bpp;
+	if (last > len)
+		return -EINVAL;
+
+	*start = first;
+	*end = last;
+	return 0;
+}
+
+static int msmfb_blit_sw(struct msmfb_blit_job *job, struct mdp_blit_req *req)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)job->info->par;
+	struct msmfb_blit_pin *src, *dst;
+	uint32_t src_fmt = req->src.format, dst_fmt = req->dst.format;
+	unsigned long src_off, dst_off, src_end, dst_end, dst_start;
+	int bpp, y, ret;
+
+	if (src_fmt == MDP_FB_FORMAT)
+		src_fmt = mfd->fb_imgType;
+	if (dst_fmt == MDP_FB_FORMAT)
+		dst_fmt = mfd->fb_imgType;
+
+	if (src_fmt != dst_fmt ||
+	    req->src_rect.w != req->dst_rect.w ||
+	    req->src_rect.h != req->dst_rect.h ||
+	    (req->flags & (MDP_ROT_90 | MDP_FLIP_LR | MDP_FLIP_UD |
+			   MDP_BLUR | MDP_SHARPENING | MDP_DEINTERLACE)) ||
+	    (req->alpha & 0xff) != MDP_ALPHA_NOP ||
+	    req->transp_mask != MDP_TRANSP_NOP)
+		return -EINVAL;
+
+	bpp = msmfb_blit_sw_bpp(src_fmt);
+	if (!bpp)
+		return -EINVAL;
+
+	if (!req->src_rect.w || !req->src_rect.h)
+		return 0;
+
+	src = msmfb_blit_find_pin(job, req->src.memory_id);
+	dst = msmfb_blit_find_pin(job, req->dst.memory_id);
+	if (!src || !dst)
+		return -EBADF;
+
+	ret = msmfb_blit_sw_span(&req->src, &req->src_rect, bpp, src->len,
+				 &src_off, &src_end);
+	if (!ret)
+		ret = msmfb_blit_sw_span(&req->dst, &req->dst_rect, bpp,
+					 dst->len, &dst_off, &dst_end);
+	if (ret)
+		return ret;
+
+	dst_start = dst_off;
+	for (y = 0; y < req->src_rect.h; y++) {
+		memmove((void *)(dst->vstart + dst_off),
+			(void *)(src->vstart + src_off),
+			req->src_rect.w * bpp);
+		src_off += req->src.width * bpp;
+		dst_off += req->dst.width * bpp;
+	}
+
+#ifdef CONFIG_ANDROID_PMEM
+	/* the result may be scanned out or blitted by the MDP next */
+	if (dst->is_pmem)
+		flush_pmem_file(dst->file, dst_start, dst_end - dst_start);
+#endif
+	return 0;
+}
+
+static int msmfb_blit_done(u32 fence)
+{
+	return (s32)(msmfb_blit_retired - fence) >= 0;
+}
+
+static void msmfb_blit_worker(struct work_struct *work)
+{
+	struct msmfb_blit_job *job;
+	int i, ret, sw;
+
+	for (;;) {
+		spin_lock(&msmfb_blit_lock);
+		if (list_empty(&msmfb_blit_queue)) {
+			spin_unlock(&msmfb_blit_lock);
+			break;
+		}
+		job = list_first_entry(&msmfb_blit_queue,
+				       struct msmfb_blit_job, list);
+		list_del(&job->list);
+		spin_unlock(&msmfb_blit_lock);
+
+		/* the parameter may change under us; one path per job */
+		sw = ACCESS_ONCE(blit_sw_ref);
+
+		ret = 0;
+		down(&msm_fb_ioctl_ppp_sem);
+		msmfb_blit_cur = job;
+		if (!sw)
+			msm_fb_ensure_memory_coherency_before_dma(job->info,
+					job->req, job->count);
+		for (i = 0; i < job->count && !ret; i++) {
+			if (job->req[i].flags & MDP_NO_BLIT)
+				continue;
+			if (sw)
+				ret = msmfb_blit_sw(job, &job->req[i]);
+			else
+				ret = mdp_blit(job->info, &job->req[i]);
+		}
+		if (!sw)
+			msm_fb_ensure_memory_coherency_after_dma(job->info,
+					job->req, job->count);
+		msmfb_blit_cur = NULL;
+		up(&msm_fb_ioctl_ppp_sem);
+
+		msmfb_blit_unpin(job);
+
+		spin_lock(&msmfb_blit_lock);
+		msmfb_blit_err[job->fence & (MSMFB_ASYNC_BLIT_ERRS - 1)] =
+			ret > 0 ? -EIO : ret;
+		msmfb_blit_retired = job->fence;
+		msmfb_blit_queued--;
+		spin_unlock(&msmfb_blit_lock);
+		wake_up_all(&msmfb_blit_wait);
+
+		kfree(job);
+	}
+}
+
+static int msmfb_async_blit(struct fb_info *info, void __user *p)
+{
+	struct mdp_async_blit_req_list hdr;
+	struct mdp_async_blit_req_list __user *up = p;
+	struct msmfb_blit_job *job;
+	u32 fence;
+	int i, ret;
+
+	if (!msmfb_blit_wq)
+		return -ENODEV;
+
+	if (copy_from_user(&hdr, p, sizeof(hdr)))
+		return -EFAULT;
+	if (hdr.count == 0 || hdr.count > MSMFB_ASYNC_BLIT_MAX)
+		return -EINVAL;
+
+	job = kzalloc(sizeof(*job) +
+		      hdr.count * (sizeof(struct mdp_blit_req) +
+				   2 * sizeof(struct msmfb_blit_pin)),
+		      GFP_KERNEL);
+	if (!job)
+		return -ENOMEM;
+	job->pin = (struct msmfb_blit_pin *)&job->req[hdr.count];
+	job->info = info;
+	job->count = hdr.count;
+
+	if (copy_from_user(job->req, up->req,
+			   hdr.count * sizeof(struct mdp_blit_req))) {
+		ret = -EFAULT;
+		goto fail;
+	}
+
+	/* the worker can't look up our file descriptors */
+	for (i = 0; i < job->count; i++) {
+		if (job->req[i].flags & MDP_NO_BLIT)
+			continue;
+		ret = msmfb_blit_pin_img(job, &job->req[i].src);
+		if (!ret)
+			ret = msmfb_blit_pin_img(job, &job->req[i].dst);
+		if (ret)
+			goto fail;
+	}
+
+	/* don't let clients run arbitrarily far ahead */
+	spin_lock(&msmfb_blit_lock);
+	while (msmfb_blit_queued >= MSMFB_ASYNC_BLIT_DEPTH) {
+		spin_unlock(&msmfb_blit_lock);
+		ret = wait_event_interruptible(msmfb_blit_wait,
+				msmfb_blit_queued < MSMFB_ASYNC_BLIT_DEPTH);
+		if (ret)
+			goto fail;
+		spin_lock(&msmfb_blit_lock);
+	}
+	fence = job->fence = ++msmfb_blit_fence;
+	list_add_tail(&job->list, &msmfb_blit_queue);
+	msmfb_blit_queued++;
+	spin_unlock(&msmfb_blit_lock);
+	queue_work(msmfb_blit_wq, &msmfb_blit_work);
+
+	if (put_user(fence, &up->fence))
+		return -EFAULT;
+	return 0;
+
+fail:
+	msmfb_blit_unpin(job);
+	kfree(job);
+	return ret;
+}
+
+static int msmfb_blit_wait_fence(u32 fence)
+{
+	int ret;
+
+	if ((s32)(fence - msmfb_blit_fence) > 0)
+		return -EINVAL;
+
+	ret = wait_event_interruptible(msmfb_blit_wait,
+				       msmfb_blit_done(fence));
+	if (ret)
+		return ret;
+
+	/* report the result of this list only; older results are gone */
+	spin_lock(&msmfb_blit_lock);
+	if ((s32)(msmfb_blit_retired - fence) < MSMFB_ASYNC_BLIT_ERRS)
+		ret = msmfb_blit_err[fence & (MSMFB_ASYNC_BLIT_ERRS - 1)];
+	spin_unlock(&msmfb_blit_lock);
+	return ret;
+}
+
+/* synchronous blits are ordered after everything already queued */
+static void msmfb_blit_drain(void)
+{
+	wait_event(msmfb_blit_wait, msmfb_blit_done(msmfb_blit_fence));
+}
+
 #ifdef CONFIG_FB_MSM_OVERLAY
 static int msmfb_overlay_get(struct fb_info *info, void __user *p)
 {
@@ -2147,12 +2705,31 @@ static int msm_fb_ioctl(struct fb_info *info, unsigned int cmd,
 		break;
 #endif
 	case MSMFB_BLIT:
+		msmfb_blit_drain();
 		down(&msm_fb_ioctl_ppp_sem);
 		ret = msmfb_blit(info, argp);
 		up(&msm_fb_ioctl_ppp_sem);
 
 		break;
 
+	case MSMFB_ASYNC_BLIT:
+		ret = msmfb_async_blit(info, argp);
+		break;
+
+	case MSMFB_DISPLAY_DIRTY:
+		ret = msmfb_display_dirty(info, argp);
+		break;
+
+	case MSMFB_BLIT_WAIT:
+	{
+		unsigned int fence;
+
+		if (get_user(fence, (unsigned int __user *)argp))
+			return -EFAULT;
+		ret = msmfb_blit_wait_fence(fence);
+		break;
+	}
+
 	/* Ioctl for setting ccs matrix from user space */
 	case MSMFB_SET_CCS_MATRIX:
 #ifndef CONFIG_FB_MSM_MDP40
@@ -2413,6 +2990,11 @@ int __init msm_fb_init(void)
 	if (msm_fb_register_driver())
 		return rc;
 
+	msmfb_blit_wq = create_singlethread_workqueue("msm_fb_blit");
+	if (!msmfb_blit_wq)
+		printk(KERN_ERR "msm_fb: no blit workqueue, "
+		       "MSMFB_ASYNC_BLIT disabled\n");
+
 #ifdef MSM_FB_ENABLE_DBGFS
 	{
 		struct dentry *root;
@@ -175,6 +175,32 @@ void msm_fb_add_device(struct platform_device *pdev);
 
 int msm_fb_detect_client(const char *name);
 
+int msmfb_blit_get_pinned(int memory_id, unsigned long *start,
+			  unsigned long *len, struct file **pp_file);
+int msmfb_blit_pinned(struct file *file);
+
+#ifdef CONFIG_NEON
+int msm_fb_neon_fillrect(struct fb_info *info, const struct fb_fillrect *rect);
+int msm_fb_neon_copyarea(struct fb_info *info, const struct fb_copyarea *area);
+int msm_fb_neon_imageblit(struct fb_info *info, const struct fb_image *image);
+#else
+static inline int msm_fb_neon_fillrect(struct fb_info *info,
+				       const struct fb_fillrect *rect)
+{
+	return -ENOSYS;
+}
+static inline int msm_fb_neon_copyarea(struct fb_info *info,
+				       const struct fb_copyarea *area)
+{
+	return -ENOSYS;
+}
+static inline int msm_fb_neon_imageblit(struct fb_info *info,
+					const struct fb_image *image)
+{
+	return -ENOSYS;
+}
+#endif
+
 #ifdef CONFIG_FB_BACKLIGHT
 void msm_fb_config_backlight(struct msm_fb_data_type *mfd);
 #endif
@@ -0,0 +1,498 @@
+/* drivers/video/msm/msm_fb_neon.c
+ *
+ * NEON versions of the console drawing helpers for 16 and 32 bpp.
+ * Each returns nonzero for requests it does not handle, and the caller
+ * then falls back to the cfb_* helper.  A self-test against the cfb
+ * helpers runs at boot; msm_fb/neon_bench in debugfs times both.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/fb.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/hardirq.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+#include <asm/neon.h>
+
+#include "msm_fb.h"
+
+void msm_fb_neon_fill(void *dst, u32 pattern, unsigned int len);
+void msm_fb_neon_copy(void *dst, const void *src, unsigned int len);
+void msm_fb_neon_expand16(void *dst, const u8 *bits, unsigned int nbytes,
+			  u32 fg, u32 bg);
+void msm_fb_neon_expand32(void *dst, const u8 *bits, unsigned int nbytes,
+			  u32 fg, u32 bg);
+
+static int fb_neon = 1;
+module_param(fb_neon, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(fb_neon, "use NEON for console fill/copy/imageblit");
+
+/* rows drawn between preemption points */
+#define NEON_ROWS_PER_SECTION	64
+
+static int msm_fb_neon_usable(struct fb_info *info)
+{
+	u32 bpp = info->var.bits_per_pixel;
+
+	if (!fb_neon || !cpu_has_neon() || in_interrupt())
+		return 0;
+	if (bpp != 16 && bpp != 32)
+		return 0;
+	return !(info->fix.line_length & 15);
+}
+
+static u32 msm_fb_neon_color(struct fb_info *info, u32 color)
+{
+	if (info->fix.visual == FB_VISUAL_TRUECOLOR ||
+	    info->fix.visual == FB_VISUAL_DIRECTCOLOR)
+		return ((u32 *)info->pseudo_palette)[color];
+	return color;
+}
+
+static inline void put_px(u8 __iomem *p, unsigned int Bpp, u32 c)
+{
+	if (Bpp == 2)
+		fb_writew(c, p);
+	else
+		fb_writel(c, p);
+}
+
+static inline u32 get_px(u8 __iomem *p, unsigned int Bpp)
+{
+	return Bpp == 2 ? fb_readw(p) : fb_readl(p);
+}
+
+static void neon_fill_row(u8 __iomem *dst, unsigned int Bpp, u32 color,
+			  u32 pattern, unsigned int n)
+{
+	unsigned int body;
+
+	while (n && ((unsigned long)dst & 15)) {
+		put_px(dst, Bpp, color);
+		dst += Bpp;
+		n--;
+	}
+	body = (n * Bpp) & ~15;
+	if (body) {
+		msm_fb_neon_fill((void __force *)dst, pattern, body);
+		dst += body;
+		n -= body / Bpp;
+	}
+	while (n--) {
+		put_px(dst, Bpp, color);
+		dst += Bpp;
+	}
+}
+
+int msm_fb_neon_fillrect(struct fb_info *info, const struct fb_fillrect *rect)
+{
+	unsigned int Bpp = info->var.bits_per_pixel / 8;
+	u32 ll = info->fix.line_length;
+	u8 __iomem *dst;
+	u32 color, pattern;
+	int y;
+
+	if (!msm_fb_neon_usable(info) || rect->rop != ROP_COPY)
+		return -EINVAL;
+	if (info->state != FBINFO_STATE_RUNNING)
+		return 0;
+
+	color = msm_fb_neon_color(info, rect->color);
+	if (Bpp == 2) {
+		color &= 0xffff;
+		pattern = color | (color << 16);
+	} else
+		pattern = color;
+
+	dst = info->screen_base + rect->dy * ll + rect->dx * Bpp;
+	kernel_neon_begin();
+	for (y = 0; y < rect->height; y++) {
+		if (y && !(y % NEON_ROWS_PER_SECTION)) {
+			kernel_neon_end();
+			kernel_neon_begin();
+		}
+		neon_fill_row(dst, Bpp, color, pattern, rect->width);
+		dst += ll;
+	}
+	kernel_neon_end();
+	return 0;
+}
+
+static void neon_copy_row(u8 __iomem *dst, u8 __iomem *src, unsigned int Bpp,
+			  unsigned int n)
+{
+	unsigned int body;
+
+	while (n && ((unsigned long)dst & 15)) {
+		put_px(dst, Bpp, get_px(src, Bpp));
+		dst += Bpp;
+		src += Bpp;
+		n--;
+	}
+	body = (n * Bpp) & ~15;
+	if (body) {
+		msm_fb_neon_copy((void __force *)dst, (void __force *)src,
+				 body);
+		dst += body;
+		src += body;
+		n -= body / Bpp;
+	}
+	while (n--) {
+		put_px(dst, Bpp, get_px(src, Bpp));
+		dst += Bpp;
+		src += Bpp;
+	}
+}
+
+int msm_fb_neon_copyarea(struct fb_info *info, const struct fb_copyarea *area)
+{
+	unsigned int Bpp = info->var.bits_per_pixel / 8;
+	long ll = info->fix.line_length;
+	u8 __iomem *dst, *src;
+	int y;
+
+	if (!msm_fb_neon_usable(info))
+		return -EINVAL;
+	if (info->state != FBINFO_STATE_RUNNING)
+		return 0;
+
+	dst = info->screen_base + area->dy * ll + area->dx * Bpp;
+	src = info->screen_base + area->sy * ll + area->sx * Bpp;
+
+	/* the aligned NEON loads and stores need matching alignment */
+	if ((dst - src) & 15)
+		return -EINVAL;
+	/* rows are copied forwards: no overlap to the right on one row */
+	if (area->dy == area->sy && area->dx > area->sx &&
+	    area->dx < area->sx + area->width)
+		return -EINVAL;
+
+	if (area->dy > area->sy) {
+		/* moving down: start at the bottom */
+		dst += (area->height - 1) * ll;
+		src += (area->height - 1) * ll;
+		ll = -ll;
+	}
+
+	kernel_neon_begin();
+	for (y = 0; y < area->height; y++) {
+		if (y && !(y % NEON_ROWS_PER_SECTION)) {
+			kernel_neon_end();
+			kernel_neon_begin();
+		}
+		neon_copy_row(dst, src, Bpp, area->width);
+		dst += ll;
+		src += ll;
+	}
+	kernel_neon_end();
+	return 0;
+}
+
+int msm_fb_neon_imageblit(struct fb_info *info, const struct fb_image *image)
+{
+	unsigned int Bpp = info->var.bits_per_pixel / 8;
+	u32 ll = info->fix.line_length;
+	unsigned int spitch = image->width / 8;
+	const u8 *bits = (const u8 *)image->data;
+	u8 __iomem *dst;
+	u32 fg, bg;
+	int y;
+
+	if (!msm_fb_neon_usable(info))
+		return -EINVAL;
+	if (image->depth != 1 || (image->width & 7))
+		return -EINVAL;
+
+	dst = info->screen_base + image->dy * ll + image->dx * Bpp;
+	if ((unsigned long)dst & 15)
+		return -EINVAL;
+	if (info->state != FBINFO_STATE_RUNNING)
+		return 0;
+
+	fg = msm_fb_neon_color(info, image->fg_color);
+	bg = msm_fb_neon_color(info, image->bg_color);
+
+	kernel_neon_begin();
+	for (y = 0; y < image->height; y++) {
+		if (y && !(y % NEON_ROWS_PER_SECTION)) {
+			kernel_neon_end();
+			kernel_neon_begin();
+		}
+		if (Bpp == 2)
+			msm_fb_neon_expand16((void __force *)dst, bits, spitch,
+					     fg, bg);
+		else
+			msm_fb_neon_expand32((void __force *)dst, bits, spitch,
+					     fg, bg);
+		bits += spitch;
+		dst += ll;
+	}
+	kernel_neon_end();
+	return 0;
+}
+
+/*
+ * Self-test and benchmark.  Both run on kmalloc'ed scratch framebuffers,
+ * one drawn by cfb and one by NEON, which must end up identical.
+ */
+#define TEST_XRES	240
+#define TEST_YRES	64
+#define TEST_ROUNDS	200
+
+static struct fb_ops msm_fb_neon_test_ops;
+static u32 msm_fb_neon_test_palette[16];
+
+static int msm_fb_neon_test_init(struct fb_info *fbi, unsigned int bpp)
+{
+	int i;
+
+	/* real 16 bpp palettes only hold 16 bit pixels */
+	for (i = 0; i < ARRAY_SIZE(msm_fb_neon_test_palette); i++)
+		if (bpp == 16)
+			msm_fb_neon_test_palette[i] &= 0xffff;
+
+	memset(fbi, 0, sizeof(*fbi));
+	fbi->fbops = &msm_fb_neon_test_ops;
+	fbi->pseudo_palette = msm_fb_neon_test_palette;
+	fbi->state = FBINFO_STATE_RUNNING;
+	fbi->fix.visual = FB_VISUAL_TRUECOLOR;
+	fbi->fix.line_length = TEST_XRES * bpp / 8;
+	fbi->var.bits_per_pixel = bpp;
+	fbi->var.xres = TEST_XRES;
+	fbi->var.yres = TEST_YRES;
+	fbi->screen_base = kzalloc(fbi->fix.line_length * TEST_YRES,
+				   GFP_KERNEL);
+	return fbi->screen_base ? 0 : -ENOMEM;
+}
+
+static u32 rnd(u32 n)
+{
+	return random32() % n;
+}
+
+/* one random operation of the given kind, the same on both buffers */
+static int msm_fb_neon_test_op(struct fb_info *ref, struct fb_info *neon,
+			       int kind, u8 *glyphs)
+{
+	struct fb_fillrect rect;
+	struct fb_copyarea area;
+	struct fb_image image;
+	int ret;
+
+	switch (kind) {
+	case 0:
+		rect.dx = rnd(TEST_XRES);
+		rect.dy = rnd(TEST_YRES);
+		rect.width = 1 + rnd(TEST_XRES - rect.dx);
+		rect.height = 1 + rnd(TEST_YRES - rect.dy);
+		rect.color = rnd(16);
+		rect.rop = ROP_COPY;
+		cfb_fillrect(ref, &rect);
+		ret = msm_fb_neon_fillrect(neon, &rect);
+		if (ret)
+			cfb_fillrect(neon, &rect);
+		return ret;
+	case 1:
+		area.width = 1 + rnd(TEST_XRES / 2);
+		area.height = 1 + rnd(TEST_YRES / 2);
+		area.sx = rnd(TEST_XRES - area.width);
+		area.sy = rnd(TEST_YRES - area.height);
+		area.dx = rnd(TEST_XRES - area.width);
+		area.dy = rnd(TEST_YRES - area.height);
+		cfb_copyarea(ref, &area);
+		ret = msm_fb_neon_copyarea(neon, &area);
+		if (ret)
+			cfb_copyarea(neon, &area);
+		return ret;
+	default:
+		image.width = 8 * (1 + rnd(TEST_XRES / 8 / 2));
+		image.height = 1 + rnd(16);
+		image.dx = 8 * rnd((TEST_XRES - image.width) / 8 + 1);
+		image.dy = rnd(TEST_YRES - image.height + 1);
+		image.fg_color = rnd(16);
+		image.bg_color = rnd(16);
+		image.depth = 1;
+		image.data = (const char *)glyphs + rnd(64);
+		cfb_imageblit(ref, &image);
+		ret = msm_fb_neon_imageblit(neon, &image);
+		if (ret)
+			cfb_imageblit(neon, &image);
+		return ret;
+	}
+}
+
+static int msm_fb_neon_selftest(void)
+{
+	struct fb_info *ref, *neon;
+	unsigned int bpps[] = { 16, 32 };
+	u8 *glyphs;
+	int i, b, ret = 0;
+	int handled = 0;
+
+	ref = kzalloc(2 * sizeof(*ref), GFP_KERNEL);
+	glyphs = kmalloc(64 + TEST_XRES / 8 * 16, GFP_KERNEL);
+	if (!ref || !glyphs) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	neon = ref + 1;
+	get_random_bytes(glyphs, 64 + TEST_XRES / 8 * 16);
+	get_random_bytes(msm_fb_neon_test_palette,
+			 sizeof(msm_fb_neon_test_palette));
+
+	for (b = 0; b < ARRAY_SIZE(bpps) && !ret; b++) {
+		ret = msm_fb_neon_test_init(ref, bpps[b]);
+		if (!ret)
+			ret = msm_fb_neon_test_init(neon, bpps[b]);
+		for (i = 0; i < TEST_ROUNDS && !ret; i++) {
+			if (!msm_fb_neon_test_op(ref, neon, i % 3, glyphs))
+				handled++;
+			if (memcmp(ref->screen_base, neon->screen_base,
+				   ref->fix.line_length * TEST_YRES)) {
+				printk(KERN_ERR "msm_fb: NEON self-test failed, "
+				       "%d bpp, op %d\n", bpps[b], i % 3);
+				ret = -EIO;
+			}
+		}
+		kfree(ref->screen_base);
+		kfree(neon->screen_base);
+	}
+	if (!ret)
+		printk(KERN_INFO "msm_fb: NEON self-test passed "
+		       "(%d of %d ops accelerated)\n",
+		       handled, 2 * TEST_ROUNDS);
+out:
+	kfree(glyphs);
+	kfree(ref);
+	return ret;
+}
+
+static ssize_t msm_fb_neon_bench_read(struct file *file, char __user *ubuf,
+				      size_t count, loff_t *ppos)
+{
+	struct fb_info *fbi;
+	struct fb_fillrect rect;
+	struct fb_copyarea area;
+	struct fb_image image;
+	unsigned int bpps[] = { 16, 32 };
+	char *buf;
+	u8 *glyphs;
+	ktime_t t0;
+	s64 us[6];
+	int b, i, len = 0;
+	ssize_t ret;
+
+	if (*ppos)
+		return 0;
+
+	fbi = kmalloc(sizeof(*fbi), GFP_KERNEL);
+	glyphs = kzalloc(TEST_XRES / 8 * 16, GFP_KERNEL);
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!fbi || !glyphs || !buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	rect.dx = rect.dy = 0;
+	rect.width = TEST_XRES;
+	rect.height = TEST_YRES;
+	rect.color = 1;
+	rect.rop = ROP_COPY;
+	area.sx = area.dx = 0;
+	area.sy = 16;
+	area.dy = 0;
+	area.width = TEST_XRES;
+	area.height = TEST_YRES - 16;
+	image.dx = image.dy = 0;
+	image.width = TEST_XRES;
+	image.height = 16;
+	image.fg_color = 1;
+	image.bg_color = 0;
+	image.depth = 1;
+	image.data = (const char *)glyphs;
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "%dx%d, us per %d ops: cfb / neon\n",
+			 TEST_XRES, TEST_YRES, TEST_ROUNDS);
+	for (b = 0; b < ARRAY_SIZE(bpps); b++) {
+		if (msm_fb_neon_test_init(fbi, bpps[b])) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+#define BENCH(slot, call)						\
+		do {							\
+			t0 = ktime_get();				\
+			for (i = 0; i < TEST_ROUNDS; i++)		\
+				call;					\
+			us[slot] = ktime_to_us(ktime_sub(ktime_get(), t0)); \
+		} while (0)
+
+		BENCH(0, cfb_fillrect(fbi, &rect));
+		BENCH(1, msm_fb_neon_fillrect(fbi, &rect));
+		BENCH(2, cfb_copyarea(fbi, &area));
+		BENCH(3, msm_fb_neon_copyarea(fbi, &area));
+		BENCH(4, cfb_imageblit(fbi, &image));
+		BENCH(5, msm_fb_neon_imageblit(fbi, &image));
+#undef BENCH
+		kfree(fbi->screen_base);
+
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%2d bpp fill %lld / %lld copy %lld / %lld "
+				 "blit %lld / %lld\n", bpps[b],
+				 us[0], us[1], us[2], us[3], us[4], us[5]);
+	}
+	if (!msm_fb_neon_usable(fbi))
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "(NEON disabled or unavailable: "
+				 "neon numbers are no-ops)\n");
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, buf, len);
+out:
+	kfree(buf);
+	kfree(glyphs);
+	kfree(fbi);
+	return ret;
+}
+
+static const struct file_operations msm_fb_neon_bench_fops = {
+	.read = msm_fb_neon_bench_read,
+};
+
+/* after vfp_init() has reported NEON in elf_hwcap */
+static int __init msm_fb_neon_init(void)
+{
+	if (!cpu_has_neon()) {
+		printk(KERN_INFO "msm_fb: no NEON, using cfb helpers\n");
+		fb_neon = 0;
+		return 0;
+	}
+
+	if (msm_fb_neon_selftest())
+		fb_neon = 0;
+
+#ifdef MSM_FB_ENABLE_DBGFS
+	{
+		struct dentry *root = msm_fb_get_debugfs_root();
+
+		if (root)
+			debugfs_create_file("neon_bench", S_IRUSR, root, NULL,
+					    &msm_fb_neon_bench_fops);
+	}
+#endif
+	return 0;
+}
+late_initcall(msm_fb_neon_init);
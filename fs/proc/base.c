@@ -1099,6 +1099,66 @@ static const struct file_operations proc_oom_adjust_operations = {
 	.write		= oom_adjust_write,
 };
 
+static ssize_t latency_sensitive_read(struct file *file, char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct task_struct *task = get_proc_task(file->f_path.dentry->d_inode);
+	char buffer[PROC_NUMBUF];
+	size_t len;
+	unsigned int latency_sensitive;
+
+	if (!task)
+		return -ESRCH;
+	latency_sensitive = task->latency_sensitive;
+	put_task_struct(task);
+
+	len = snprintf(buffer, sizeof(buffer), "%u\n", latency_sensitive);
+
+	return simple_read_from_buffer(buf, count, ppos, buffer, len);
+}
+
+static ssize_t latency_sensitive_write(struct file *file,
+				       const char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	struct task_struct *task;
+	char buffer[PROC_NUMBUF], *end;
+	unsigned long latency_sensitive;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+	latency_sensitive = simple_strtoul(buffer, &end, 0);
+	if (latency_sensitive > 1)
+		return -EINVAL;
+	if (*end == '\n')
+		end++;
+	if (end - buffer == 0)
+		return -EIO;
+	/* like a nice boost: CAP_SYS_NICE, or System Server */
+	if (latency_sensitive && !capable(CAP_SYS_NICE) &&
+	    current_fsuid() != 1000)
+		return -EPERM;
+	task = get_proc_task(file->f_path.dentry->d_inode);
+	if (!task)
+		return -ESRCH;
+	task->latency_sensitive = latency_sensitive;
+	put_task_struct(task);
+	return end - buffer;
+}
+
+/* System Server may mark application threads just as it sets oom_adj */
+static const struct inode_operations proc_latency_sensitive_inode_operations = {
+	.permission	= oom_adjust_permission,
+};
+
+static const struct file_operations proc_latency_sensitive_operations = {
+	.read		= latency_sensitive_read,
+	.write		= latency_sensitive_write,
+};
+
 #ifdef CONFIG_AUDITSYSCALL
 #define TMPBUFLEN 21
 static ssize_t proc_loginuid_read(struct file * file, char __user * buf,
@@ -2585,6 +2645,7 @@ static const struct pid_entry tgid_base_stuff[] = {
 #endif
 	INF("oom_score",  S_IRUGO, proc_oom_score),
 	ANDROID("oom_adj",S_IRUGO|S_IWUSR, oom_adjust),
+	ANDROID("latency_sensitive", S_IRUGO|S_IWUSR, latency_sensitive),
 #ifdef CONFIG_AUDITSYSCALL
 	REG("loginuid",   S_IWUSR|S_IRUGO, proc_loginuid_operations),
 	REG("sessionid",  S_IRUGO, proc_sessionid_operations),
@@ -2923,6 +2984,7 @@ static const struct pid_entry tid_base_stuff[] = {
 #endif
 	INF("oom_score", S_IRUGO, proc_oom_score),
 	REG("oom_adj",   S_IRUGO|S_IWUSR, proc_oom_adjust_operations),
+	ANDROID("latency_sensitive", S_IRUGO|S_IWUSR, latency_sensitive),
 #ifdef CONFIG_AUDITSYSCALL
 	REG("loginuid",  S_IWUSR|S_IRUGO, proc_loginuid_operations),
 	REG("sessionid",  S_IRUSR, proc_sessionid_operations),
@@ -20,6 +20,7 @@
 #ifndef _LINUX_MEMCONTROL_H
 #define _LINUX_MEMCONTROL_H
 #include <linux/cgroup.h>
+#include <linux/ktime.h>
 struct mem_cgroup;
 struct page_cgroup;
 struct page;
@@ -97,6 +98,7 @@ extern void mem_cgroup_note_reclaim_priority(struct mem_cgroup *mem,
 extern void mem_cgroup_record_reclaim_priority(struct mem_cgroup *mem,
 							int priority);
 int mem_cgroup_inactive_anon_is_low(struct mem_cgroup *memcg);
+int mem_cgroup_inactive_file_is_low(struct mem_cgroup *memcg);
 unsigned long mem_cgroup_zone_nr_pages(struct mem_cgroup *memcg,
 				       struct zone *zone,
 				       enum lru_list lru);
@@ -118,6 +120,11 @@ static inline bool mem_cgroup_disabled(void)
 
 extern bool mem_cgroup_oom_called(struct task_struct *task);
 
+unsigned long mem_cgroup_soft_limit_reclaim(gfp_t gfp_mask,
+					    unsigned long nr_to_reclaim);
+void mem_cgroup_count_reclaim_stall(struct mm_struct *mm, ktime_t start);
+void mem_cgroup_count_refault(struct page *page, int activated);
+
 #else /* CONFIG_CGROUP_MEM_RES_CTLR */
 struct mem_cgroup;
 
@@ -250,6 +257,12 @@ mem_cgroup_inactive_anon_is_low(struct mem_cgroup *memcg)
 	return 1;
 }
 
+static inline int
+mem_cgroup_inactive_file_is_low(struct mem_cgroup *memcg)
+{
+	return 1;
+}
+
 static inline unsigned long
 mem_cgroup_zone_nr_pages(struct mem_cgroup *memcg, struct zone *zone,
 			 enum lru_list lru)
@@ -270,6 +283,21 @@ mem_cgroup_get_reclaim_stat_from_page(struct page *page)
 	return NULL;
 }
 
+static inline unsigned long
+mem_cgroup_soft_limit_reclaim(gfp_t gfp_mask, unsigned long nr_to_reclaim)
+{
+	return 0;
+}
+
+static inline void
+mem_cgroup_count_reclaim_stall(struct mm_struct *mm, ktime_t start)
+{
+}
+
+static inline void mem_cgroup_count_refault(struct page *page, int activated)
+{
+}
+
 #endif /* CONFIG_CGROUP_MEM_CONT */
 
 #endif /* _LINUX_MEMCONTROL_H */
@@ -1197,6 +1197,36 @@ void page_cache_async_readahead(struct address_space *mapping,
 
 unsigned long max_sane_readahead(unsigned long nr);
 
+#ifdef CONFIG_READAHEAD_TRACE
+extern int readahead_trace_active;
+void __readahead_trace_access(struct file *file, pgoff_t index, int cached);
+void __readahead_trace_fault(struct file *file, pgoff_t index);
+
+/* Record a page cache lookup for launch prefetching, see readahead_trace.c */
+static inline void readahead_trace_access(struct file *file, pgoff_t index,
+					  int cached)
+{
+	if (unlikely(readahead_trace_active))
+		__readahead_trace_access(file, index, cached);
+}
+
+/* The same for a mmap fault, called before the page is looked up */
+static inline void readahead_trace_fault(struct file *file, pgoff_t index)
+{
+	if (unlikely(readahead_trace_active))
+		__readahead_trace_fault(file, index);
+}
+#else
+static inline void readahead_trace_access(struct file *file, pgoff_t index,
+					  int cached)
+{
+}
+
+static inline void readahead_trace_fault(struct file *file, pgoff_t index)
+{
+}
+#endif
+
 /* Do stack extension */
 extern int expand_stack(struct vm_area_struct *vma, unsigned long address);
 #ifdef CONFIG_IA64
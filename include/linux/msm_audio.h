@@ -83,6 +83,10 @@
 #define AUDIO_SET_AGC        _IOW(AUDIO_IOCTL_MAGIC, 90, unsigned)
 #define AUDIO_SET_NS         _IOW(AUDIO_IOCTL_MAGIC, 91, unsigned)
 #define AUDIO_SET_TX_IIR     _IOW(AUDIO_IOCTL_MAGIC, 92, unsigned)
+#define AUDIO_SET_MMAP_CONFIG _IOW(AUDIO_IOCTL_MAGIC, 93, \
+		struct msm_audio_mmap_config)
+#define AUDIO_GET_MMAP_CONFIG _IOR(AUDIO_IOCTL_MAGIC, 94, \
+		struct msm_audio_mmap_config)
 
 #define	AUDIO_MAX_COMMON_IOCTL_NUM	100
 
@@ -148,6 +152,27 @@ struct msm_audio_stream_config {
 	uint32_t buffer_count;
 };
 
+/* Layout of an mmap'd PCM ring: a status page (struct
+ * msm_audio_mmap_status) at status_offset followed by period_count
+ * periods of period_size bytes at ring_offset. */
+struct msm_audio_mmap_config {
+	uint32_t period_size;
+	uint32_t period_count;
+	uint32_t status_offset;	/* filled in by AUDIO_GET_MMAP_CONFIG */
+	uint32_t ring_offset;	/* filled in by AUDIO_GET_MMAP_CONFIG */
+};
+
+/* hw_ptr and appl_ptr are free running byte counts, reset to zero on
+ * flush. The driver advances hw_ptr a period at a time as the DSP takes
+ * data from the ring, the application advances appl_ptr after writing
+ * into it; appl_ptr - hw_ptr is the amount queued. */
+struct msm_audio_mmap_status {
+	uint32_t hw_ptr;
+	uint32_t appl_ptr;
+	uint32_t underruns;	/* periods of silence sent to the DSP */
+	uint32_t unused[5];
+};
+
 struct msm_audio_stats {
 	uint32_t byte_count;
 	uint32_t sample_count;
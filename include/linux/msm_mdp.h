@@ -41,6 +41,11 @@
 #define MSMFB_OVERLAY_GET      _IOR(MSMFB_IOCTL_MAGIC, 140, \
 						struct mdp_overlay)
 #define MSMFB_OVERLAY_PLAY_ENABLE     _IOW(MSMFB_IOCTL_MAGIC, 141, unsigned int)
+#define MSMFB_ASYNC_BLIT       _IOWR(MSMFB_IOCTL_MAGIC, 142, \
+						struct mdp_async_blit_req_list)
+#define MSMFB_BLIT_WAIT        _IOW(MSMFB_IOCTL_MAGIC, 143, unsigned int)
+#define MSMFB_DISPLAY_DIRTY    _IOW(MSMFB_IOCTL_MAGIC, 144, \
+						struct mdp_dirty_rects)
 
 #define MDP_IMGTYPE2_START 0x10000
 
@@ -148,6 +153,29 @@ struct mdp_blit_req_list {
 	struct mdp_blit_req req[];
 };
 
+/*
+ * MSMFB_ASYNC_BLIT queues the whole list and returns at once; the fence
+ * it hands back can be passed to MSMFB_BLIT_WAIT to wait for the list
+ * (and every list queued before it) to be done.  The wait returns the
+ * error, if any, of that list alone.
+ */
+struct mdp_async_blit_req_list {
+	uint32_t fence;		/* out */
+	uint32_t count;
+	struct mdp_blit_req req[];
+};
+
+/*
+ * MSMFB_DISPLAY_DIRTY pushes only the given rectangles of the frame
+ * currently panned to, on panels that can take partial updates.
+ */
+#define MDP_DIRTY_RECTS_MAX 16
+
+struct mdp_dirty_rects {
+	uint32_t count;
+	struct mdp_rect rect[MDP_DIRTY_RECTS_MAX];
+};
+
 struct msmfb_data {
 	uint32_t offset;
 	int memory_id;
@@ -1152,6 +1152,7 @@ struct task_struct {
 #endif
 
 	unsigned int policy;
+	unsigned int latency_sensitive;	/* CFS wakeup/slice hint */
 	cpumask_t cpus_allowed;
 
 #ifdef CONFIG_PREEMPT_RCU
@@ -174,6 +174,14 @@ extern unsigned int nr_free_pagecache_pages(void);
 #define nr_free_pages() global_page_state(NR_FREE_PAGES)
 
 
+/* linux/mm/workingset.c */
+extern atomic_long_t workingset_shadows;
+void *workingset_eviction(struct address_space *mapping, struct page *page);
+int workingset_refault(struct page *page, void *shadow);
+void workingset_activation(struct page *page);
+void workingset_track_mapping(struct address_space *mapping);
+void workingset_forget_mapping(struct address_space *mapping);
+
 /* linux/mm/swap.c */
 extern void __lru_cache_add(struct page *, enum lru_list lru);
 extern void lru_cache_add_lru(struct page *, enum lru_list lru);
@@ -38,6 +38,14 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		FOR_ALL_ZONES(PGSCAN_DIRECT),
 		PGINODESTEAL, SLABS_SCANNED, KSWAPD_STEAL, KSWAPD_INODESTEAL,
 		PAGEOUTRUN, ALLOCSTALL, PGROTATED,
+		PGALLOC_HIGHORDER, PGALLOC_HIGHORDER_USECS,
+		PGALLOC_HIGHORDER_SLOW,	/* took 1ms or longer */
+		PGALLOC_PCP_HIGHORDER_HIT, PGALLOC_PCP_HIGHORDER_MISS,
+		ZONE_LOCK_CONTENDED,
+#ifdef CONFIG_COMPACTION
+		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
+		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+#endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
 #endif
@@ -279,6 +279,8 @@ struct task_group {
 	/* runqueue "owned" by this group on each cpu */
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
+	/* wakeup preemption and short slices, see sched_fair.c */
+	int latency_sensitive;
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -531,6 +533,22 @@ static struct root_domain def_root_domain;
 
 #endif
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * Scheduling latency histogram classes.  Bucket i counts runqueue waits
+ * shorter than 2^(10+i) ns; the last bucket takes everything longer.
+ */
+enum {
+	SCHED_LAT_RT,
+	SCHED_LAT_LATENCY,	/* latency sensitive CFS tasks */
+	SCHED_LAT_FAIR,
+	SCHED_LAT_BATCH,	/* SCHED_BATCH and SCHED_IDLE */
+	SCHED_LAT_NR_CLASSES,
+};
+
+#define SCHED_LAT_BUCKETS	16
+#endif
+
 /*
  * This is the main, per-CPU runqueue data structure.
  *
@@ -634,6 +652,9 @@ struct rq {
 
 	/* BKL stats */
 	unsigned int bkl_count;
+
+	/* scheduling latency histograms, see sched_stats.h */
+	unsigned int lat_hist[SCHED_LAT_NR_CLASSES][SCHED_LAT_BUCKETS];
 #endif
 };
 
@@ -1654,6 +1675,21 @@ static void cfs_rq_set_shares(struct cfs_rq *cfs_rq, unsigned long shares)
 }
 #endif
 
+/*
+ * A task is latency sensitive if it is marked itself or, with group
+ * scheduling, if its task group is.
+ */
+static inline int task_latency_sensitive(struct task_struct *p)
+{
+	if (p->latency_sensitive)
+		return 1;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	return task_group(p)->latency_sensitive;
+#else
+	return 0;
+#endif
+}
+
 #include "sched_stats.h"
 #include "sched_idletask.c"
 #include "sched_fair.c"
@@ -2437,6 +2473,12 @@ void sched_fork(struct task_struct *p, int clone_flags)
 	if (!rt_prio(p->prio))
 		p->sched_class = &fair_sched_class;
 
+	/*
+	 * The latency hint is granted per thread; a child has to be marked
+	 * again, so that it does not spread through a whole process tree:
+	 */
+	p->latency_sensitive = 0;
+
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
 	if (likely(sched_info_on()))
 		memset(&p->sched_info, 0, sizeof(p->sched_info));
@@ -9443,6 +9485,25 @@ static u64 cpu_shares_read_u64(struct cgroup *cgrp, struct cftype *cft)
 
 	return (u64) tg->shares;
 }
+
+static int cpu_latency_sensitive_write_u64(struct cgroup *cgrp,
+					   struct cftype *cftype, u64 val)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+
+	/* the root group has no entity to favour */
+	if (tg == &init_task_group || val > 1)
+		return -EINVAL;
+
+	tg->latency_sensitive = val;
+	return 0;
+}
+
+static u64 cpu_latency_sensitive_read_u64(struct cgroup *cgrp,
+					  struct cftype *cft)
+{
+	return (u64) cgroup_tg(cgrp)->latency_sensitive;
+}
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -9476,6 +9537,11 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_shares_read_u64,
 		.write_u64 = cpu_shares_write_u64,
 	},
+	{
+		.name = "latency_sensitive",
+		.read_u64 = cpu_latency_sensitive_read_u64,
+		.write_u64 = cpu_latency_sensitive_write_u64,
+	},
 #endif
 #ifdef CONFIG_RT_GROUP_SCHED
 	{
@@ -243,6 +243,25 @@ find_matching_se(struct sched_entity **se, struct sched_entity **pse)
 
 #endif	/* CONFIG_FAIR_GROUP_SCHED */
 
+/*
+ * Latency sensitive entities are tasks marked through
+ * /proc/<pid>/latency_sensitive and groups marked through the cpu
+ * cgroup's latency_sensitive file.  They preempt ordinary entities on
+ * wakeup without the wakeup granularity and run in slices of at most
+ * sysctl_sched_min_granularity.  Their weight is left alone, so they
+ * get the cpu sooner but not for longer.
+ */
+static inline int entity_latency_sensitive(struct sched_entity *se)
+{
+	if (!sched_feat(LATENCY_HINTS))
+		return 0;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	if (!entity_is_task(se))
+		return group_cfs_rq(se)->tg->latency_sensitive;
+#endif
+	return task_of(se)->latency_sensitive;
+}
+
 
 /**************************************************************
  * Scheduling class tree data structure manipulation methods:
@@ -455,6 +474,20 @@ static u64 sched_vslice(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	return calc_delta_fair(sched_slice(cfs_rq, se), se);
 }
 
+/*
+ * The wall-time slice the entity may run before being preempted by
+ * the tick: latency sensitive entities get short slices.
+ */
+static u64 sched_run_slice(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	u64 slice = sched_slice(cfs_rq, se);
+
+	if (entity_latency_sensitive(se))
+		slice = min_t(u64, slice, sysctl_sched_min_granularity);
+
+	return slice;
+}
+
 /*
  * Update the current task's runtime statistics. Skip current tasks that
  * are not in our scheduling class.
@@ -771,8 +804,9 @@ static void
 check_preempt_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 {
 	unsigned long ideal_runtime, delta_exec;
+	struct sched_entity *first;
 
-	ideal_runtime = sched_slice(cfs_rq, curr);
+	ideal_runtime = sched_run_slice(cfs_rq, curr);
 	delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
 	if (delta_exec > ideal_runtime) {
 		resched_task(rq_of(cfs_rq)->curr);
@@ -781,7 +815,22 @@ check_preempt_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 		 * re-elected due to buddy favours.
 		 */
 		clear_buddies(cfs_rq, curr);
+		return;
 	}
+
+	/*
+	 * A latency sensitive entity queued behind an ordinary one need
+	 * not wait out the rest of its slice once the minimum granularity
+	 * has been served.
+	 */
+	if (delta_exec < sysctl_sched_min_granularity ||
+	    entity_latency_sensitive(curr))
+		return;
+
+	first = __pick_next_entity(cfs_rq);
+	if (first && entity_latency_sensitive(first) &&
+	    (s64)(first->vruntime - curr->vruntime) < 0)
+		resched_task(rq_of(cfs_rq)->curr);
 }
 
 static void
@@ -890,7 +939,7 @@ static void hrtick_start_fair(struct rq *rq, struct task_struct *p)
 	WARN_ON(task_rq(p) != rq);
 
 	if (hrtick_enabled(rq) && cfs_rq->nr_running > 1) {
-		u64 slice = sched_slice(cfs_rq, se);
+		u64 slice = sched_run_slice(cfs_rq, se);
 		u64 ran = se->sum_exec_runtime - se->prev_sum_exec_runtime;
 		s64 delta = slice - ran;
 
@@ -1351,6 +1400,9 @@ wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 		return -1;
 
 	gran = wakeup_gran(curr);
+	/* latency sensitive entities preempt ordinary ones right away */
+	if (entity_latency_sensitive(se) && !entity_latency_sensitive(curr))
+		gran = 0;
 	if (vdiff > gran)
 		return 1;
 
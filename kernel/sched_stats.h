@@ -4,7 +4,14 @@
  * bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 14
+#define SCHEDSTAT_VERSION 15
+
+static const char *sched_lat_class_names[SCHED_LAT_NR_CLASSES] = {
+	[SCHED_LAT_RT]		= "rt",
+	[SCHED_LAT_LATENCY]	= "latency",
+	[SCHED_LAT_FAIR]	= "fair",
+	[SCHED_LAT_BATCH]	= "batch",
+};
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
@@ -19,6 +26,7 @@ static int show_schedstat(struct seq_file *seq, void *v)
 	seq_printf(seq, "timestamp %lu\n", jiffies);
 	for_each_online_cpu(cpu) {
 		struct rq *rq = cpu_rq(cpu);
+		int class, bucket;
 #ifdef CONFIG_SMP
 		struct sched_domain *sd;
 		int dcount = 0;
@@ -36,6 +44,15 @@ static int show_schedstat(struct seq_file *seq, void *v)
 
 		seq_printf(seq, "\n");
 
+		/* scheduling latency histograms of this runqueue */
+		for (class = 0; class < SCHED_LAT_NR_CLASSES; class++) {
+			seq_printf(seq, "lat_%s", sched_lat_class_names[class]);
+			for (bucket = 0; bucket < SCHED_LAT_BUCKETS; bucket++)
+				seq_printf(seq, " %u",
+					   rq->lat_hist[class][bucket]);
+			seq_printf(seq, "\n");
+		}
+
 #ifdef CONFIG_SMP
 		/* domain-specific stats */
 		preempt_disable();
@@ -133,6 +150,32 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 	if (rq)
 		rq->rq_sched_info.run_delay += delta;
 }
+
+static inline int sched_lat_class(struct task_struct *t)
+{
+	if (rt_task(t))
+		return SCHED_LAT_RT;
+	if (t->policy == SCHED_BATCH || t->policy == SCHED_IDLE)
+		return SCHED_LAT_BATCH;
+	if (task_latency_sensitive(t))
+		return SCHED_LAT_LATENCY;
+	return SCHED_LAT_FAIR;
+}
+
+/*
+ * Expects runqueue lock to be held for atomicity of update
+ */
+static inline void
+rq_sched_lat_hist(struct rq *rq, struct task_struct *t,
+		  unsigned long long delta)
+{
+	int bucket = fls64(delta >> 10);
+
+	if (bucket >= SCHED_LAT_BUCKETS)
+		bucket = SCHED_LAT_BUCKETS - 1;
+	if (rq)
+		rq->lat_hist[sched_lat_class(t)][bucket]++;
+}
 # define schedstat_inc(rq, field)	do { (rq)->field++; } while (0)
 # define schedstat_add(rq, field, amt)	do { (rq)->field += (amt); } while (0)
 # define schedstat_set(var, val)	do { var = (val); } while (0)
@@ -146,6 +189,10 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 static inline void
 rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 {}
+static inline void
+rq_sched_lat_hist(struct rq *rq, struct task_struct *t,
+		  unsigned long long delta)
+{}
 # define schedstat_inc(rq, field)	do { } while (0)
 # define schedstat_add(rq, field, amt)	do { } while (0)
 # define schedstat_set(var, val)	do { } while (0)
@@ -201,6 +248,7 @@ static void sched_info_arrive(struct task_struct *t)
 	t->sched_info.pcount++;
 
 	rq_sched_info_arrive(task_rq(t), delta);
+	rq_sched_lat_hist(task_rq(t), t, delta);
 }
 
 /*
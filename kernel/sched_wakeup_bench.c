@@ -0,0 +1,209 @@
+/*
+ * CFS wakeup latency benchmark
+ *
+ * Wakes a sleeping thread once per tick while a number of cpu hogs keep
+ * its cpu busy, and measures the time from wake_up_process() until the
+ * woken thread runs.  The run is done twice, with the woken thread
+ * ordinary and marked latency sensitive, and percentiles of both runs
+ * are printed when the module is loaded:
+ *
+ *	modprobe sched_wakeup_bench nr_hogs=4 loops=500
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/sort.h>
+
+#define BENCH_MAX_HOGS	32
+
+static int nr_hogs;
+module_param(nr_hogs, int, 0444);
+MODULE_PARM_DESC(nr_hogs, "Busy looping threads (default: 2)");
+
+static int loops = 200;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "Wakeups measured per run");
+
+static int target_cpu = -1;
+module_param_named(cpu, target_cpu, int, 0444);
+MODULE_PARM_DESC(cpu, "Cpu the threads are bound to (default: first online)");
+
+struct wake_bench {
+	struct task_struct *wakee;
+	struct completion done;
+	ktime_t woken_at;
+	int pending;
+	int latency_sensitive;
+	int nr_samples;
+	u64 *samples;
+};
+
+static void bench_park(void)
+{
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+}
+
+static int bench_hog_fn(void *data)
+{
+	set_user_nice(current, 0);
+	while (!kthread_should_stop())
+		cond_resched();
+	return 0;
+}
+
+static int bench_wakee_fn(void *data)
+{
+	struct wake_bench *wb = data;
+	ktime_t now;
+
+	set_user_nice(current, 0);
+	current->latency_sensitive = wb->latency_sensitive;
+
+	while (wb->nr_samples < loops) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		while (!ACCESS_ONCE(wb->pending)) {
+			schedule();
+			set_current_state(TASK_UNINTERRUPTIBLE);
+		}
+		__set_current_state(TASK_RUNNING);
+
+		now = ktime_get();
+		smp_rmb();
+		wb->samples[wb->nr_samples++] =
+			ktime_to_ns(ktime_sub(now, wb->woken_at));
+		wb->pending = 0;
+	}
+	complete(&wb->done);
+
+	bench_park();
+	return 0;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	if (x < y)
+		return -1;
+	return x > y;
+}
+
+static u64 bench_percentile(struct wake_bench *wb, int pct)
+{
+	return wb->samples[(wb->nr_samples - 1) * pct / 100];
+}
+
+static int bench_run(int bench_cpu, int latency_sensitive)
+{
+	struct task_struct *hogs[BENCH_MAX_HOGS];
+	struct wake_bench wb;
+	u64 sum = 0;
+	int i, started = 0, ret = 0;
+
+	memset(&wb, 0, sizeof(wb));
+	wb.latency_sensitive = latency_sensitive;
+	init_completion(&wb.done);
+	wb.samples = kcalloc(loops, sizeof(*wb.samples), GFP_KERNEL);
+	if (!wb.samples)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_hogs; i++) {
+		hogs[i] = kthread_create(bench_hog_fn, NULL,
+					 "wakeup_bench_hog/%d", i);
+		if (IS_ERR(hogs[i])) {
+			ret = PTR_ERR(hogs[i]);
+			goto out_hogs;
+		}
+		kthread_bind(hogs[i], bench_cpu);
+		wake_up_process(hogs[i]);
+		started++;
+	}
+
+	wb.wakee = kthread_create(bench_wakee_fn, &wb, "wakeup_bench");
+	if (IS_ERR(wb.wakee)) {
+		ret = PTR_ERR(wb.wakee);
+		goto out_hogs;
+	}
+	kthread_bind(wb.wakee, bench_cpu);
+	wake_up_process(wb.wakee);
+
+	/* One wakeup per tick, skipping ticks the last one is still queued */
+	while (!completion_done(&wb.done)) {
+		schedule_timeout_uninterruptible(1);
+		if (ACCESS_ONCE(wb.pending))
+			continue;
+		wb.woken_at = ktime_get();
+		smp_wmb();
+		wb.pending = 1;
+		wake_up_process(wb.wakee);
+	}
+	kthread_stop(wb.wakee);
+
+	sort(wb.samples, wb.nr_samples, sizeof(*wb.samples), bench_cmp, NULL);
+	for (i = 0; i < wb.nr_samples; i++)
+		sum += wb.samples[i];
+
+	pr_info("sched_wakeup_bench: cpu %d hogs %d latency_sensitive %d: "
+		"avg %llu p50 %llu p90 %llu p99 %llu max %llu ns\n",
+		bench_cpu, nr_hogs, latency_sensitive,
+		(unsigned long long)div64_u64(sum, wb.nr_samples),
+		(unsigned long long)bench_percentile(&wb, 50),
+		(unsigned long long)bench_percentile(&wb, 90),
+		(unsigned long long)bench_percentile(&wb, 99),
+		(unsigned long long)wb.samples[wb.nr_samples - 1]);
+
+out_hogs:
+	for (i = 0; i < started; i++)
+		kthread_stop(hogs[i]);
+	kfree(wb.samples);
+	return ret;
+}
+
+static int __init sched_wakeup_bench_init(void)
+{
+	int ret;
+
+	if (loops < 1)
+		return -EINVAL;
+	if (nr_hogs <= 0)
+		nr_hogs = 2;
+	if (nr_hogs > BENCH_MAX_HOGS)
+		return -EINVAL;
+	if (target_cpu < 0)
+		target_cpu = first_cpu(cpu_online_map);
+	if (target_cpu >= nr_cpu_ids || !cpu_online(target_cpu))
+		return -EINVAL;
+
+	ret = bench_run(target_cpu, 0);
+	if (!ret)
+		ret = bench_run(target_cpu, 1);
+	return ret;
+}
+
+static void __exit sched_wakeup_bench_exit(void)
+{
+}
+
+module_init(sched_wakeup_bench_init);
+module_exit(sched_wakeup_bench_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("CFS wakeup latency benchmark");
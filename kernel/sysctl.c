@@ -48,6 +48,7 @@
 #include <linux/acpi.h>
 #include <linux/reboot.h>
 #include <linux/ftrace.h>
+#include <linux/compaction.h>
 
 #include <asm/uaccess.h>
 #include <asm/processor.h>
@@ -105,6 +106,9 @@ static int two = 2;
 #endif
 
 static int zero;
+#ifdef CONFIG_COMPACTION
+static int max_compact_order = MAX_ORDER - 1;
+#endif
 static unsigned long one_ul = 1;
 static int one_hundred = 100;
 
@@ -1118,6 +1122,47 @@ static struct ctl_table vm_table[] = {
 		.strategy	= &sysctl_intvec,
 		.extra1		= &min_percpu_pagelist_fract,
 	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "percpu_highorder_high",
+		.data		= &percpu_highorder_high,
+		.maxlen		= sizeof(percpu_highorder_high),
+		.mode		= 0644,
+		.proc_handler	= &percpu_highorder_sysctl_handler,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+	},
+#ifdef CONFIG_COMPACTION
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "compact_memory",
+		.data		= &sysctl_compact_memory,
+		.maxlen		= sizeof(int),
+		.mode		= 0200,
+		.proc_handler	= &sysctl_compaction_handler,
+	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "compact_idle_order",
+		.data		= &sysctl_compact_idle_order,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+		.extra2		= &max_compact_order,
+	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "compact_idle_interval",
+		.data		= &sysctl_compact_idle_interval,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+	},
+#endif
 #ifdef CONFIG_MMU
 	{
 		.ctl_name	= VM_MAX_MAP_COUNT,
@@ -0,0 +1,655 @@
+/*
+ * linux/mm/compaction.c
+ *
+ * Memory compaction for the reduction of external fragmentation. Movable
+ * pages are migrated from the start of a zone into free pages isolated
+ * from its end, so that free memory gathers into large contiguous blocks
+ * at the start of the zone.
+ *
+ * Compaction runs directly from the page allocator when a high-order
+ * allocation fails, and in the background from kcompactd, a nice 19
+ * kernel thread that keeps a block of sysctl_compact_idle_order available
+ * in every zone.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/swap.h>
+#include <linux/migrate.h>
+#include <linux/compaction.h>
+#include <linux/backing-dev.h>
+#include <linux/sysctl.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/init.h>
+#include "internal.h"
+
+/*
+ * compact_control is used to track pages being migrated and the free pages
+ * they are being migrated to during memory compaction. The free_pfn starts
+ * at the end of a zone and migrate_pfn begins at the start. Movable pages
+ * are moved to the end of a zone during a compaction run and the run
+ * completes when free_pfn <= migrate_pfn
+ */
+struct compact_control {
+	struct list_head freepages;	/* List of free pages to migrate to */
+	struct list_head migratepages;	/* List of pages being migrated */
+	unsigned long nr_freepages;	/* Number of isolated free pages */
+	unsigned long nr_migratepages;	/* Number of pages to migrate */
+	unsigned long free_pfn;		/* isolate_freepages search base */
+	unsigned long migrate_pfn;	/* isolate_migratepages search base */
+
+	int order;			/* order a direct compactor needs */
+	unsigned long mark;		/* zone watermark the block must clear */
+	struct zone *zone;
+};
+
+/* Per-order outcome counters, shown in /proc/compactinfo */
+enum compact_stat_item {
+	COMPACT_DIRECT_SUCCESS,
+	COMPACT_DIRECT_FAIL,
+	COMPACT_IDLE_SUCCESS,
+	COMPACT_IDLE_FAIL,
+	NR_COMPACT_STAT_ITEMS
+};
+
+static atomic_long_t compact_stats[MAX_ORDER][NR_COMPACT_STAT_ITEMS];
+
+static inline void count_compact_stat(int order, enum compact_stat_item item)
+{
+	atomic_long_inc(&compact_stats[order][item]);
+}
+
+/*
+ * After a compaction failure a zone is skipped by direct compaction for
+ * 1 << compact_defer_shift attempts, doubling on every further failure.
+ */
+#define COMPACT_MAX_DEFER_SHIFT 6
+
+static void defer_compaction(struct zone *zone)
+{
+	zone->compact_considered = 0;
+	zone->compact_defer_shift++;
+	if (zone->compact_defer_shift > COMPACT_MAX_DEFER_SHIFT)
+		zone->compact_defer_shift = COMPACT_MAX_DEFER_SHIFT;
+}
+
+static int compaction_deferred(struct zone *zone)
+{
+	unsigned long defer_limit = 1UL << zone->compact_defer_shift;
+
+	/* Avoid possible overflow */
+	if (++zone->compact_considered > defer_limit)
+		zone->compact_considered = defer_limit;
+
+	return zone->compact_considered < defer_limit;
+}
+
+static unsigned long release_freepages(struct list_head *freelist)
+{
+	struct page *page, *next;
+	unsigned long count = 0;
+
+	list_for_each_entry_safe(page, next, freelist, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+		count++;
+	}
+
+	return count;
+}
+
+/* Isolate free pages onto a private freelist. Must hold zone->lock */
+static unsigned long isolate_freepages_block(struct zone *zone,
+				unsigned long blockpfn,
+				struct list_head *freelist)
+{
+	unsigned long zone_end_pfn, end_pfn;
+	unsigned long total_isolated = 0;
+
+	/* Get the last PFN we should scan for free pages at */
+	zone_end_pfn = zone->zone_start_pfn + zone->spanned_pages;
+	end_pfn = min(blockpfn + pageblock_nr_pages, zone_end_pfn);
+
+	/* Isolate free pages. This assumes the block is valid */
+	for (; blockpfn < end_pfn; blockpfn++) {
+		struct page *page;
+		int isolated, i;
+
+		if (!pfn_valid_within(blockpfn))
+			continue;
+
+		page = pfn_to_page(blockpfn);
+		if (!PageBuddy(page))
+			continue;
+
+		/* Found a free page, break it into order-0 pages */
+		isolated = split_free_page(page);
+		if (!isolated)
+			break;
+		total_isolated += isolated;
+		for (i = 0; i < isolated; i++) {
+			list_add(&page->lru, freelist);
+			page++;
+		}
+		blockpfn += isolated - 1;
+	}
+
+	return total_isolated;
+}
+
+/* Returns true if the page is within a block suitable for migration to */
+static int suitable_migration_target(struct page *page)
+{
+	int migratetype = get_pageblock_migratetype(page);
+
+	/* Don't interfere with memory hot-remove or the min_free_kbytes blocks */
+	if (migratetype == MIGRATE_ISOLATE || migratetype == MIGRATE_RESERVE)
+		return 0;
+
+	/* If the page is a large free page, then allow migration */
+	if (PageBuddy(page) && page_order(page) >= pageblock_order)
+		return 1;
+
+	/* If the block is MIGRATE_MOVABLE, allow migration */
+	if (migratetype == MIGRATE_MOVABLE)
+		return 1;
+
+	/* Otherwise skip the block */
+	return 0;
+}
+
+/*
+ * Based on information in the current compact_control, find blocks
+ * suitable for isolating free pages from and then isolate them.
+ */
+static void isolate_freepages(struct zone *zone,
+				struct compact_control *cc)
+{
+	struct page *page;
+	unsigned long high_pfn, low_pfn, pfn;
+	unsigned long flags;
+	unsigned long nr_freepages = cc->nr_freepages;
+	LIST_HEAD(freelist);
+
+	/*
+	 * Initialise the free scanner. The starting point is where we last
+	 * scanned from (or the end of the zone if starting). The low point
+	 * is the end of the pageblock the migration scanner is using.
+	 */
+	pfn = cc->free_pfn;
+	low_pfn = cc->migrate_pfn + pageblock_nr_pages;
+	high_pfn = low_pfn;
+
+	/*
+	 * Isolate free pages until enough are available to migrate the
+	 * pages on cc->migratepages. We stop searching if the migrate
+	 * and free page scanners meet or enough free pages are isolated.
+	 */
+	for (; pfn > low_pfn && cc->nr_migratepages > nr_freepages;
+					pfn -= pageblock_nr_pages) {
+		unsigned long isolated;
+
+		if (!pfn_valid(pfn))
+			continue;
+
+		/*
+		 * Check for overlapping nodes/zones. It's possible on some
+		 * configurations to have a setup like
+		 * node0 node1 node0
+		 * i.e. it's possible that all pages within a zones range of
+		 * pages do not belong to a single zone.
+		 */
+		page = pfn_to_page(pfn);
+		if (page_zone(page) != zone)
+			continue;
+
+		/* Check the block is suitable for migration */
+		if (!suitable_migration_target(page))
+			continue;
+
+		/* Found a block suitable for isolating free pages from */
+		isolated = 0;
+		spin_lock_irqsave(&zone->lock, flags);
+		if (suitable_migration_target(page)) {
+			isolated = isolate_freepages_block(zone, pfn,
+							   &freelist);
+			nr_freepages += isolated;
+		}
+		spin_unlock_irqrestore(&zone->lock, flags);
+
+		/*
+		 * Record the highest PFN we isolated pages from. When next
+		 * looking for free pages, the search will restart here as
+		 * page migration may have returned some pages to the allocator
+		 */
+		if (isolated)
+			high_pfn = max(high_pfn, pfn);
+	}
+
+	/* split_free_page does not map the pages */
+	list_for_each_entry(page, &freelist, lru) {
+		arch_alloc_page(page, 0);
+		kernel_map_pages(page, 1, 1);
+	}
+	list_splice(&freelist, &cc->freepages);
+
+	cc->free_pfn = high_pfn;
+	cc->nr_freepages = nr_freepages;
+}
+
+/*
+ * Isolate all pages that can be migrated from the block pointed to by
+ * the migrate scanner within compact_control.
+ */
+static unsigned long isolate_migratepages(struct zone *zone,
+					struct compact_control *cc)
+{
+	unsigned long low_pfn, end_pfn;
+	struct list_head *migratelist = &cc->migratepages;
+
+	/* Do not scan outside zone boundaries */
+	low_pfn = max(cc->migrate_pfn, zone->zone_start_pfn);
+
+	/* Only scan within a pageblock boundary */
+	end_pfn = ALIGN(low_pfn + pageblock_nr_pages, pageblock_nr_pages);
+
+	/* Do not cross the free scanner or scan within a memory hole */
+	if (end_pfn > cc->free_pfn || !pfn_valid(low_pfn)) {
+		cc->migrate_pfn = end_pfn;
+		return 0;
+	}
+
+	/* Time to isolate some pages for migration */
+	for (; low_pfn < end_pfn; low_pfn++) {
+		struct page *page;
+
+		if (!pfn_valid_within(low_pfn))
+			continue;
+
+		/* Get the page and skip if free */
+		page = pfn_to_page(low_pfn);
+		if (PageBuddy(page))
+			continue;
+
+		/* Only LRU pages can be moved; leave mlocked ones alone */
+		if (!PageLRU(page) || PageUnevictable(page))
+			continue;
+		if (page_zone(page) != zone)
+			continue;
+
+		/* Takes a reference and removes the page from the LRU */
+		if (isolate_lru_page(page))
+			continue;
+
+		list_add(&page->lru, migratelist);
+		cc->nr_migratepages++;
+
+		/* Avoid isolating too much */
+		if (cc->nr_migratepages == SWAP_CLUSTER_MAX) {
+			++low_pfn;
+			break;
+		}
+	}
+
+	cc->migrate_pfn = low_pfn;
+
+	return cc->nr_migratepages;
+}
+
+/*
+ * This is a migrate-callback that "allocates" freepages by taking pages
+ * from the isolated freelists in the block we are migrating to.
+ */
+static struct page *compaction_alloc(struct page *migratepage,
+					unsigned long data,
+					int **result)
+{
+	struct compact_control *cc = (struct compact_control *)data;
+	struct page *freepage;
+
+	/* Isolate free pages if necessary */
+	if (list_empty(&cc->freepages)) {
+		isolate_freepages(cc->zone, cc);
+
+		if (list_empty(&cc->freepages))
+			return NULL;
+	}
+
+	freepage = list_entry(cc->freepages.next, struct page, lru);
+	list_del(&freepage->lru);
+	cc->nr_freepages--;
+
+	return freepage;
+}
+
+static int compact_finished(struct zone *zone,
+				struct compact_control *cc)
+{
+	unsigned long watermark;
+
+	if (fatal_signal_pending(current))
+		return COMPACT_PARTIAL;
+
+	/* Compaction run completes if the migrate and free scanner meet */
+	if (cc->free_pfn <= cc->migrate_pfn)
+		return COMPACT_COMPLETE;
+
+	/* Compacting everything, as for /proc/sys/vm/compact_memory */
+	if (cc->order == -1)
+		return COMPACT_CONTINUE;
+
+	/* Done once a block of the wanted order is free above the watermark */
+	watermark = cc->mark + (1 << cc->order);
+	if (zone_watermark_ok(zone, cc->order, watermark, 0, 0))
+		return COMPACT_PARTIAL;
+
+	return COMPACT_CONTINUE;
+}
+
+/*
+ * Returns
+ *   COMPACT_SKIPPED  - If there are too few free pages for compaction
+ *   COMPACT_PARTIAL  - If the allocation would succeed without compaction
+ *   COMPACT_CONTINUE - If compaction should run
+ */
+static int compaction_suitable(struct zone *zone, int order,
+			       unsigned long mark)
+{
+	unsigned long watermark;
+
+	/*
+	 * Watermarks for order-0 must be met for compaction. Note the 2UL.
+	 * This is because during migration, copies of pages need to be
+	 * allocated and for a short time, the footprint is higher
+	 */
+	watermark = mark + (2UL << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return COMPACT_SKIPPED;
+
+	/* The block may be there already */
+	watermark = mark + (1UL << order);
+	if (zone_watermark_ok(zone, order, watermark, 0, 0))
+		return COMPACT_PARTIAL;
+
+	return COMPACT_CONTINUE;
+}
+
+static int compact_zone(struct zone *zone, struct compact_control *cc)
+{
+	int ret;
+
+	if (cc->order > 0) {
+		ret = compaction_suitable(zone, cc->order, cc->mark);
+		if (ret != COMPACT_CONTINUE)
+			return ret;
+	}
+
+	/* Setup to move all movable pages to the end of the zone */
+	cc->migrate_pfn = zone->zone_start_pfn;
+	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
+	cc->free_pfn &= ~(pageblock_nr_pages-1);
+
+	/* Pages still on the pagevecs are not on the LRU yet */
+	lru_add_drain();
+
+	while ((ret = compact_finished(zone, cc)) == COMPACT_CONTINUE) {
+		unsigned long nr_migrate;
+		int err;
+
+		if (!isolate_migratepages(zone, cc))
+			continue;
+
+		nr_migrate = cc->nr_migratepages;
+		err = migrate_pages(&cc->migratepages, compaction_alloc,
+				    (unsigned long)cc);
+
+		/* migrate_pages() puts back whatever it could not move */
+		cc->nr_migratepages = 0;
+		count_vm_event(COMPACTBLOCKS);
+		if (!err)
+			count_vm_events(COMPACTPAGES, nr_migrate);
+		else if (err > 0) {
+			count_vm_events(COMPACTPAGES, nr_migrate - err);
+			count_vm_events(COMPACTPAGEFAILED, err);
+		}
+
+		cond_resched();
+	}
+
+	/* Release free pages and check accounting */
+	cc->nr_freepages -= release_freepages(&cc->freepages);
+	VM_BUG_ON(cc->nr_freepages != 0);
+
+	return ret;
+}
+
+static int compact_zone_order(struct zone *zone, int order,
+			      unsigned long mark)
+{
+	struct compact_control cc = {
+		.nr_freepages = 0,
+		.nr_migratepages = 0,
+		.order = order,
+		.mark = mark,
+		.zone = zone,
+	};
+	INIT_LIST_HEAD(&cc.freepages);
+	INIT_LIST_HEAD(&cc.migratepages);
+
+	return compact_zone(zone, &cc);
+}
+
+/**
+ * try_to_compact_pages - Direct compact to satisfy a high-order allocation
+ * @zonelist: The zonelist used for the current allocation
+ * @order: The order of the current allocation
+ * @gfp_mask: The GFP mask of the current allocation
+ * @nodemask: The allowed nodes to allocate from
+ *
+ * This is the main entry point for direct page compaction.
+ */
+unsigned long try_to_compact_pages(struct zonelist *zonelist,
+			int order, gfp_t gfp_mask, nodemask_t *nodemask)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int may_enter_fs = gfp_mask & __GFP_FS;
+	int may_perform_io = gfp_mask & __GFP_IO;
+	unsigned long watermark;
+	struct zoneref *z;
+	struct zone *zone;
+	int rc = COMPACT_SKIPPED;
+
+	/*
+	 * Check whether it is worth even starting compaction. The order check is
+	 * made because an assumption is made that the page allocator can satisfy
+	 * the "cheaper" orders without taking special steps
+	 */
+	if (!order || !may_enter_fs || !may_perform_io)
+		return rc;
+
+	count_vm_event(COMPACTSTALL);
+
+	/* Compact each zone in the list */
+	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
+								nodemask) {
+		int status;
+
+		if (compaction_deferred(zone))
+			continue;
+
+		status = compact_zone_order(zone, order, zone->pages_low);
+		rc = max(status, rc);
+		if (status == COMPACT_SKIPPED)
+			continue;
+
+		/* If a normal allocation would succeed, stop compacting */
+		watermark = zone->pages_low + (1 << order);
+		if (zone_watermark_ok(zone, order, watermark, 0, 0)) {
+			zone->compact_defer_shift = 0;
+			count_compact_stat(order, COMPACT_DIRECT_SUCCESS);
+			break;
+		}
+		defer_compaction(zone);
+		count_compact_stat(order, COMPACT_DIRECT_FAIL);
+	}
+
+	return rc;
+}
+
+/* Compact all zones, as requested through /proc/sys/vm/compact_memory */
+static void compact_all_zones(void)
+{
+	struct zone *zone;
+
+	lru_add_drain_all();
+	for_each_zone(zone) {
+		if (!populated_zone(zone))
+			continue;
+		compact_zone_order(zone, -1, zone->pages_low);
+		zone->compact_considered = 0;
+		zone->compact_defer_shift = 0;
+	}
+}
+
+/* The written value does not matter, this is a trigger */
+int sysctl_compact_memory;
+
+/* This is the entry point for compacting all zones via /proc/sys/vm */
+int sysctl_compaction_handler(struct ctl_table *table, int write,
+			struct file *file, void __user *buffer,
+			size_t *length, loff_t *ppos)
+{
+	if (write)
+		compact_all_zones();
+
+	return 0;
+}
+
+/*
+ * kcompactd
+ *
+ * Runs at nice 19, so it mostly gets the cpu when nothing else wants it.
+ * Every sysctl_compact_idle_interval seconds, or when an allocation that
+ * could not compact by itself wakes it, it compacts any zone that lacks
+ * a free block of sysctl_compact_idle_order above the high watermark.
+ */
+int sysctl_compact_idle_order = 3;
+int sysctl_compact_idle_interval = 60;
+
+static DECLARE_WAIT_QUEUE_HEAD(kcompactd_wait);
+static int kcompactd_order;
+
+/**
+ * wakeup_kcompactd - ask for a block of @order in the background
+ * @order: order of the allocation that failed
+ *
+ * For allocations that cannot compact themselves, such as GFP_ATOMIC.
+ * May be called from any context.
+ */
+void wakeup_kcompactd(int order)
+{
+	if (order <= 0 || order >= MAX_ORDER)
+		return;
+	if (order > kcompactd_order)
+		kcompactd_order = order;
+	if (waitqueue_active(&kcompactd_wait))
+		wake_up_interruptible(&kcompactd_wait);
+}
+
+static void kcompactd_compact(int order)
+{
+	struct zone *zone;
+
+	for_each_zone(zone) {
+		unsigned long watermark;
+
+		if (!populated_zone(zone))
+			continue;
+
+		watermark = zone->pages_high + (1UL << order);
+		if (zone_watermark_ok(zone, order, watermark, 0, 0))
+			continue;
+
+		if (compact_zone_order(zone, order, zone->pages_high) ==
+		    COMPACT_SKIPPED)
+			continue;
+
+		if (zone_watermark_ok(zone, order, watermark, 0, 0)) {
+			zone->compact_defer_shift = 0;
+			count_compact_stat(order, COMPACT_IDLE_SUCCESS);
+		} else
+			count_compact_stat(order, COMPACT_IDLE_FAIL);
+	}
+}
+
+static int kcompactd(void *unused)
+{
+	set_user_nice(current, 19);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+		int order;
+
+		if (sysctl_compact_idle_interval > 0)
+			timeout = sysctl_compact_idle_interval * HZ;
+		wait_event_freezable_timeout(kcompactd_wait,
+				kcompactd_order || kthread_should_stop(),
+				timeout);
+		if (kthread_should_stop())
+			break;
+
+		order = xchg(&kcompactd_order, 0);
+		order = max(order, sysctl_compact_idle_order);
+		if (order <= 0 || order >= MAX_ORDER)
+			continue;
+
+		lru_add_drain();
+		kcompactd_compact(order);
+	}
+	return 0;
+}
+
+static int compactinfo_show(struct seq_file *m, void *v)
+{
+	int order;
+
+	seq_printf(m, "order  direct_success  direct_fail  "
+		   "idle_success  idle_fail\n");
+	for (order = 1; order < MAX_ORDER; order++)
+		seq_printf(m, "%5d  %14lu  %11lu  %12lu  %9lu\n", order,
+		   atomic_long_read(&compact_stats[order][COMPACT_DIRECT_SUCCESS]),
+		   atomic_long_read(&compact_stats[order][COMPACT_DIRECT_FAIL]),
+		   atomic_long_read(&compact_stats[order][COMPACT_IDLE_SUCCESS]),
+		   atomic_long_read(&compact_stats[order][COMPACT_IDLE_FAIL]));
+	return 0;
+}
+
+static int compactinfo_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, compactinfo_show, NULL);
+}
+
+static const struct file_operations compactinfo_fops = {
+	.open		= compactinfo_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init compaction_init(void)
+{
+	struct task_struct *tsk;
+
+	proc_create("compactinfo", S_IRUGO, NULL, &compactinfo_fops);
+
+	tsk = kthread_run(kcompactd, NULL, "kcompactd");
+	if (IS_ERR(tsk))
+		printk(KERN_ERR "compaction: failed to start kcompactd\n");
+	return 0;
+}
+module_init(compaction_init);
@@ -51,6 +51,9 @@ extern void putback_lru_page(struct page *page);
  */
 extern unsigned long highest_memmap_pfn;
 extern void __free_pages_bootmem(struct page *page, unsigned int order);
+#ifdef CONFIG_COMPACTION
+extern int split_free_page(struct page *page);
+#endif
 
 /*
  * function for dealing with page's order in buddy system.
@@ -273,6 +276,10 @@ static inline void mminit_validate_memmodel_limits(unsigned long *start_pfn,
 }
 #endif /* CONFIG_SPARSEMEM */
 
+unsigned long truncate_shadow_entries(struct address_space *mapping,
+				      pgoff_t start, pgoff_t end,
+				      unsigned long nr_to_drop);
+
 #define GUP_FLAGS_WRITE                  0x1
 #define GUP_FLAGS_FORCE                  0x2
 #define GUP_FLAGS_IGNORE_VMA_PERMISSIONS 0x4
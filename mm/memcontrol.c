@@ -42,6 +42,8 @@
 
 struct cgroup_subsys mem_cgroup_subsys __read_mostly;
 #define MEM_CGROUP_RECLAIM_RETRIES	5
+#define MEM_CGROUP_RECLAIM_PRIO_MAX	10
+#define MEM_CGROUP_SOFT_RECLAIM_LOOPS	4
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_SWAP
 /* Turned on only when memory cgroup is enabled && really_do_swap_account = 0 */
@@ -53,6 +55,14 @@ static int really_do_swap_account __initdata = 1; /* for remember boot option*/
 
 static DEFINE_MUTEX(memcg_tasklist);	/* can be hold under cgroup_mutex */
 
+/*
+ * All memory cgroups, walked by soft limit reclaim to pick a victim.
+ * Systems using soft limits run a handful of groups, so a plain list
+ * is scanned rather than keeping the groups sorted by excess.
+ */
+static LIST_HEAD(memcg_soft_list);
+static DEFINE_SPINLOCK(memcg_soft_lock);
+
 /*
  * Statistics for memory cgroup.
  */
@@ -64,6 +74,11 @@ enum mem_cgroup_stat_index {
 	MEM_CGROUP_STAT_RSS,	   /* # of pages charged as rss */
 	MEM_CGROUP_STAT_PGPGIN_COUNT,	/* # of pages paged in */
 	MEM_CGROUP_STAT_PGPGOUT_COUNT,	/* # of pages paged out */
+	MEM_CGROUP_STAT_SOFT_RECLAIM,	/* # of pages soft limit reclaimed */
+	MEM_CGROUP_STAT_RECLAIM_STALL,	/* # of reclaim stalls of tasks */
+	MEM_CGROUP_STAT_RECLAIM_USECS,	/* time tasks spent in reclaim */
+	MEM_CGROUP_STAT_REFAULT,	/* # of refaults of evicted pages */
+	MEM_CGROUP_STAT_REFAULT_ACTIVATE, /* # of refaults activated */
 
 	MEM_CGROUP_STAT_NSTATS,
 };
@@ -165,6 +180,13 @@ struct mem_cgroup {
 	atomic_t	refcnt;
 
 	unsigned int	swappiness;
+	/*
+	 * Under global memory pressure, groups over their soft limit are
+	 * reclaimed first, in order of decreasing reclaim_priority.
+	 * Protected by reclaim_param_lock.
+	 */
+	unsigned int	reclaim_priority;
+	struct list_head soft_list;	/* on memcg_soft_list */
 
 	/*
 	 * statistics. This must be placed at the end of memcg.
@@ -536,6 +558,17 @@ int mem_cgroup_inactive_anon_is_low(struct mem_cgroup *memcg)
 	return 0;
 }
 
+int mem_cgroup_inactive_file_is_low(struct mem_cgroup *memcg)
+{
+	unsigned long active;
+	unsigned long inactive;
+
+	inactive = mem_cgroup_get_all_zonestat(memcg, LRU_INACTIVE_FILE);
+	active = mem_cgroup_get_all_zonestat(memcg, LRU_ACTIVE_FILE);
+
+	return (active > inactive);
+}
+
 unsigned long mem_cgroup_zone_nr_pages(struct mem_cgroup *memcg,
 				       struct zone *zone,
 				       enum lru_list lru)
@@ -754,6 +787,35 @@ static unsigned int get_swappiness(struct mem_cgroup *memcg)
 	return swappiness;
 }
 
+static unsigned int get_reclaim_priority(struct mem_cgroup *memcg)
+{
+	unsigned int prio;
+
+	spin_lock(&memcg->reclaim_param_lock);
+	prio = memcg->reclaim_priority;
+	spin_unlock(&memcg->reclaim_param_lock);
+
+	return prio;
+}
+
+static void mem_cgroup_add_stat(struct mem_cgroup *mem,
+				enum mem_cgroup_stat_index idx, int val)
+{
+	int cpu = get_cpu();
+
+	__mem_cgroup_stat_add_safe(&mem->stat.cpustat[cpu], idx, val);
+	put_cpu();
+}
+
+static void __mem_cgroup_count_reclaim_stall(struct mem_cgroup *mem,
+					     ktime_t start)
+{
+	s64 usecs = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	mem_cgroup_add_stat(mem, MEM_CGROUP_STAT_RECLAIM_STALL, 1);
+	mem_cgroup_add_stat(mem, MEM_CGROUP_STAT_RECLAIM_USECS, usecs);
+}
+
 /*
  * Dance down the hierarchy if needed to reclaim memory. We remember the
  * last child we reclaimed from, so that we don't end up penalizing
@@ -797,6 +859,168 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 	return ret;
 }
 
+/*
+ * Reclaim from a group over its soft limit, and from its children when
+ * the group is hierarchical, until it is back within the soft limit or
+ * @nr_to_reclaim pages have been freed.  Gives up after a whole pass
+ * over the group (and its children) frees nothing.
+ */
+static unsigned long mem_cgroup_soft_reclaim(struct mem_cgroup *root_mem,
+					     gfp_t gfp_mask,
+					     unsigned long nr_to_reclaim)
+{
+	struct mem_cgroup *mem = root_mem;
+	unsigned long nr_reclaimed = 0;
+	unsigned long pass_reclaimed = 0;
+	unsigned long progress;
+
+	while (1) {
+		if (!mem_cgroup_is_obsolete(mem)) {
+			progress = try_to_free_mem_cgroup_pages(mem, gfp_mask,
+					false, get_swappiness(mem));
+			nr_reclaimed += progress;
+			pass_reclaimed += progress;
+			mem_cgroup_add_stat(mem, MEM_CGROUP_STAT_SOFT_RECLAIM,
+					    progress);
+		}
+		if (nr_reclaimed >= nr_to_reclaim ||
+		    !res_counter_soft_limit_excess(&root_mem->res))
+			break;
+		if (root_mem->use_hierarchy)
+			mem = mem_cgroup_get_next_node(root_mem);
+		if (mem == root_mem) {
+			if (!pass_reclaimed)
+				break;
+			pass_reclaimed = 0;
+		}
+	}
+	return nr_reclaimed;
+}
+
+/*
+ * Pick the group to reclaim from: the highest reclaim_priority wins and
+ * the largest soft limit excess breaks ties.  The group is returned with
+ * a reference held.
+ */
+static struct mem_cgroup *mem_cgroup_soft_limit_victim(void)
+{
+	struct mem_cgroup *mem, *victim = NULL;
+	unsigned long long excess, victim_excess = 0;
+	unsigned int prio, victim_prio = 0;
+
+	spin_lock(&memcg_soft_lock);
+	list_for_each_entry(mem, &memcg_soft_list, soft_list) {
+		if (mem_cgroup_is_obsolete(mem))
+			continue;
+		excess = res_counter_soft_limit_excess(&mem->res);
+		if (!excess)
+			continue;
+		prio = get_reclaim_priority(mem);
+		if (victim && (prio < victim_prio ||
+			       (prio == victim_prio && excess <= victim_excess)))
+			continue;
+		victim = mem;
+		victim_prio = prio;
+		victim_excess = excess;
+	}
+	if (victim)
+		mem_cgroup_get(victim);
+	spin_unlock(&memcg_soft_lock);
+	return victim;
+}
+
+/**
+ * mem_cgroup_soft_limit_reclaim - reclaim from groups over their soft limit
+ * @gfp_mask: allocation context of the reclaim
+ * @nr_to_reclaim: number of pages the caller is after
+ *
+ * Called by kswapd before it scans the zone LRU lists, so that groups
+ * over their soft limit give up memory before anyone else.  Direct
+ * reclaim does not use it: the pages come from any zone and node, and
+ * would not help an allocation restricted by its zonelist or cpuset.  A
+ * group is asked for up to (1 + reclaim_priority) times @nr_to_reclaim,
+ * which makes background groups with a high priority shrink harder; the
+ * next group is only tried when that one stops making progress short of
+ * @nr_to_reclaim.
+ *
+ * Returns the number of pages reclaimed.
+ */
+unsigned long mem_cgroup_soft_limit_reclaim(gfp_t gfp_mask,
+					    unsigned long nr_to_reclaim)
+{
+	unsigned long nr_reclaimed = 0;
+	unsigned long progress;
+	struct mem_cgroup *mem;
+	int loop;
+
+	if (mem_cgroup_disabled())
+		return 0;
+
+	for (loop = 0; loop < MEM_CGROUP_SOFT_RECLAIM_LOOPS; loop++) {
+		mem = mem_cgroup_soft_limit_victim();
+		if (!mem)
+			break;
+		progress = mem_cgroup_soft_reclaim(mem, gfp_mask,
+				nr_to_reclaim * (1 + get_reclaim_priority(mem)));
+		mem_cgroup_put(mem);
+		nr_reclaimed += progress;
+		/*
+		 * Don't keep hammering a group whose pages can't be
+		 * freed; leave the rest to the global LRU scan.
+		 */
+		if (!progress || nr_reclaimed >= nr_to_reclaim)
+			break;
+	}
+	return nr_reclaimed;
+}
+
+/**
+ * mem_cgroup_count_reclaim_stall - account time spent in global reclaim
+ * @mm: mm of the stalled task
+ * @start: time reclaim was entered
+ */
+void mem_cgroup_count_reclaim_stall(struct mm_struct *mm, ktime_t start)
+{
+	struct mem_cgroup *mem;
+
+	if (mem_cgroup_disabled() || !mm)
+		return;
+
+	mem = try_get_mem_cgroup_from_mm(mm);
+	if (!mem)
+		return;
+	__mem_cgroup_count_reclaim_stall(mem, start);
+	css_put(&mem->css);
+}
+
+/**
+ * mem_cgroup_count_refault - account a page cache refault
+ * @page: the refaulting page, charged to its new group
+ * @activated: the refault distance put the page on the active list
+ */
+void mem_cgroup_count_refault(struct page *page, int activated)
+{
+	struct page_cgroup *pc;
+	struct mem_cgroup *mem;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	pc = lookup_page_cgroup(page);
+	if (unlikely(!pc))
+		return;
+
+	lock_page_cgroup(pc);
+	mem = pc->mem_cgroup;
+	if (PageCgroupUsed(pc) && mem) {
+		mem_cgroup_add_stat(mem, MEM_CGROUP_STAT_REFAULT, 1);
+		if (activated)
+			mem_cgroup_add_stat(mem,
+					MEM_CGROUP_STAT_REFAULT_ACTIVATE, 1);
+	}
+	unlock_page_cgroup(pc);
+}
+
 bool mem_cgroup_oom_called(struct task_struct *task)
 {
 	bool ret = false;
@@ -852,6 +1076,7 @@ static int __mem_cgroup_try_charge(struct mm_struct *mm,
 	while (1) {
 		int ret;
 		bool noswap = false;
+		ktime_t start;
 
 		ret = res_counter_charge(&mem->res, PAGE_SIZE, &fail_res);
 		if (likely(!ret)) {
@@ -874,8 +1099,10 @@ static int __mem_cgroup_try_charge(struct mm_struct *mm,
 		if (!(gfp_mask & __GFP_WAIT))
 			goto nomem;
 
+		start = ktime_get();
 		ret = mem_cgroup_hierarchical_reclaim(mem_over_limit, gfp_mask,
 							noswap);
+		__mem_cgroup_count_reclaim_stall(mem, start);
 		if (ret)
 			continue;
 
@@ -1810,7 +2037,7 @@ static u64 mem_cgroup_read(struct cgroup *cont, struct cftype *cft)
 }
 /*
  * The user of this function is...
- * RES_LIMIT.
+ * RES_LIMIT, RES_SOFT_LIMIT.
  */
 static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 			    const char *buffer)
@@ -1833,6 +2060,15 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 		else
 			ret = mem_cgroup_resize_memsw_limit(memcg, val);
 		break;
+	case RES_SOFT_LIMIT:
+		ret = res_counter_memparse_write_strategy(buffer, &val);
+		if (ret)
+			break;
+		if (type == _MEM)
+			res_counter_set_soft_limit(&memcg->res, val);
+		else
+			ret = -EINVAL;
+		break;
 	default:
 		ret = -EINVAL; /* should be BUG() ? */
 		break;
@@ -1901,6 +2137,11 @@ static const struct mem_cgroup_stat_desc {
 	[MEM_CGROUP_STAT_RSS] = { "rss", PAGE_SIZE, },
 	[MEM_CGROUP_STAT_PGPGIN_COUNT] = {"pgpgin", 1, },
 	[MEM_CGROUP_STAT_PGPGOUT_COUNT] = {"pgpgout", 1, },
+	[MEM_CGROUP_STAT_SOFT_RECLAIM] = {"soft_reclaim", 1, },
+	[MEM_CGROUP_STAT_RECLAIM_STALL] = {"reclaim_stall", 1, },
+	[MEM_CGROUP_STAT_RECLAIM_USECS] = {"reclaim_stall_usecs", 1, },
+	[MEM_CGROUP_STAT_REFAULT] = {"workingset_refault", 1, },
+	[MEM_CGROUP_STAT_REFAULT_ACTIVATE] = {"workingset_activate", 1, },
 };
 
 static int mem_control_stat_show(struct cgroup *cont, struct cftype *cft,
@@ -2020,6 +2261,27 @@ static int mem_cgroup_swappiness_write(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+static u64 mem_cgroup_reclaim_priority_read(struct cgroup *cgrp,
+					    struct cftype *cft)
+{
+	return get_reclaim_priority(mem_cgroup_from_cont(cgrp));
+}
+
+static int mem_cgroup_reclaim_priority_write(struct cgroup *cgrp,
+					     struct cftype *cft, u64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	if (val > MEM_CGROUP_RECLAIM_PRIO_MAX)
+		return -EINVAL;
+
+	spin_lock(&memcg->reclaim_param_lock);
+	memcg->reclaim_priority = val;
+	spin_unlock(&memcg->reclaim_param_lock);
+
+	return 0;
+}
+
 
 static struct cftype mem_cgroup_files[] = {
 	{
@@ -2039,6 +2301,12 @@ static struct cftype mem_cgroup_files[] = {
 		.write_string = mem_cgroup_write,
 		.read_u64 = mem_cgroup_read,
 	},
+	{
+		.name = "soft_limit_in_bytes",
+		.private = MEMFILE_PRIVATE(_MEM, RES_SOFT_LIMIT),
+		.write_string = mem_cgroup_write,
+		.read_u64 = mem_cgroup_read,
+	},
 	{
 		.name = "failcnt",
 		.private = MEMFILE_PRIVATE(_MEM, RES_FAILCNT),
@@ -2063,6 +2331,11 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "reclaim_priority",
+		.read_u64 = mem_cgroup_reclaim_priority_read,
+		.write_u64 = mem_cgroup_reclaim_priority_write,
+	},
 };
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_SWAP
@@ -2266,6 +2539,10 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	if (parent)
 		mem->swappiness = get_swappiness(parent);
 	atomic_set(&mem->refcnt, 1);
+
+	spin_lock(&memcg_soft_lock);
+	list_add(&mem->soft_list, &memcg_soft_list);
+	spin_unlock(&memcg_soft_lock);
 	return &mem->css;
 free_out:
 	__mem_cgroup_free(mem);
@@ -2285,6 +2562,10 @@ static void mem_cgroup_destroy(struct cgroup_subsys *ss,
 	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
 	struct mem_cgroup *last_scanned_child = mem->last_scanned_child;
 
+	spin_lock(&memcg_soft_lock);
+	list_del(&mem->soft_list);
+	spin_unlock(&memcg_soft_lock);
+
 	if (last_scanned_child) {
 		VM_BUG_ON(!mem_cgroup_is_obsolete(last_scanned_child));
 		mem_cgroup_put(last_scanned_child);
@@ -47,6 +47,7 @@
 #include <linux/page_cgroup.h>
 #include <linux/debugobjects.h>
 #include <linux/mem_notify.h>
+#include <linux/compaction.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -72,6 +73,7 @@ unsigned long totalram_pages __read_mostly;
 unsigned long totalreserve_pages __read_mostly;
 unsigned long highest_memmap_pfn __read_mostly;
 int percpu_pagelist_fraction;
+int percpu_highorder_high[PCP_MAX_ORDER] = { 8, 4, 2 };
 
 #ifdef CONFIG_HUGETLB_PAGE_SIZE_VARIABLE
 int pageblock_order __read_mostly;
@@ -518,6 +520,18 @@ static inline int free_pages_check(struct page *page)
 	return 0;
 }
 
+/*
+ * Take zone->lock, counting the acquisitions that had to spin for it.
+ * Interrupts must be disabled.
+ */
+static inline void zone_lock(struct zone *zone)
+{
+	if (unlikely(!spin_trylock(&zone->lock))) {
+		__count_vm_event(ZONE_LOCK_CONTENDED);
+		spin_lock(&zone->lock);
+	}
+}
+
 /*
  * Frees a list of pages. 
  * Assumes all pages on list are in same zone, and of same order.
@@ -532,7 +546,7 @@ static inline int free_pages_check(struct page *page)
 static void free_pages_bulk(struct zone *zone, int count,
 					struct list_head *list, int order)
 {
-	spin_lock(&zone->lock);
+	zone_lock(zone);
 	zone_clear_flag(zone, ZONE_ALL_UNRECLAIMABLE);
 	zone->pages_scanned = 0;
 	while (count--) {
@@ -549,13 +563,50 @@ static void free_pages_bulk(struct zone *zone, int count,
 
 static void free_one_page(struct zone *zone, struct page *page, int order)
 {
-	spin_lock(&zone->lock);
+	zone_lock(zone);
 	zone_clear_flag(zone, ZONE_ALL_UNRECLAIMABLE);
 	zone->pages_scanned = 0;
 	__free_one_page(page, zone, order);
 	spin_unlock(&zone->lock);
 }
 
+/*
+ * Put a block of order 1..PCP_MAX_ORDER on this cpu's list for that
+ * order, returning the coldest half to the buddy lists once the list
+ * reaches its high mark. Interrupts must be disabled.
+ *
+ * high and batch may be rewritten by setup_highorder_highmark() from
+ * another cpu.  Each is read once, and batch is clamped to the count, so
+ * no pairing of old and new values can free more blocks than are listed.
+ */
+static void free_pcp_highorder_page(struct zone *zone, struct page *page,
+				    int order)
+{
+	struct per_cpu_pages *pcp;
+	int high, batch;
+
+	pcp = &zone_pcp(zone, smp_processor_id())->hpcp[order - 1];
+	high = ACCESS_ONCE(pcp->high);
+	if (!high) {
+		free_one_page(zone, page, order);
+		return;
+	}
+
+	/* The list is not order-aware, so hand it plain blocks */
+	if (unlikely(PageCompound(page)) &&
+	    unlikely(destroy_compound_page(page, order)))
+		return;
+
+	list_add(&page->lru, &pcp->list);
+	set_page_private(page, get_pageblock_migratetype(page));
+	pcp->count++;
+	if (pcp->count >= high) {
+		batch = min(ACCESS_ONCE(pcp->batch), pcp->count);
+		free_pages_bulk(zone, batch, &pcp->list, order);
+		pcp->count -= batch;
+	}
+}
+
 static void __free_pages_ok(struct page *page, unsigned int order)
 {
 	unsigned long flags;
@@ -577,7 +628,10 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 
 	local_irq_save(flags);
 	__count_vm_events(PGFREE, 1 << order);
-	free_one_page(page_zone(page), page, order);
+	if (order && order <= PCP_MAX_ORDER)
+		free_pcp_highorder_page(page_zone(page), page, order);
+	else
+		free_one_page(page_zone(page), page, order);
 	local_irq_restore(flags);
 }
 
@@ -875,7 +929,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 {
 	int i;
 	
-	spin_lock(&zone->lock);
+	zone_lock(zone);
 	for (i = 0; i < count; ++i) {
 		struct page *page = __rmqueue(zone, order, migratetype);
 		if (unlikely(page == NULL))
@@ -938,6 +992,7 @@ static void drain_pages(unsigned int cpu)
 	for_each_zone(zone) {
 		struct per_cpu_pageset *pset;
 		struct per_cpu_pages *pcp;
+		int i;
 
 		if (!populated_zone(zone))
 			continue;
@@ -948,6 +1003,11 @@ static void drain_pages(unsigned int cpu)
 		local_irq_save(flags);
 		free_pages_bulk(zone, pcp->count, &pcp->list, 0);
 		pcp->count = 0;
+		for (i = 0; i < PCP_MAX_ORDER; i++) {
+			pcp = &pset->hpcp[i];
+			free_pages_bulk(zone, pcp->count, &pcp->list, i + 1);
+			pcp->count = 0;
+		}
 		local_irq_restore(flags);
 	}
 }
@@ -1070,6 +1130,50 @@ void split_page(struct page *page, unsigned int order)
 		set_page_refcounted(page + i);
 }
 
+#ifdef CONFIG_COMPACTION
+/*
+ * Similar to split_page except the page is already free. As this is only
+ * being used for migration, the migratetype of the block also changes.
+ * This is called with interrupts disabled and zone->lock held. Returns
+ * the number of order-0 pages isolated, or 0 if the zone is too low on
+ * free pages to give this one up.
+ */
+int split_free_page(struct page *page)
+{
+	unsigned int order;
+	unsigned long watermark;
+	struct zone *zone;
+
+	BUG_ON(!PageBuddy(page));
+
+	zone = page_zone(page);
+	order = page_order(page);
+
+	/* Obey watermarks as if the page was being allocated */
+	watermark = zone->pages_low + (1 << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return 0;
+
+	/* Remove page from free list */
+	list_del(&page->lru);
+	zone->free_area[order].nr_free--;
+	rmv_page_order(page);
+	__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+	/* Split into individual pages */
+	set_page_refcounted(page);
+	split_page(page, order);
+
+	if (order >= pageblock_order - 1) {
+		struct page *endpage = page + (1 << order) - 1;
+		for (; page < endpage; page += pageblock_nr_pages)
+			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+	}
+
+	return 1 << order;
+}
+#endif
+
 /*
  * Really, prep_compound_page() should be called from __rmqueue_bulk().  But
  * we cheat by calling it from here, in the order > 0 path.  Saves a branch
@@ -1116,10 +1220,33 @@ again:
 			page = list_entry(pcp->list.next, struct page, lru);
 		}
 
+		list_del(&page->lru);
+		pcp->count--;
+	} else if (order <= PCP_MAX_ORDER &&
+		   zone_pcp(zone, cpu)->hpcp[order - 1].high) {
+		struct per_cpu_pages *pcp;
+
+		pcp = &zone_pcp(zone, cpu)->hpcp[order - 1];
+		local_irq_save(flags);
+		list_for_each_entry(page, &pcp->list, lru)
+			if (page_private(page) == migratetype)
+				break;
+
+		if (&page->lru == &pcp->list) {
+			__count_vm_event(PGALLOC_PCP_HIGHORDER_MISS);
+			pcp->count += rmqueue_bulk(zone, order,
+					pcp->batch, &pcp->list, migratetype);
+			if (unlikely(!pcp->count))
+				goto failed;
+			page = list_entry(pcp->list.next, struct page, lru);
+		} else
+			__count_vm_event(PGALLOC_PCP_HIGHORDER_HIT);
+
 		list_del(&page->lru);
 		pcp->count--;
 	} else {
-		spin_lock_irqsave(&zone->lock, flags);
+		local_irq_save(flags);
+		zone_lock(zone);
 		page = __rmqueue(zone, order, migratetype);
 		spin_unlock(&zone->lock);
 		if (!page)
@@ -1476,8 +1603,8 @@ try_next_zone:
 /*
  * This is the 'heart' of the zoned buddy allocator.
  */
-struct page *
-__alloc_pages_internal(gfp_t gfp_mask, unsigned int order,
+static struct page *
+__alloc_pages_untimed(gfp_t gfp_mask, unsigned int order,
 			struct zonelist *zonelist, nodemask_t *nodemask)
 {
 	const gfp_t wait = gfp_mask & __GFP_WAIT;
@@ -1579,11 +1706,36 @@ nofail_alloc:
 	}
 
 	/* Atomic allocations - we can't balance anything */
-	if (!wait)
+	if (!wait) {
+		/* but kcompactd can assemble a block for the next attempt */
+		wakeup_kcompactd(order);
 		goto nopage;
+	}
 
 	cond_resched();
 
+	/* Try memory compaction for high-order allocations before reclaim */
+	if (order) {
+		unsigned long compact_result;
+
+		p->flags |= PF_MEMALLOC;
+		compact_result = try_to_compact_pages(zonelist, order,
+						gfp_mask, nodemask);
+		p->flags &= ~PF_MEMALLOC;
+
+		if (compact_result != COMPACT_SKIPPED) {
+			drain_local_pages(NULL);
+			page = get_page_from_freelist(gfp_mask, nodemask,
+				order, zonelist, high_zoneidx, alloc_flags);
+			if (page) {
+				count_vm_event(COMPACTSUCCESS);
+				goto got_pg;
+			}
+			count_vm_event(COMPACTFAIL);
+			cond_resched();
+		}
+	}
+
 	/* We now go into synchronous reclaim */
 	cpuset_memory_pressure_bump();
 	/*
@@ -1683,6 +1835,34 @@ nopage:
 got_pg:
 	return page;
 }
+
+/*
+ * Order-0 requests go straight through; higher orders are timed for
+ * the pgalloc_highorder counters in /proc/vmstat.
+ */
+struct page *
+__alloc_pages_internal(gfp_t gfp_mask, unsigned int order,
+			struct zonelist *zonelist, nodemask_t *nodemask)
+{
+	struct page *page;
+	u64 start, delta;
+
+	if (likely(!order))
+		return __alloc_pages_untimed(gfp_mask, 0, zonelist, nodemask);
+
+	start = sched_clock();
+	page = __alloc_pages_untimed(gfp_mask, order, zonelist, nodemask);
+	delta = sched_clock() - start;
+	if ((s64)delta < 0)	/* migrated to a cpu with an older clock */
+		delta = 0;
+	do_div(delta, NSEC_PER_USEC);
+
+	count_vm_event(PGALLOC_HIGHORDER);
+	count_vm_events(PGALLOC_HIGHORDER_USECS, delta);
+	if (delta >= USEC_PER_MSEC)
+		count_vm_event(PGALLOC_HIGHORDER_SLOW);
+	return page;
+}
 EXPORT_SYMBOL(__alloc_pages_internal);
 
 /*
@@ -2746,9 +2926,32 @@ static int zone_batchsize(struct zone *zone)
 	return batch;
 }
 
+/*
+ * Set the high-order list limits of pageset p from percpu_highorder_high.
+ * The pageset may be in use by its cpu, which reads the limits without a
+ * lock; free_pcp_highorder_page() clamps batch to the list count, so the
+ * ordering below only keeps the transient values small.
+ */
+static void setup_highorder_highmark(struct per_cpu_pageset *p)
+{
+	int i;
+
+	for (i = 0; i < PCP_MAX_ORDER; i++) {
+		struct per_cpu_pages *pcp = &p->hpcp[i];
+		int high = percpu_highorder_high[i];
+
+		pcp->batch = 1;
+		smp_wmb();
+		pcp->high = high;
+		smp_wmb();
+		pcp->batch = max(1, high / 2);
+	}
+}
+
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
+	int i;
 
 	memset(p, 0, sizeof(*p));
 
@@ -2757,6 +2960,12 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->high = 6 * batch;
 	pcp->batch = max(1UL, 1 * batch);
 	INIT_LIST_HEAD(&pcp->list);
+
+	for (i = 0; i < PCP_MAX_ORDER; i++)
+		INIT_LIST_HEAD(&p->hpcp[i].list);
+	/* Boot pagesets (batch 0) hand every block straight back */
+	if (batch)
+		setup_highorder_highmark(p);
 }
 
 /*
@@ -4537,6 +4746,31 @@ int percpu_pagelist_fraction_sysctl_handler(ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * percpu_highorder_high - changes the high marks of the order 1..3 per cpu
+ * lists of each zone on each cpu, then drains the lists so that none is
+ * left above its new limit.
+ */
+int percpu_highorder_sysctl_handler(ctl_table *table, int write,
+	struct file *file, void __user *buffer, size_t *length, loff_t *ppos)
+{
+	struct zone *zone;
+	unsigned int cpu;
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, file, buffer, length, ppos);
+	if (!write || ret)
+		return ret;
+	for_each_zone(zone) {
+		if (!populated_zone(zone))
+			continue;
+		for_each_online_cpu(cpu)
+			setup_highorder_highmark(zone_pcp(zone, cpu));
+	}
+	drain_all_pages();
+	return 0;
+}
+
 int hashdist = HASHDIST_DEFAULT;
 
 #ifdef CONFIG_NUMA
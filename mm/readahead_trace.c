@@ -0,0 +1,711 @@
+/*
+ * mm/readahead_trace.c - record and replay page cache accesses
+ *
+ * Copyright (C) 2010 Acer Incorporated.
+ *
+ * An application launch touches much the same scattered set of pages in
+ * APKs, dex files and shared libraries every time.  While a named window
+ * is open, every page looked up through read() or a file mmap fault is
+ * recorded as (file, page index).  Closing the window sorts the records,
+ * merges them into ranges and keeps the result as a compact trace that
+ * userspace can save.  Writing a saved trace back starts a replay, which
+ * reads those ranges in with batched, sorted readahead before the
+ * application gets to them.
+ *
+ * The interface lives in debugfs, see Documentation/vm/readahead-trace.txt.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
+#include <linux/hash.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/backing-dev.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#define RA_TRACE_MAGIC		0x31544152	/* "RAT1" */
+#define RA_TRACE_NAME_LEN	32
+#define RA_TRACE_MAX_FILES	512
+#define RA_TRACE_HASH_BITS	10
+#define RA_TRACE_MAX_RECORDS	(64 * 1024)
+#define RA_TRACE_MAX_SIZE	(1024 * 1024)
+#define RA_TRACE_MERGE_GAP	4	/* pages; smaller holes are read too */
+#define RA_TRACE_MAX_WINDOW_MS	15000
+
+/*
+ * Trace format, native endian.  The header is followed by nr_files file
+ * entries, each immediately followed by its path (path_len bytes, no NUL,
+ * padded to 4 bytes) and nr_ranges ranges sorted by start.  Files appear
+ * in the order they were first touched during the window.
+ */
+struct ra_trace_header {
+	__u32 magic;
+	__u32 size;		/* total bytes, header included */
+	__u32 nr_files;
+	__u32 reserved;
+	char name[RA_TRACE_NAME_LEN];
+};
+
+struct ra_trace_file {
+	__u32 nr_ranges;
+	__u16 path_len;
+	__u16 reserved;
+};
+
+struct ra_trace_range {
+	__u32 start;
+	__u32 nr_pages;
+};
+
+struct ra_trace_rec {
+	u32 file;
+	u32 index;
+};
+
+struct ra_trace_inode {
+	struct inode *inode;
+	char *path;
+};
+
+int readahead_trace_active;
+
+/* Recording state, protected by ra_lock */
+static DEFINE_SPINLOCK(ra_lock);
+static unsigned int ra_window;
+static struct ra_trace_rec *ra_recs;
+static unsigned int ra_nr_recs;
+static struct ra_trace_inode *ra_files;
+static unsigned int ra_nr_files;
+static u16 ra_hash[1 << RA_TRACE_HASH_BITS];	/* file index + 1 */
+static unsigned long ra_accesses, ra_misses, ra_dropped;
+
+/* Everything else, protected by ra_mutex */
+static DEFINE_MUTEX(ra_mutex);
+static char ra_name[RA_TRACE_NAME_LEN];
+static unsigned long ra_start, ra_deadline;
+static void *ra_trace;
+static size_t ra_trace_size;
+
+static struct ra_trace_stats {
+	unsigned int duration_ms;
+	unsigned long accesses;
+	unsigned long misses;
+	unsigned long dropped;
+	unsigned int files;
+	unsigned int ranges;
+	unsigned long pages;
+} ra_last;
+
+static struct ra_replay_stats {
+	char name[RA_TRACE_NAME_LEN];
+	unsigned int duration_ms;
+	unsigned int files;
+	unsigned int failed;
+	unsigned int ranges;
+	unsigned long pages;
+	unsigned long submitted;
+	unsigned long busy;
+} ra_replay;
+
+static struct workqueue_struct *ra_replay_wq;
+static void *ra_replay_trace;		/* owned by the replay work */
+static int ra_replay_running;
+
+static void ra_trace_timeout(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ra_timeout_work, ra_trace_timeout);
+
+static int ra_trace_lookup(struct inode *inode)
+{
+	unsigned int h = hash_ptr(inode, RA_TRACE_HASH_BITS);
+
+	while (ra_hash[h]) {
+		if (ra_files[ra_hash[h] - 1].inode == inode)
+			return ra_hash[h] - 1;
+		h = (h + 1) & ((1 << RA_TRACE_HASH_BITS) - 1);
+	}
+	return -1;
+}
+
+/*
+ * First access to a file in this window: remember its path.  The path is
+ * built without ra_lock held, so the window may have moved on meanwhile.
+ */
+static int ra_trace_add_file(struct file *file, unsigned int window)
+{
+	struct inode *inode = file->f_mapping->host;
+	char *buf, *path;
+	unsigned int h;
+	int id = -1;
+
+	buf = kmalloc(PATH_MAX, GFP_NOFS);
+	if (!buf)
+		return -1;
+	path = d_path(&file->f_path, buf, PATH_MAX);
+	if (IS_ERR(path)) {
+		kfree(buf);
+		return -1;
+	}
+	path = kstrdup(path, GFP_NOFS);
+	kfree(buf);
+	if (!path)
+		return -1;
+
+	spin_lock(&ra_lock);
+	if (!readahead_trace_active || ra_window != window)
+		goto out;
+	id = ra_trace_lookup(inode);
+	if (id >= 0)
+		goto out;
+	if (ra_nr_files == RA_TRACE_MAX_FILES || !igrab(inode)) {
+		ra_dropped++;
+		goto out;
+	}
+	id = ra_nr_files++;
+	ra_files[id].inode = inode;
+	ra_files[id].path = path;
+	path = NULL;
+	h = hash_ptr(inode, RA_TRACE_HASH_BITS);
+	while (ra_hash[h])
+		h = (h + 1) & ((1 << RA_TRACE_HASH_BITS) - 1);
+	ra_hash[h] = id + 1;
+out:
+	spin_unlock(&ra_lock);
+	kfree(path);
+	return id;
+}
+
+void __readahead_trace_access(struct file *file, pgoff_t index, int cached)
+{
+	struct address_space *mapping = file->f_mapping;
+	unsigned int window;
+	int id;
+
+	/* Only regular files on real storage are worth prefetching */
+	if (!S_ISREG(mapping->host->i_mode) ||
+	    !mapping_cap_account_dirty(mapping) || index != (u32)index)
+		return;
+
+	spin_lock(&ra_lock);
+	if (!readahead_trace_active)
+		goto out;
+	ra_accesses++;
+	if (!cached)
+		ra_misses++;
+	id = ra_trace_lookup(mapping->host);
+	if (id < 0) {
+		window = ra_window;
+		spin_unlock(&ra_lock);
+		id = ra_trace_add_file(file, window);
+		if (id < 0)
+			return;
+		spin_lock(&ra_lock);
+		if (!readahead_trace_active || ra_window != window)
+			goto out;
+	}
+	if (ra_nr_recs < RA_TRACE_MAX_RECORDS) {
+		ra_recs[ra_nr_recs].file = id;
+		ra_recs[ra_nr_recs].index = index;
+		ra_nr_recs++;
+	} else
+		ra_dropped++;
+out:
+	spin_unlock(&ra_lock);
+}
+
+/*
+ * filemap_fault() calls this before it locks the page: the first access
+ * to a file allocates and builds its path, which must not happen with a
+ * page locked.
+ */
+void __readahead_trace_fault(struct file *file, pgoff_t index)
+{
+	struct page *page = find_get_page(file->f_mapping, index);
+
+	__readahead_trace_access(file, index, page != NULL);
+	if (page)
+		page_cache_release(page);
+}
+
+static int ra_rec_cmp(const void *a, const void *b)
+{
+	const struct ra_trace_rec *l = a, *r = b;
+
+	if (l->file != r->file)
+		return l->file < r->file ? -1 : 1;
+	if (l->index != r->index)
+		return l->index < r->index ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Turn sorted records into ranges, in place.  Returns the number of
+ * ranges; each range reuses a record with .index as start and .file
+ * as page count.  Ranges of one file stay contiguous.
+ */
+static unsigned int ra_trace_merge(struct ra_trace_rec *recs, unsigned int nr,
+				   unsigned int *file_of)
+{
+	unsigned int i, n = 0;
+	u32 start = 0, end = 0, file = 0;
+
+	for (i = 0; i < nr; i++) {
+		if (n && recs[i].file == file &&
+		    recs[i].index <= end + RA_TRACE_MERGE_GAP) {
+			if (recs[i].index >= end)
+				end = recs[i].index + 1;
+			continue;
+		}
+		if (n) {
+			recs[n - 1].index = start;
+			recs[n - 1].file = end - start;
+		}
+		file = recs[i].file;
+		start = recs[i].index;
+		end = start + 1;
+		file_of[n++] = file;
+	}
+	if (n) {
+		recs[n - 1].index = start;
+		recs[n - 1].file = end - start;
+	}
+	return n;
+}
+
+/*
+ * Close the recording window and build the trace from it.  Called with
+ * ra_mutex held.
+ */
+static void ra_trace_stop(void)
+{
+	struct ra_trace_rec *recs;
+	struct ra_trace_inode *files;
+	struct ra_trace_header *hdr;
+	unsigned int nr_recs, nr_files, nr_ranges, *file_of = NULL;
+	unsigned int i, r;
+	size_t size;
+	void *trace, *p;
+
+	spin_lock(&ra_lock);
+	readahead_trace_active = 0;
+	recs = ra_recs;
+	nr_recs = ra_nr_recs;
+	files = ra_files;
+	nr_files = ra_nr_files;
+	ra_recs = NULL;
+	ra_files = NULL;
+	ra_nr_recs = ra_nr_files = 0;
+	ra_last.accesses = ra_accesses;
+	ra_last.misses = ra_misses;
+	ra_last.dropped = ra_dropped;
+	spin_unlock(&ra_lock);
+
+	ra_last.duration_ms = jiffies_to_msecs(jiffies - ra_start);
+	ra_last.files = nr_files;
+	ra_last.ranges = 0;
+	ra_last.pages = 0;
+
+	sort(recs, nr_recs, sizeof(*recs), ra_rec_cmp, NULL);
+	if (nr_recs)
+		file_of = vmalloc(nr_recs * sizeof(*file_of));
+	nr_ranges = file_of ? ra_trace_merge(recs, nr_recs, file_of) : 0;
+
+	size = sizeof(*hdr) + nr_ranges * sizeof(struct ra_trace_range);
+	for (i = 0; i < nr_files; i++)
+		size += sizeof(struct ra_trace_file) +
+			ALIGN(strlen(files[i].path), 4);
+
+	trace = NULL;
+	if (nr_ranges && size <= RA_TRACE_MAX_SIZE)
+		trace = vmalloc(size);
+	if (trace) {
+		hdr = trace;
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->magic = RA_TRACE_MAGIC;
+		hdr->size = size;
+		memcpy(hdr->name, ra_name, sizeof(hdr->name));
+		p = hdr + 1;
+
+		for (i = 0, r = 0; i < nr_files; i++) {
+			struct ra_trace_file *f = p;
+			struct ra_trace_range *range;
+			unsigned int len = strlen(files[i].path);
+
+			f->nr_ranges = 0;
+			f->path_len = len;
+			f->reserved = 0;
+			p = f + 1;
+			memset(p, 0, ALIGN(len, 4));
+			memcpy(p, files[i].path, len);
+			p += ALIGN(len, 4);
+
+			for (range = p; r < nr_ranges && file_of[r] == i;
+			     r++, range++) {
+				range->start = recs[r].index;
+				range->nr_pages = recs[r].file;
+				ra_last.pages += range->nr_pages;
+				f->nr_ranges++;
+			}
+			p = range;
+			hdr->nr_files++;
+		}
+		/* Files without ranges only happen if records were dropped */
+		hdr->size = p - trace;
+		ra_last.ranges = nr_ranges;
+	}
+
+	vfree(ra_trace);
+	ra_trace = trace;
+	ra_trace_size = trace ? ((struct ra_trace_header *)trace)->size : 0;
+
+	vfree(file_of);
+	vfree(recs);
+	for (i = 0; i < nr_files; i++) {
+		iput(files[i].inode);
+		kfree(files[i].path);
+	}
+	kfree(files);
+}
+
+static int ra_trace_start(const char *name)
+{
+	struct ra_trace_rec *recs;
+	struct ra_trace_inode *files;
+
+	if (readahead_trace_active)
+		return -EBUSY;
+
+	recs = vmalloc(RA_TRACE_MAX_RECORDS * sizeof(*recs));
+	files = kcalloc(RA_TRACE_MAX_FILES, sizeof(*files), GFP_KERNEL);
+	if (!recs || !files) {
+		vfree(recs);
+		kfree(files);
+		return -ENOMEM;
+	}
+
+	strlcpy(ra_name, name, sizeof(ra_name));
+	ra_start = jiffies;
+	ra_deadline = ra_start + msecs_to_jiffies(RA_TRACE_MAX_WINDOW_MS);
+
+	spin_lock(&ra_lock);
+	ra_recs = recs;
+	ra_files = files;
+	ra_nr_recs = ra_nr_files = 0;
+	memset(ra_hash, 0, sizeof(ra_hash));
+	ra_accesses = ra_misses = ra_dropped = 0;
+	ra_window++;
+	readahead_trace_active = 1;
+	spin_unlock(&ra_lock);
+
+	schedule_delayed_work(&ra_timeout_work,
+			      msecs_to_jiffies(RA_TRACE_MAX_WINDOW_MS));
+	return 0;
+}
+
+/* Windows left open by a crashed or confused launcher end on their own */
+static void ra_trace_timeout(struct work_struct *work)
+{
+	mutex_lock(&ra_mutex);
+	if (readahead_trace_active && time_after_eq(jiffies, ra_deadline)) {
+		pr_info("readahead_trace: window %s timed out\n", ra_name);
+		ra_trace_stop();
+	}
+	mutex_unlock(&ra_mutex);
+}
+
+/*
+ * Check a trace before replaying it: every file entry, path and range
+ * must lie within the trace.
+ */
+static int ra_trace_valid(void *trace, size_t size)
+{
+	struct ra_trace_header *hdr = trace;
+	void *p, *end = trace + size;
+	unsigned int i;
+
+	if (size < sizeof(*hdr) || hdr->magic != RA_TRACE_MAGIC ||
+	    hdr->size != size)
+		return 0;
+	p = hdr + 1;
+	for (i = 0; i < hdr->nr_files; i++) {
+		struct ra_trace_file *f = p;
+
+		if (end - p < sizeof(*f))
+			return 0;
+		p = f + 1;
+		if (!f->path_len || f->path_len >= PATH_MAX ||
+		    end - p < ALIGN(f->path_len, 4))
+			return 0;
+		p += ALIGN(f->path_len, 4);
+		if ((end - p) / sizeof(struct ra_trace_range) < f->nr_ranges)
+			return 0;
+		p += f->nr_ranges * sizeof(struct ra_trace_range);
+	}
+	return p == end;
+}
+
+static void ra_replay_file(const char *path, struct ra_trace_range *range,
+			   unsigned int nr_ranges)
+{
+	struct file *filp;
+	pgoff_t size;
+	int ret;
+
+	filp = filp_open(path, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(filp)) {
+		ra_replay.failed++;
+		return;
+	}
+	ra_replay.files++;
+
+	size = (i_size_read(filp->f_mapping->host) + PAGE_CACHE_SIZE - 1) >>
+		PAGE_CACHE_SHIFT;
+	for (; nr_ranges; nr_ranges--, range++) {
+		unsigned long nr = range->nr_pages;
+
+		if (range->start >= size)
+			continue;
+		nr = min_t(unsigned long, nr, size - range->start);
+		ret = force_page_cache_readahead(filp->f_mapping, filp,
+						 range->start, nr);
+		ra_replay.ranges++;
+		ra_replay.pages += nr;
+		if (ret > 0)
+			ra_replay.submitted += ret;
+	}
+	filp_close(filp, NULL);
+}
+
+static void ra_replay_work_fn(struct work_struct *work)
+{
+	struct ra_trace_header *hdr;
+	unsigned long start = jiffies;
+	char *path;
+	void *p;
+	unsigned int i;
+
+	path = kmalloc(PATH_MAX, GFP_KERNEL);
+
+	mutex_lock(&ra_mutex);
+	hdr = ra_replay_trace;
+	memcpy(ra_replay.name, hdr->name, sizeof(ra_replay.name));
+	ra_replay.name[sizeof(ra_replay.name) - 1] = '\0';
+	ra_replay.files = ra_replay.failed = ra_replay.ranges = 0;
+	ra_replay.pages = ra_replay.submitted = 0;
+	mutex_unlock(&ra_mutex);
+
+	p = hdr + 1;
+	for (i = 0; path && i < hdr->nr_files; i++) {
+		struct ra_trace_file *f = p;
+
+		p = f + 1;
+		memcpy(path, p, f->path_len);
+		path[f->path_len] = '\0';
+		p += ALIGN(f->path_len, 4);
+		ra_replay_file(path, p, f->nr_ranges);
+		p += f->nr_ranges * sizeof(struct ra_trace_range);
+		cond_resched();
+	}
+	kfree(path);
+
+	mutex_lock(&ra_mutex);
+	ra_replay.duration_ms = jiffies_to_msecs(jiffies - start);
+	vfree(ra_replay_trace);
+	ra_replay_trace = NULL;
+	ra_replay_running = 0;
+	mutex_unlock(&ra_mutex);
+}
+
+static DECLARE_WORK(ra_replay_work, ra_replay_work_fn);
+
+static ssize_t ra_control_write(struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	char buf[RA_TRACE_NAME_LEN + 8];
+	char *cmd;
+	int ret = 0;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+	cmd = strstrip(buf);
+
+	mutex_lock(&ra_mutex);
+	if (!strncmp(cmd, "start ", 6) && cmd[6])
+		ret = ra_trace_start(cmd + 6);
+	else if (!strcmp(cmd, "stop")) {
+		if (readahead_trace_active) {
+			cancel_delayed_work(&ra_timeout_work);
+			ra_trace_stop();
+		} else
+			ret = -EINVAL;
+	} else
+		ret = -EINVAL;
+	mutex_unlock(&ra_mutex);
+
+	return ret ? ret : count;
+}
+
+static int ra_control_show(struct seq_file *m, void *v)
+{
+	mutex_lock(&ra_mutex);
+	if (readahead_trace_active)
+		seq_printf(m, "recording %s for %u ms\n", ra_name,
+			   jiffies_to_msecs(jiffies - ra_start));
+	else
+		seq_printf(m, "idle\n");
+
+	seq_printf(m, "window %s: %u ms, %lu accesses, %lu misses, "
+		   "%lu dropped\n",
+		   ra_name[0] ? ra_name : "-", ra_last.duration_ms,
+		   ra_last.accesses, ra_last.misses, ra_last.dropped);
+	seq_printf(m, "trace: %zu bytes, %u files, %u ranges, %lu pages\n",
+		   ra_trace_size, ra_last.files, ra_last.ranges,
+		   ra_last.pages);
+	seq_printf(m, "replay %s%s: %u ms, %u files (%u failed), "
+		   "%u ranges, %lu pages, %lu submitted, %lu busy\n",
+		   ra_replay.name[0] ? ra_replay.name : "-",
+		   ra_replay_running ? " (running)" : "",
+		   ra_replay.duration_ms, ra_replay.files, ra_replay.failed,
+		   ra_replay.ranges, ra_replay.pages, ra_replay.submitted,
+		   ra_replay.busy);
+	mutex_unlock(&ra_mutex);
+	return 0;
+}
+
+static int ra_control_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ra_control_show, NULL);
+}
+
+static const struct file_operations ra_control_fops = {
+	.open		= ra_control_open,
+	.read		= seq_read,
+	.write		= ra_control_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t ra_trace_read(struct file *file, char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&ra_mutex);
+	ret = simple_read_from_buffer(ubuf, count, ppos, ra_trace,
+				      ra_trace_size);
+	mutex_unlock(&ra_mutex);
+	return ret;
+}
+
+static const struct file_operations ra_trace_fops = {
+	.read		= ra_trace_read,
+};
+
+/*
+ * A trace may arrive in several writes; it is checked and replayed once
+ * the file is closed.
+ */
+struct ra_replay_buf {
+	void *data;
+	size_t len;
+};
+
+static int ra_replay_open(struct inode *inode, struct file *file)
+{
+	struct ra_replay_buf *rb;
+
+	rb = kzalloc(sizeof(*rb), GFP_KERNEL);
+	if (!rb)
+		return -ENOMEM;
+	rb->data = vmalloc(RA_TRACE_MAX_SIZE);
+	if (!rb->data) {
+		kfree(rb);
+		return -ENOMEM;
+	}
+	file->private_data = rb;
+	return 0;
+}
+
+static ssize_t ra_replay_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	struct ra_replay_buf *rb = file->private_data;
+	loff_t pos = *ppos;
+
+	if (pos < 0 || pos >= RA_TRACE_MAX_SIZE)
+		return -EFBIG;
+	count = min_t(size_t, count, RA_TRACE_MAX_SIZE - pos);
+	if (copy_from_user(rb->data + pos, ubuf, count))
+		return -EFAULT;
+	*ppos = pos + count;
+	rb->len = max_t(size_t, rb->len, pos + count);
+	return count;
+}
+
+static int ra_replay_release(struct inode *inode, struct file *file)
+{
+	struct ra_replay_buf *rb = file->private_data;
+	int ret = 0;
+
+	if (!ra_trace_valid(rb->data, rb->len)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ra_mutex);
+	if (ra_replay_running) {
+		ra_replay.busy++;
+		mutex_unlock(&ra_mutex);
+		goto out;
+	}
+	ra_replay_running = 1;
+	ra_replay_trace = rb->data;
+	rb->data = NULL;
+	mutex_unlock(&ra_mutex);
+	queue_work(ra_replay_wq, &ra_replay_work);
+out:
+	vfree(rb->data);
+	kfree(rb);
+	return ret;
+}
+
+static const struct file_operations ra_replay_fops = {
+	.open		= ra_replay_open,
+	.write		= ra_replay_write,
+	.release	= ra_replay_release,
+};
+
+static int __init readahead_trace_init(void)
+{
+	struct dentry *dir;
+
+	ra_replay_wq = create_singlethread_workqueue("ra_replay");
+	if (!ra_replay_wq)
+		return -ENOMEM;
+
+	dir = debugfs_create_dir("readahead_trace", NULL);
+	if (!dir)
+		return 0;
+	debugfs_create_file("control", 0600, dir, NULL, &ra_control_fops);
+	debugfs_create_file("trace", 0400, dir, NULL, &ra_trace_fops);
+	debugfs_create_file("replay", 0200, dir, NULL, &ra_replay_fops);
+	return 0;
+}
+late_initcall(readahead_trace_init);
@@ -3388,26 +3388,47 @@ __do_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
 
 #endif /* CONFIG_NUMA */
 
+/*
+ * The checks and hooks around __do_cache_alloc(), shared by the single
+ * and the bulk allocation paths.
+ */
+static __always_inline int
+cache_alloc_prepare(struct kmem_cache *cachep, gfp_t flags)
+{
+	if (slab_should_failslab(cachep, flags))
+		return 0;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+	return 1;
+}
+
+static __always_inline void *
+cache_alloc_finish(struct kmem_cache *cachep, gfp_t flags, void *objp,
+		   void *caller)
+{
+	objp = cache_alloc_debugcheck_after(cachep, flags, objp, caller);
+	prefetchw(objp);
+
+	if (unlikely((flags & __GFP_ZERO) && objp))
+		memset(objp, 0, obj_size(cachep));
+
+	return objp;
+}
+
 static __always_inline void *
 __cache_alloc(struct kmem_cache *cachep, gfp_t flags, void *caller)
 {
 	unsigned long save_flags;
 	void *objp;
 
-	if (slab_should_failslab(cachep, flags))
+	if (!cache_alloc_prepare(cachep, flags))
 		return NULL;
 
-	cache_alloc_debugcheck_before(cachep, flags);
 	local_irq_save(save_flags);
 	objp = __do_cache_alloc(cachep, flags);
 	local_irq_restore(save_flags);
-	objp = cache_alloc_debugcheck_after(cachep, flags, objp, caller);
-	prefetchw(objp);
 
-	if (unlikely((flags & __GFP_ZERO) && objp))
-		memset(objp, 0, obj_size(cachep));
-
-	return objp;
+	return cache_alloc_finish(cachep, flags, objp, caller);
 }
 
 /*
@@ -3554,6 +3575,43 @@ void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - Allocate several objects at once
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @size: Number of objects to allocate.
+ * @p: Array receiving the objects.
+ *
+ * Returns @size if all objects were allocated, or 0 if none were.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags,
+			size_t size, void **p)
+{
+	void *caller = __builtin_return_address(0);
+	unsigned long save_flags;
+	size_t i, j;
+
+	if (!cache_alloc_prepare(cachep, flags))
+		return 0;
+
+	local_irq_save(save_flags);
+	for (i = 0; i < size; i++) {
+		p[i] = __do_cache_alloc(cachep, flags);
+		if (unlikely(!p[i]))
+			break;
+	}
+	local_irq_restore(save_flags);
+
+	for (j = 0; j < i; j++)
+		p[j] = cache_alloc_finish(cachep, flags, p[j], caller);
+	if (unlikely(i < size)) {
+		kmem_cache_free_bulk(cachep, i, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /**
  * kmem_ptr_validate - check if an untrusted pointer might be a slab entry.
  * @cachep: the cache we're checking against
@@ -3702,6 +3760,31 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_free_bulk - Deallocate several objects at once
+ * @cachep: The cache the allocations were from.
+ * @size: Number of objects in @p.
+ * @p: The previously allocated objects.
+ *
+ * Like calling kmem_cache_free() on each object, with interrupts
+ * disabled only once for the batch.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t size, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < size; i++) {
+		debug_check_no_locks_freed(p[i], obj_size(cachep));
+		if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(p[i], obj_size(cachep));
+		__cache_free(cachep, p[i]);
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
@@ -0,0 +1,225 @@
+/*
+ * Slab allocator microbenchmark
+ *
+ * Measures kmem_cache alloc/free throughput for a set of object sizes
+ * and thread counts, first one object at a time and then through
+ * kmem_cache_alloc_bulk()/kmem_cache_free_bulk().  Results are printed
+ * when the module is loaded:
+ *
+ *	modprobe slab_bench sizes=64,256,1024 max_threads=2 batch=16
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+
+#define BENCH_MAX_SIZES	16
+#define BENCH_MAX_BATCH	64
+
+static int sizes[BENCH_MAX_SIZES] = { 32, 64, 128, 256, 512, 1024, 2048 };
+static int nr_sizes = 7;
+module_param_array(sizes, int, &nr_sizes, 0444);
+MODULE_PARM_DESC(sizes, "Object sizes to benchmark");
+
+static int max_threads;
+module_param(max_threads, int, 0444);
+MODULE_PARM_DESC(max_threads,
+		 "Largest thread count, doubling from 1 (default: online cpus)");
+
+static int iterations = 100000;
+module_param(iterations, int, 0444);
+MODULE_PARM_DESC(iterations, "Objects allocated and freed per thread");
+
+static int batch = 16;
+module_param(batch, int, 0444);
+MODULE_PARM_DESC(batch, "Objects per bulk call (max 64)");
+
+struct bench_thread {
+	struct task_struct *task;
+	struct kmem_cache *cache;
+	struct completion *start;
+	struct completion done;
+	u64 single_ns;
+	u64 bulk_ns;
+	int failed;
+};
+
+static u64 bench_single(struct bench_thread *bt, int loops)
+{
+	void *objs[BENCH_MAX_BATCH];
+	ktime_t t0 = ktime_get();
+	int i, j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < batch; j++) {
+			objs[j] = kmem_cache_alloc(bt->cache, GFP_KERNEL);
+			if (!objs[j])
+				break;
+		}
+		if (j < batch)
+			bt->failed = 1;
+		while (j--)
+			kmem_cache_free(bt->cache, objs[j]);
+		cond_resched();
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), t0));
+}
+
+static u64 bench_bulk(struct bench_thread *bt, int loops)
+{
+	void *objs[BENCH_MAX_BATCH];
+	ktime_t t0 = ktime_get();
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		if (!kmem_cache_alloc_bulk(bt->cache, GFP_KERNEL, batch,
+					   objs)) {
+			bt->failed = 1;
+			continue;
+		}
+		kmem_cache_free_bulk(bt->cache, batch, objs);
+		cond_resched();
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), t0));
+}
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	int loops = iterations / batch;
+
+	wait_for_completion(bt->start);
+
+	bt->single_ns = bench_single(bt, loops);
+	bt->bulk_ns = bench_bulk(bt, loops);
+	complete(&bt->done);
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int bench_nth_cpu(int n)
+{
+	int cpu;
+
+	n %= num_online_cpus();
+	for_each_online_cpu(cpu)
+		if (n-- == 0)
+			return cpu;
+	return first_cpu(cpu_online_map);
+}
+
+static u64 bench_rate(u64 ops, u64 ns)
+{
+	if (!ns)
+		return 0;
+	return div64_u64(ops * NSEC_PER_SEC, ns);
+}
+
+static int bench_run(int size, int nr_threads)
+{
+	struct completion start;
+	struct bench_thread *bt;
+	struct kmem_cache *cache;
+	u64 single_ns = 0, bulk_ns = 0, ops;
+	int i, started = 0, failed = 0, ret = 0;
+
+	cache = kmem_cache_create("slab_bench", size, 0, 0, NULL);
+	if (!cache)
+		return -ENOMEM;
+
+	bt = kcalloc(nr_threads, sizeof(*bt), GFP_KERNEL);
+	if (!bt) {
+		kmem_cache_destroy(cache);
+		return -ENOMEM;
+	}
+
+	init_completion(&start);
+	for (i = 0; i < nr_threads; i++) {
+		bt[i].cache = cache;
+		bt[i].start = &start;
+		init_completion(&bt[i].done);
+		bt[i].task = kthread_create(bench_thread_fn, &bt[i],
+					    "slab_bench/%d", i);
+		if (IS_ERR(bt[i].task)) {
+			ret = PTR_ERR(bt[i].task);
+			break;
+		}
+		kthread_bind(bt[i].task, bench_nth_cpu(i));
+		wake_up_process(bt[i].task);
+		started++;
+	}
+
+	/* Release all threads together so the runs overlap. */
+	complete_all(&start);
+
+	for (i = 0; i < started; i++) {
+		wait_for_completion(&bt[i].done);
+		kthread_stop(bt[i].task);
+		single_ns = max(single_ns, bt[i].single_ns);
+		bulk_ns = max(bulk_ns, bt[i].bulk_ns);
+		failed |= bt[i].failed;
+	}
+
+	if (!ret) {
+		ops = (u64)nr_threads * (iterations / batch) * batch;
+		pr_info("slab_bench: size %5d threads %2d: "
+			"single %llu ops/s, bulk(%d) %llu ops/s%s\n",
+			size, nr_threads,
+			(unsigned long long)bench_rate(ops, single_ns), batch,
+			(unsigned long long)bench_rate(ops, bulk_ns),
+			failed ? " (allocation failures)" : "");
+	}
+
+	kfree(bt);
+	kmem_cache_destroy(cache);
+	return ret;
+}
+
+static int __init slab_bench_init(void)
+{
+	int i, threads, ret;
+
+	if (batch < 1 || batch > BENCH_MAX_BATCH || iterations < batch)
+		return -EINVAL;
+	if (max_threads <= 0)
+		max_threads = num_online_cpus();
+
+	for (i = 0; i < nr_sizes; i++) {
+		if (sizes[i] <= 0)
+			continue;
+		for (threads = 1; threads <= max_threads; threads <<= 1) {
+			ret = bench_run(sizes[i], threads);
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+static void __exit slab_bench_exit(void)
+{
+}
+
+module_init(slab_bench_init);
+module_exit(slab_bench_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("Slab allocator microbenchmark");
@@ -1448,6 +1448,60 @@ static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	deactivate_slab(s, c);
 }
 
+/*
+ * Move all but the first @keep slabs of the cpu partial list back to the
+ * node partial lists, coldest first. The list_lock is taken once for a
+ * run of slabs from the same node instead of once per slab.
+ *
+ * Taking the slab lock under list_lock is safe here since the slabs are
+ * frozen and owned by this cpu: a remote free locks them only briefly
+ * and never goes for the list_lock of a frozen slab.
+ *
+ * Interrupts must be disabled, or the cpu must be dead.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c,
+				int keep)
+{
+	struct kmem_cache_node *n = NULL;
+	struct page *page, *t;
+	LIST_HEAD(discard);
+
+	while (c->nr_partial > keep) {
+		struct kmem_cache_node *n2;
+
+		page = list_entry(c->partial.prev, struct page, lru);
+		list_del(&page->lru);
+		c->nr_partial--;
+		stat(c, CPU_PARTIAL_DRAIN);
+
+		n2 = get_node(s, page_to_nid(page));
+		if (n != n2) {
+			if (n)
+				spin_unlock(&n->list_lock);
+			n = n2;
+			spin_lock(&n->list_lock);
+		}
+
+		slab_lock(page);
+		__ClearPageSlubFrozen(page);
+		if (!page->inuse && n->nr_partial >= n->min_partial)
+			list_add(&page->lru, &discard);
+		else if (page->freelist) {
+			list_add_tail(&page->lru, &n->partial);
+			n->nr_partial++;
+		}
+		slab_unlock(page);
+	}
+	if (n)
+		spin_unlock(&n->list_lock);
+
+	list_for_each_entry_safe(page, t, &discard, lru) {
+		list_del(&page->lru);
+		stat(c, FREE_SLAB);
+		discard_slab(s, page);
+	}
+}
+
 /*
  * Flush cpu slab.
  *
@@ -1457,8 +1511,11 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = get_cpu_slab(s, cpu);
 
-	if (likely(c && c->page))
+	if (unlikely(!c))
+		return;
+	if (c->page)
 		flush_slab(s, c);
+	unfreeze_partials(s, c, 0);
 }
 
 static void flush_cpu_slab(void *d)
@@ -1496,9 +1553,10 @@ static inline int node_match(struct kmem_cache_cpu *c, int node)
  * regular freelist. In that case we simply take over the regular freelist
  * as the lockless freelist and zap the regular freelist.
  *
- * If that is not working then we fall back to the partial lists. We take the
- * first element of the freelist as the object to allocate now and move the
- * rest of the freelist to the lockless freelist.
+ * If that is not working then we fall back to the partial lists, first the
+ * one private to this cpu, which needs no list_lock, then the node's. We
+ * take the first element of the freelist as the object to allocate now and
+ * move the rest of the freelist to the lockless freelist.
  *
  * And if we were unable to get a new slab from the partial slab lists then
  * we need to allocate a new slab. This is the slowest path since it involves
@@ -1542,6 +1600,18 @@ another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
+	if (c->nr_partial) {
+		new = list_first_entry(&c->partial, struct page, lru);
+		if (node == -1 || page_to_nid(new) == node) {
+			list_del(&new->lru);
+			c->nr_partial--;
+			slab_lock(new);
+			c->page = new;
+			stat(c, CPU_PARTIAL_ALLOC);
+			goto load_freelist;
+		}
+	}
+
 	new = get_partial(s, gfpflags, node);
 	if (new) {
 		c->page = new;
@@ -1672,9 +1742,22 @@ checks_ok:
 
 	/*
 	 * Objects left in the slab. If it was not on the partial list before
-	 * then add it.
+	 * then add it, preferably to this cpu's partial list so that neither
+	 * this free nor the allocation that refills from it has to take the
+	 * list_lock. The slab is frozen while it sits there.
 	 */
 	if (unlikely(!prior)) {
+		if (s->cpu_partial && !(SLABDEBUG && PageSlubDebug(page)) &&
+				page_to_nid(page) == numa_node_id()) {
+			__SetPageSlubFrozen(page);
+			list_add(&page->lru, &c->partial);
+			c->nr_partial++;
+			stat(c, CPU_PARTIAL_FREE);
+			slab_unlock(page);
+			if (c->nr_partial > s->cpu_partial)
+				unfreeze_partials(s, c, s->cpu_partial / 2);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(c, FREE_ADD_PARTIAL);
 	}
@@ -1713,15 +1796,12 @@ debug:
  * If fastpath is not possible then fall back to __slab_free where we deal
  * with all sorts of special processing.
  */
-static __always_inline void slab_free(struct kmem_cache *s,
-			struct page *page, void *x, unsigned long addr)
+static __always_inline void __slab_free_cpu(struct kmem_cache *s,
+			struct kmem_cache_cpu *c, struct page *page, void *x,
+			unsigned long addr)
 {
 	void **object = (void *)x;
-	struct kmem_cache_cpu *c;
-	unsigned long flags;
 
-	local_irq_save(flags);
-	c = get_cpu_slab(s, smp_processor_id());
 	debug_check_no_locks_freed(object, c->objsize);
 	if (!(s->flags & SLAB_DEBUG_OBJECTS))
 		debug_check_no_obj_freed(object, s->objsize);
@@ -1731,7 +1811,15 @@ static __always_inline void slab_free(struct kmem_cache *s,
 		stat(c, FREE_FASTPATH);
 	} else
 		__slab_free(s, page, x, addr, c->offset);
+}
 
+static __always_inline void slab_free(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__slab_free_cpu(s, get_cpu_slab(s, smp_processor_id()), page, x, addr);
 	local_irq_restore(flags);
 }
 
@@ -1745,6 +1833,72 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Bulk interfaces. Interrupts are disabled and the cpu structure looked
+ * up once for the whole batch; every object still goes through the same
+ * fast and slow paths as a single kmem_cache_alloc()/kmem_cache_free().
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	unsigned long flags;
+	struct kmem_cache_cpu *c;
+	size_t i;
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+	for (i = 0; i < size; i++)
+		__slab_free_cpu(s, c, virt_to_head_page(p[i]), p[i],
+				_RET_IP_);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/*
+ * Returns @size with all objects allocated, or 0 with none allocated.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t gfpflags, size_t size,
+			void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	might_sleep_if(gfpflags & __GFP_WAIT);
+
+	if (should_failslab(s->objsize, gfpflags))
+		return 0;
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+	for (i = 0; i < size; i++) {
+		void **object = c->freelist;
+
+		if (unlikely(!object)) {
+			/* may enable interrupts and move us to another cpu */
+			p[i] = __slab_alloc(s, gfpflags, -1, _RET_IP_, c);
+			c = get_cpu_slab(s, smp_processor_id());
+			if (unlikely(!p[i]))
+				goto error;
+			continue;
+		}
+		c->freelist = object[c->offset];
+		p[i] = object;
+		stat(c, ALLOC_FASTPATH);
+	}
+	local_irq_restore(flags);
+
+	if (unlikely(gfpflags & __GFP_ZERO))
+		for (i = 0; i < size; i++)
+			memset(p[i], 0, s->objsize);
+	return size;
+
+error:
+	local_irq_restore(flags);
+	kmem_cache_free_bulk(s, i, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /* Figure out on which slab page the object resides */
 static struct page *get_object_page(const void *x)
 {
@@ -1919,6 +2073,8 @@ static void init_kmem_cache_cpu(struct kmem_cache *s,
 	c->node = 0;
 	c->offset = s->offset / sizeof(void *);
 	c->objsize = s->objsize;
+	INIT_LIST_HEAD(&c->partial);
+	c->nr_partial = 0;
 #ifdef CONFIG_SLUB_STATS
 	memset(c->stat, 0, NR_SLUB_STAT_ITEMS * sizeof(unsigned));
 #endif
@@ -2304,6 +2460,22 @@ static int calculate_sizes(struct kmem_cache *s, int forced_order)
 
 }
 
+/*
+ * Number of partial slabs each cpu may keep for itself. Fewer for large
+ * objects, where every slab already holds a lot of memory.
+ */
+static void set_cpu_partial(struct kmem_cache *s)
+{
+	if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 6;
+	else if (s->size >= 256)
+		s->cpu_partial = 13;
+	else
+		s->cpu_partial = 30;
+}
+
 static int kmem_cache_open(struct kmem_cache *s, gfp_t gfpflags,
 		const char *name, size_t size,
 		size_t align, unsigned long flags,
@@ -2320,6 +2492,7 @@ static int kmem_cache_open(struct kmem_cache *s, gfp_t gfpflags,
 		goto error;
 
 	s->refcount = 1;
+	set_cpu_partial(s);
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
 #endif
@@ -3871,6 +4044,44 @@ static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(cpu_slabs);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects > INT_MAX)
+		return -EINVAL;
+
+	s->cpu_partial = objects;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	unsigned long slabs = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct kmem_cache_cpu *c = get_cpu_slab(s, cpu);
+
+		if (c)
+			slabs += c->nr_partial;
+	}
+	return sprintf(buf, "%lu\n", slabs);
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t objects_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_ALL|SO_OBJECTS);
@@ -4144,6 +4355,9 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4157,6 +4371,8 @@ static struct attribute *slab_attrs[] = {
 	&slabs_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&cpu_partial_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4197,6 +4413,9 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_drain_attr.attr,
 #endif
 	NULL
 };
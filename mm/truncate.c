@@ -135,6 +135,51 @@ invalidate_complete_page(struct address_space *mapping, struct page *page)
 	return ret;
 }
 
+/*
+ * Remove up to @nr_to_drop shadow entries of evicted pages between @start
+ * and @end, and return how many were removed.  The page lookups do not
+ * see them, and left alone they would pin radix tree nodes after the
+ * last page of the mapping is gone.  The shadow shrinker uses this too.
+ */
+unsigned long truncate_shadow_entries(struct address_space *mapping,
+				      pgoff_t start, pgoff_t end,
+				      unsigned long nr_to_drop)
+{
+	void **slots[PAGEVEC_SIZE];
+	void *entries[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned long dropped = 0;
+	pgoff_t next = start;
+	unsigned int i, nr;
+
+	while (next <= end && mapping->nrshadows && dropped < nr_to_drop) {
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, next, PAGEVEC_SIZE);
+		/* deleting may free the nodes holding later slots */
+		for (i = 0; i < nr; i++)
+			entries[i] = *slots[i];
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			if (!radix_tree_exceptional_entry(entries[i]))
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+			atomic_long_dec(&workingset_shadows);
+			if (++dropped >= nr_to_drop)
+				break;
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (!nr)
+			break;
+		next = indices[nr - 1] + 1;
+		if (!next)
+			break;		/* wrapped around */
+		cond_resched();
+	}
+	return dropped;
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -168,7 +213,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t next;
 	int i;
 
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
@@ -251,6 +296,10 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		}
 		pagevec_release(&pvec);
 	}
+
+	/* With the pages gone, no new shadows can appear in the range */
+	if (mapping->nrshadows)
+		truncate_shadow_entries(mapping, start, end, ULONG_MAX);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -357,7 +406,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(PagePrivate(page));
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	page_cache_release(page);	/* pagecache ref */
 	return 1;
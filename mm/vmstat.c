@@ -663,6 +663,8 @@ static const char * const vmstat_text[] = {
 	"nr_bounce",
 	"nr_vmscan_write",
 	"nr_writeback_temp",
+	"workingset_refault",
+	"workingset_activate",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -701,6 +703,21 @@ static const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+
+	"pgalloc_highorder",
+	"pgalloc_highorder_usecs",
+	"pgalloc_highorder_slow",
+	"pgalloc_pcp_highorder_hit",
+	"pgalloc_pcp_highorder_miss",
+	"zone_lock_contended",
+#ifdef CONFIG_COMPACTION
+	"compact_blocks_moved",
+	"compact_pages_moved",
+	"compact_pagemigrate_failed",
+	"compact_stall",
+	"compact_fail",
+	"compact_success",
+#endif
 #ifdef CONFIG_HUGETLB_PAGE
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
@@ -721,7 +738,7 @@ static const char * const vmstat_text[] = {
 static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 							struct zone *zone)
 {
-	int i;
+	int i, j;
 	seq_printf(m, "Node %d, zone %8s", pgdat->node_id, zone->name);
 	seq_printf(m,
 		   "\n  pages free     %lu"
@@ -770,6 +787,12 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 			   pageset->pcp.count,
 			   pageset->pcp.high,
 			   pageset->pcp.batch);
+		for (j = 0; j < PCP_MAX_ORDER; j++)
+			seq_printf(m, "\n     order %d count: %i high: %i"
+				   " batch: %i", j + 1,
+				   pageset->hpcp[j].count,
+				   pageset->hpcp[j].high,
+				   pageset->hpcp[j].batch);
 #ifdef CONFIG_SMP
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);
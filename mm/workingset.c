@@ -0,0 +1,250 @@
+/*
+ * Workingset detection
+ *
+ * Per zone, two clocks are maintained for the file LRU pages: the
+ * inactive age, which advances whenever a page is evicted from or
+ * activated out of the inactive file list, and the size of the active
+ * file list.
+ *
+ * When a file page is evicted, the current inactive age is stored in a
+ * shadow entry in the page's slot of the page cache radix tree.  Should
+ * the page be read in again, the distance between that snapshot and the
+ * inactive age at refault time is the number of inactive list slots it
+ * would have needed to stay cached: the refault distance.
+ *
+ * A page evicted with a refault distance no larger than the active file
+ * list could have stayed resident by displacing active pages.  It was
+ * evicted only because the inactive list is a fraction of memory, as
+ * happens when a large streaming read pushes through it.  Such a page is
+ * part of the working set and is put straight back on the active list.
+ * Pages with longer distances go onto the inactive list as usual, so
+ * that pages used once are reclaimed before the active working set.
+ *
+ * Shadow entries are replaced when the index is cached again and removed
+ * when the mapping is truncated, including when the inode is reclaimed.
+ * Mappings whose inodes stay in use would keep them, and the radix tree
+ * nodes holding them, forever.  Since every eviction advances the inactive
+ * age, only shadows from the last NR_ACTIVE_FILE evictions can still
+ * activate anything, so a shrinker trims the shadows beyond the size of
+ * the file LRU lists, a whole mapping at a time.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/radix-tree.h>
+#include <linux/memcontrol.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include "internal.h"
+
+/*
+ * The shadow entry holds the node and zone of the evicted page and as
+ * many low bits of the inactive age as fit next to them.  Distances are
+ * computed modulo that width.
+ */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 NODES_SHIFT + ZONES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @page: the page being read back in, already charged to its memcg
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.  The
+ * refault is also accounted to the memory cgroup of @page.
+ *
+ * Returns non-zero if the page should be activated.
+ */
+int workingset_refault(struct page *page, void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+	int activate = 0;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		activate = 1;
+	}
+	mem_cgroup_count_refault(page, activate);
+	return activate;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+atomic_long_t workingset_shadows = ATOMIC_LONG_INIT(0);
+
+/* Mappings that may hold shadow entries, oldest first */
+static LIST_HEAD(shadow_mappings);
+static DEFINE_SPINLOCK(shadow_lock);
+
+/**
+ * workingset_track_mapping - put a mapping on the shadow shrinker's list
+ * @mapping: mapping about to receive a shadow entry
+ *
+ * The caller keeps @mapping alive, usually with a locked page in it.
+ */
+void workingset_track_mapping(struct address_space *mapping)
+{
+	if (!list_empty(&mapping->shadow_list))
+		return;
+
+	spin_lock(&shadow_lock);
+	if (list_empty(&mapping->shadow_list))
+		list_add_tail(&mapping->shadow_list, &shadow_mappings);
+	spin_unlock(&shadow_lock);
+}
+
+/**
+ * workingset_forget_mapping - take a mapping off the shadow shrinker's list
+ * @mapping: mapping being torn down, with all its shadows truncated
+ */
+void workingset_forget_mapping(struct address_space *mapping)
+{
+	if (list_empty_careful(&mapping->shadow_list))
+		return;
+
+	spin_lock(&shadow_lock);
+	list_del_init(&mapping->shadow_list);
+	spin_unlock(&shadow_lock);
+}
+
+static unsigned long shadows_excess(void)
+{
+	unsigned long limit, nr;
+
+	limit = global_page_state(NR_ACTIVE_FILE) +
+		global_page_state(NR_INACTIVE_FILE);
+	nr = atomic_long_read(&workingset_shadows);
+	return nr > limit ? nr - limit : 0;
+}
+
+/*
+ * Drop shadows from the mappings tracked longest, rotating each one to the
+ * tail after a visit.  The inode is pinned while its tree is trimmed; one
+ * that is already being freed is skipped, its shadows go with it.
+ */
+static void shrink_shadow_mappings(unsigned long nr_to_drop)
+{
+	struct address_space *mapping;
+	struct inode *inode;
+	unsigned long dropped;
+
+	while (nr_to_drop) {
+		spin_lock(&shadow_lock);
+		if (list_empty(&shadow_mappings)) {
+			spin_unlock(&shadow_lock);
+			break;
+		}
+		mapping = list_first_entry(&shadow_mappings,
+					   struct address_space, shadow_list);
+		if (!mapping->nrshadows) {
+			list_del_init(&mapping->shadow_list);
+			spin_unlock(&shadow_lock);
+			continue;
+		}
+		list_move_tail(&mapping->shadow_list, &shadow_mappings);
+		inode = igrab(mapping->host);
+		spin_unlock(&shadow_lock);
+
+		dropped = 0;
+		if (inode) {
+			dropped = truncate_shadow_entries(mapping, 0, ~0UL,
+							  nr_to_drop);
+			iput(inode);
+		}
+		/* a visit costs at least one, so this always terminates */
+		nr_to_drop -= min(nr_to_drop, max(dropped, 1UL));
+	}
+}
+
+static int shrink_shadows(int nr_to_scan, gfp_t gfp_mask)
+{
+	unsigned long excess;
+
+	if (nr_to_scan) {
+		/* iput() may have to evict the inode */
+		if (!(gfp_mask & __GFP_FS))
+			return -1;
+		excess = shadows_excess();
+		if (excess)
+			shrink_shadow_mappings(min_t(unsigned long,
+						     nr_to_scan, excess));
+	}
+	return min_t(unsigned long, shadows_excess(), INT_MAX);
+}
+
+static struct shrinker shadow_shrinker = {
+	.shrink = shrink_shadows,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
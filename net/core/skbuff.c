@@ -419,6 +419,40 @@ void __kfree_skb(struct sk_buff *skb)
 	kfree_skbmem(skb);
 }
 
+/**
+ *	__kfree_skb_list - private function
+ *	@skb: first buffer of a list chained through skb->next
+ *
+ *	Free a list of sk_buffs whose last reference is already gone, as
+ *	__kfree_skb() would, but hand the heads back to the slab in batches.
+ */
+#define SKB_FREE_BULK 16
+
+void __kfree_skb_list(struct sk_buff *skb)
+{
+	void *heads[SKB_FREE_BULK];
+	int n = 0;
+
+	while (skb) {
+		struct sk_buff *next = skb->next;
+
+		WARN_ON(atomic_read(&skb->users));
+		skb_release_all(skb);
+		if (skb->fclone == SKB_FCLONE_UNAVAILABLE) {
+			heads[n++] = skb;
+			if (n == SKB_FREE_BULK) {
+				kmem_cache_free_bulk(skbuff_head_cache, n,
+						     heads);
+				n = 0;
+			}
+		} else
+			kfree_skbmem(skb);
+		skb = next;
+	}
+	if (n)
+		kmem_cache_free_bulk(skbuff_head_cache, n, heads);
+}
+
 /**
  *	kfree_skb - free an sk_buff
  *	@skb: buffer to free
@@ -2894,6 +2928,7 @@ void __skb_warn_lro_forwarding(const struct sk_buff *skb)
 
 EXPORT_SYMBOL(___pskb_trim);
 EXPORT_SYMBOL(__kfree_skb);
+EXPORT_SYMBOL(__kfree_skb_list);
 EXPORT_SYMBOL(kfree_skb);
 EXPORT_SYMBOL(__pskb_pull_tail);
 EXPORT_SYMBOL(__alloc_skb);